@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "rexwb.h"
+#include "msadpcm.h"
+#include "resample.h"
+#include "pool.h"
+#include "genbank.h"
+
+// rexwb_bench: time each stage of the conversion on synthetic banks, at several thread counts.
+// rexwb_bench gen OUT.xwb [...] only writes a synthetic bank
+
+static double Now( void )
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef struct {
+    WAVEBANKENTRYINFO       info;
+    int                     outrate;
+    std::vector<int16_t>    pcm;
+    uint32_t                frames;
+    std::vector<int16_t>    res;
+    uint32_t                resframes;
+    std::vector<uint8_t>    enc;
+} BENCHENTRY;
+
+static void DecodeJob( void* arg )
+{
+    BENCHENTRY* e = (BENCHENTRY*)arg;
+    const MINIWAVEFORMAT* fmt = &e->info.Format;
+    uint32_t chans = fmt->nChannels;
+    if(fmt->wFormatTag == MINIWAVEFORMAT::TAG_ADPCM) {
+        e->pcm.resize((size_t)AdpcmSamplesIn(e->info.dwLength, chans, fmt->BlockAlign(), fmt->AdpcmSamplesPerBlock())*chans);
+        e->frames = AdpcmDecode(e->info.data, e->info.dwLength, fmt, e->pcm.data());
+    } else if(fmt->wBitsPerSample == MINIWAVEFORMAT::BITDEPTH_8) {
+        e->frames = e->info.dwLength / chans;
+        e->pcm.resize((size_t)e->frames*chans);
+        for(size_t i=0; i<e->pcm.size(); ++i)
+            e->pcm[i] = (int16_t)((e->info.data[i] - 128) << 8);
+    } else {
+        e->frames = e->info.dwLength / (2*chans);
+        e->pcm.resize((size_t)e->frames*chans);
+        memcpy(e->pcm.data(), e->info.data, e->pcm.size()*2);
+    }
+}
+
+static void ResampleJob( void* arg )
+{
+    BENCHENTRY* e = (BENCHENTRY*)arg;
+    uint32_t chans = e->info.Format.nChannels;
+    const RESAMPLER* rs = GetResampler(e->info.Format.nSamplesPerSec, e->outrate, RESAMPLE_HIGH);
+    e->res.resize((size_t)ResampledLength(rs, e->frames)*chans);
+    e->resframes = Resample(rs, e->pcm.data(), e->frames, chans, e->res.data());
+}
+
+static void EncodeJob( void* arg )
+{
+    BENCHENTRY* e = (BENCHENTRY*)arg;
+    uint32_t chans = e->info.Format.nChannels;
+    e->enc.resize(AdpcmEncodedSize(e->resframes, chans, 256*chans));
+    AdpcmEncode(e->res.data(), e->resframes, chans, 256*chans, 0, NULL, e->enc.data());
+}
+
+// Run fn on every entry, one entry per work item. Return the best time of repeat runs
+static double RunStage( std::vector<BENCHENTRY>& entries, WORKFUNC fn, int threads, int repeat )
+{
+    double best = 1e30;
+    for(int r=0; r<repeat; ++r) {
+        double t0 = Now();
+        if(threads<=1) {
+            for(auto& e : entries)
+                fn(&e);
+        } else {
+            WORKERPOOL* pool = CreateWorkerPool(threads);
+            for(auto& e : entries)
+                SubmitWork(pool, fn, &e);
+            DestroyWorkerPool(pool);
+        }
+        best = std::min(best, Now() - t0);
+    }
+    return best;
+}
+
+static void PrintResult( const char* stage, int threads, double t, double bytes, uint32_t count )
+{
+    if(t <= 0)
+        t = 1e-9;
+    printf("  %-9s %7d %10.4f %10.1f %12.1f\n", stage, threads, t, bytes / t / (1<<20), count / t);
+}
+
+static int BenchBank( const char* name, const char* file, const char* outfile, const std::vector<int>& threads, int outrate, int repeat )
+{
+    WaveBank wb;
+    if(OpenWaveBank(&wb, file, 0))
+        return -1;
+    uint32_t count = wb.bank.dwEntryCount;
+    printf("%s: %u entries, %.1f MB of wave data\n", name, count, wb.waveLen / (double)(1<<20));
+    printf("  %-9s %7s %10s %10s %12s\n", "stage", "threads", "time (s)", "MB/s", "entries/s");
+
+    // header parsing: open the bank and read every entry, repeated for at least 0.2s
+    {
+        uint32_t n = 0;
+        double t0 = Now(), t = 0;
+        do {
+            WaveBank tmp;
+            if(OpenWaveBank(&tmp, file, 0))
+                break;
+            for(uint32_t j=0; j<count; ++j) {
+                WAVEBANKENTRYINFO info;
+                GetWaveBankEntry(&tmp, j, &info, 0);
+            }
+            CloseWaveBank(&tmp);
+            ++n;
+            t = Now() - t0;
+        } while(t < 0.2);
+        if(!n) {
+            printf("ERROR: Cannot reopen %s\n", file);
+            CloseWaveBank(&wb);
+            return -1;
+        }
+        PrintResult("parse", 1, t / n, wb.waveOffset, count);
+    }
+
+    std::vector<BENCHENTRY> entries(count);
+    double inBytes = 0, pcmBytes = 0, resBytes = 0;
+    for(uint32_t j=0; j<count; ++j) {
+        GetWaveBankEntry(&wb, j, &entries[j].info, 0);
+        entries[j].outrate = outrate;
+        inBytes += entries[j].info.dwLength;
+        // the filter tables are built out of the timings
+        GetResampler(entries[j].info.Format.nSamplesPerSec, outrate, RESAMPLE_HIGH);
+    }
+    for(int n : threads)
+        PrintResult("decode", n, RunStage(entries, DecodeJob, n, repeat), inBytes, count);
+    for(auto& e : entries)
+        pcmBytes += e.pcm.size()*2;
+    for(int n : threads)
+        PrintResult("resample", n, RunStage(entries, ResampleJob, n, repeat), pcmBytes, count);
+    for(auto& e : entries)
+        resBytes += e.res.size()*2;
+    for(int n : threads)
+        PrintResult("encode", n, RunStage(entries, EncodeJob, n, repeat), resBytes, count);
+    entries.clear();
+
+    // writing a bank, entries copied as is
+    {
+        double best = 1e30;
+        for(int r=0; r<repeat; ++r) {
+            double t0 = Now();
+            BANKWRITER w;
+            if(OpenBankWriter(&w, &wb, outfile, 0))
+                break;
+            for(uint32_t j=0; j<count; ++j) {
+                WAVEBANKENTRYINFO info;
+                CONVERTEDENTRY e;
+                GetWaveBankEntry(&wb, j, &info, 0);
+                memset(&e, 0, sizeof(e));
+                e.data = info.data;
+                e.length = info.dwLength;
+                WriteBankEntry(&w, &info, &e);
+            }
+            CloseBankWriter(&w);
+            best = std::min(best, Now() - t0);
+        }
+        PrintResult("write", 1, best, inBytes, count);
+    }
+
+    // and the whole conversion
+    for(int n : threads) {
+        REXWB_OPTIONS opt;
+        memset(&opt, 0, sizeof(opt));
+        opt.rate = outrate;
+        opt.jobs = n;
+        double best = 1e30;
+        for(int r=0; r<repeat; ++r) {
+            double t0 = Now();
+            if(rexwb_convert_bank(file, outfile, &opt))
+                printf("ERROR: converting %s failed\n", file);
+            best = std::min(best, Now() - t0);
+        }
+        PrintResult("convert", n, best, inBytes, count);
+    }
+    unlink(outfile);
+    CloseWaveBank(&wb);
+    return 0;
+}
+
+static int ParseFormat( const char* s )
+{
+    if(!strcmp(s, "pcm8")) return GENBANK_PCM8;
+    if(!strcmp(s, "pcm16")) return GENBANK_PCM16;
+    if(!strcmp(s, "adpcm")) return GENBANK_ADPCM;
+    if(!strcmp(s, "mixed")) return GENBANK_MIXED;
+    return -1;
+}
+
+static void Usage( const char* prog )
+{
+    printf(
+        "usage: %s [-n N] [-t SEC] [-o RATE] [-j LIST] [-R N] [-d DIR] [-k]\n"
+        "Time header parsing, decode, resample, encode, write and the whole conversion on synthetic banks\n"
+        "Use -n N for N entries per bank (default 64), -t SEC for entries of SEC seconds on average (default 2)\n"
+        "Use -o RATE for the output rate (default 22050), -j LIST for the thread counts (default 1,2,4,cpus)\n"
+        "Use -R N to keep the best of N runs (default 3), -d DIR to write the banks in DIR, -k to keep them\n"
+        "or:    %s gen OUT.xwb [-n N] [-t SEC] [-r RATE] [-f pcm8|pcm16|adpcm|mixed] [-c 0|1|2] [-l 0|1] [-C] [-N] [-z SEC] [-m] [-s SEED]\n"
+        "Write a synthetic bank: -c channels (0: mix), -l loops, -C compact bank, -N entry names,\n"
+        "  -z SEC of silence around each sound, -m same sound on every channel\n",
+        prog, prog);
+}
+
+static int GenMain( int argc, const char** argv )
+{
+    if(argc<3) {
+        Usage(argv[0]);
+        return 1;
+    }
+    GENBANKOPTIONS gen;
+    GenBankDefaults(&gen);
+    for(int i=3; i<argc; ++i) {
+        const char* v = (i+1<argc)? argv[i+1] : NULL;
+        if(!strcmp(argv[i], "-C")) gen.compact = 1;
+        else if(!strcmp(argv[i], "-N")) gen.names = 1;
+        else if(!strcmp(argv[i], "-m")) gen.alike = 1;
+        else if(v && !strcmp(argv[i], "-z")) {gen.silence = atof(v); ++i;}
+        else if(v && !strcmp(argv[i], "-n")) {gen.entries = atoi(v); ++i;}
+        else if(v && !strcmp(argv[i], "-t")) {gen.seconds = atof(v); ++i;}
+        else if(v && !strcmp(argv[i], "-r")) {gen.rate = atoi(v); ++i;}
+        else if(v && !strcmp(argv[i], "-c")) {gen.channels = atoi(v); ++i;}
+        else if(v && !strcmp(argv[i], "-l")) {gen.loops = atoi(v); ++i;}
+        else if(v && !strcmp(argv[i], "-s")) {gen.seed = atoi(v); ++i;}
+        else if(v && !strcmp(argv[i], "-f") && ParseFormat(v)>=0) {gen.format = ParseFormat(v); ++i;}
+        else {
+            printf("Unknown option \"%s\", aborting\n", argv[i]);
+            return 1;
+        }
+    }
+    if(!gen.entries || gen.channels<0 || gen.channels>2 || gen.rate<1000 || gen.rate>200000) {
+        printf("ERROR: invalid bank options\n");
+        return 1;
+    }
+    return GenerateWaveBank(argv[2], &gen);
+}
+
+int main( int argc, const char** argv )
+{
+    if(argc>1 && !strcmp(argv[1], "gen"))
+        return GenMain(argc, argv);
+
+    uint32_t entries = 64;
+    float seconds = 2.0f;
+    int outrate = 22050;
+    int repeat = 3;
+    int keep = 0;
+    std::string dir;
+    std::vector<int> threads;
+    for(int i=1; i<argc; ++i) {
+        const char* v = (i+1<argc)? argv[i+1] : NULL;
+        if(!strcmp(argv[i], "-k")) keep = 1;
+        else if(v && !strcmp(argv[i], "-n")) {entries = atoi(v); ++i;}
+        else if(v && !strcmp(argv[i], "-t")) {seconds = atof(v); ++i;}
+        else if(v && !strcmp(argv[i], "-o")) {outrate = atoi(v); ++i;}
+        else if(v && !strcmp(argv[i], "-R")) {repeat = atoi(v); ++i;}
+        else if(v && !strcmp(argv[i], "-d")) {dir = v; ++i;}
+        else if(v && !strcmp(argv[i], "-j")) {
+            for(const char* p=v; *p; ) {
+                int n = atoi(p);
+                threads.push_back(n>0? n : GetCPUCount());
+                p = strchr(p, ',');
+                if(!p)
+                    break;
+                ++p;
+            }
+            ++i;
+        }
+        else {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+    if(!entries || repeat<1 || outrate<4000) {
+        Usage(argv[0]);
+        return 1;
+    }
+    if(threads.empty()) {
+        int cpus = GetCPUCount();
+        for(int n : {1, 2, 4, cpus})
+            if(n<=cpus && std::find(threads.begin(), threads.end(), n)==threads.end())
+                threads.push_back(n);
+    }
+
+    int removedir = 0;
+    if(dir.empty()) {
+        char tmp[] = "/tmp/rexwb_bench.XXXXXX";
+        if(!mkdtemp(tmp)) {
+            printf("ERROR: Cannot create a temporary directory\n");
+            return -2;
+        }
+        dir = tmp;
+        removedir = !keep;
+    }
+    if(rexwb_init(0))
+        return -3;
+
+    struct {
+        const char* name;
+        int format, channels, compact;
+    } banks[] = {
+        { "mixed",          GENBANK_MIXED, 0, 0 },  // PCM 8/16 and ADPCM, mono and stereo, with loops
+        { "adpcm-compact",  GENBANK_ADPCM, 2, 1 },
+    };
+    printf("rexwb_bench: %u entries of %.1fs at 44100Hz -> %dHz, best of %d\n", entries, seconds, outrate, repeat);
+    int ret = 0;
+    for(auto& b : banks) {
+        GENBANKOPTIONS gen;
+        GenBankDefaults(&gen);
+        gen.entries = entries;
+        gen.seconds = seconds;
+        gen.format = b.format;
+        gen.channels = b.channels;
+        gen.compact = b.compact;
+        std::string file = dir + "/" + b.name + ".xwb";
+        std::string out = dir + "/" + b.name + ".out.xwb";
+        if(GenerateWaveBank(file.c_str(), &gen) || BenchBank(b.name, file.c_str(), out.c_str(), threads, outrate, repeat))
+            ret = -1;
+        if(!keep)
+            unlink(file.c_str());
+    }
+    if(removedir)
+        rmdir(dir.c_str());
+    rexwb_quit();
+    return ret;
+}
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <vector>
+
+#include "xwb.h"
+#include "msadpcm.h"
+#include "genbank.h"
+
+void GenBankDefaults( GENBANKOPTIONS* opt )
+{
+    memset(opt, 0, sizeof(*opt));
+    opt->entries = 64;
+    opt->seconds = 2.0f;
+    opt->rate = 44100;
+    opt->format = GENBANK_MIXED;
+    opt->channels = 0;
+    opt->loops = 1;
+    opt->seed = 1;
+}
+
+static uint32_t Random( uint32_t* state )
+{
+    // xorshift32, the banks only have to be reproducible
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// A few tones with a decay, and some noise: not silence, and not too easy for the ADPCM encoder
+static void GenerateSound( int16_t* pcm, uint32_t frames, uint32_t chans, int rate, uint32_t* seed )
+{
+    float freq[3], amp[3];
+    for(int k=0; k<3; ++k) {
+        freq[k] = 80.0f + (Random(seed) % 8000);
+        amp[k] = 2000.0f + (Random(seed) % 6000);
+    }
+    float decay = 1.0f / (frames + 1);
+    for(uint32_t i=0; i<frames; ++i) {
+        float env = 1.0f - i * decay;
+        for(uint32_t c=0; c<chans; ++c) {
+            float v = 0.0f;
+            for(int k=0; k<3; ++k)
+                v += amp[k] * sinf(2.0f * (float)M_PI * freq[k] * (1.0f + 0.01f*c) * i / rate);
+            v = v * env + (float)((int)(Random(seed) & 0x3ff) - 512);
+            pcm[(size_t)i*chans + c] = (int16_t)(v > 32767.f ? 32767 : (v < -32768.f ? -32768 : v));
+        }
+    }
+}
+
+int GenerateWaveBank( const char* filename, const GENBANKOPTIONS* opt )
+{
+    int format = opt->format;
+    int channels = opt->channels;
+    if(opt->compact) {
+        // every entry shares the bank format
+        if(format == GENBANK_MIXED)
+            format = GENBANK_ADPCM;
+        if(!channels)
+            channels = 2;
+    }
+    uint32_t count = opt->entries;
+    uint32_t alignment = opt->compact? WAVEBANK_ALIGNMENT_DVD : WAVEBANK_ALIGNMENT_MIN;
+    uint32_t seed = opt->seed? opt->seed : 1;
+
+    std::vector<WAVEBANKENTRY> entries(count);
+    std::vector<uint8_t> wave;
+    std::vector<int16_t> pcm;
+    uint32_t compactFormat = 0;
+    for(uint32_t j=0; j<count; ++j) {
+        int fmt = (format == GENBANK_MIXED)? (int)(j % 3) : format;
+        uint32_t chans = channels? channels : 1 + (j/3) % 2;
+        uint32_t frames = (uint32_t)(opt->seconds * opt->rate * (0.5f + (Random(&seed) % 1000) / 1000.0f));
+        if(frames < 16)
+            frames = 16;
+        uint32_t pad = (uint32_t)(opt->silence * opt->rate);
+        pcm.assign((size_t)(frames + 2*pad)*chans, 0);
+        GenerateSound(pcm.data() + (size_t)pad*chans, frames, chans, opt->rate, &seed);
+        if(opt->alike)
+            for(uint32_t i=pad; i<pad+frames; ++i)
+                for(uint32_t c=1; c<chans; ++c)
+                    pcm[(size_t)i*chans + c] = pcm[(size_t)i*chans];
+        frames += 2*pad;
+
+        MINIWAVEFORMAT mf;
+        mf.dwValue = 0;
+        mf.nChannels = chans;
+        mf.nSamplesPerSec = opt->rate;
+        size_t offset = (wave.size() + alignment - 1) / alignment * alignment;
+        wave.resize(offset);
+        switch(fmt) {
+        case GENBANK_PCM8:
+            mf.wFormatTag = MINIWAVEFORMAT::TAG_PCM;
+            mf.wBitsPerSample = MINIWAVEFORMAT::BITDEPTH_8;
+            mf.wBlockAlign = chans;
+            for(size_t i=0; i<pcm.size(); ++i)
+                wave.push_back((uint8_t)((pcm[i] >> 8) + 128));
+            break;
+        case GENBANK_PCM16:
+            mf.wFormatTag = MINIWAVEFORMAT::TAG_PCM;
+            mf.wBitsPerSample = MINIWAVEFORMAT::BITDEPTH_16;
+            mf.wBlockAlign = 2*chans;
+            wave.resize(offset + pcm.size()*2);
+            memcpy(wave.data() + offset, pcm.data(), pcm.size()*2);
+            break;
+        default: {
+            uint32_t blockAlign = 256*chans;
+            mf.wFormatTag = MINIWAVEFORMAT::TAG_ADPCM;
+            mf.wBitsPerSample = MINIWAVEFORMAT::BITDEPTH_16;
+            mf.wBlockAlign = blockAlign/chans - MINIWAVEFORMAT::ADPCM_BLOCKALIGN_CONVERSION_OFFSET;
+            wave.resize(offset + AdpcmEncodedSize(frames, chans, blockAlign));
+            uint32_t l = AdpcmEncode(pcm.data(), frames, chans, blockAlign, 0, NULL, wave.data() + offset);
+            wave.resize(offset + l);
+            break;
+        }
+        }
+        WAVEBANKENTRY& e = entries[j];
+        memset(&e, 0, sizeof(e));
+        e.Duration = frames;
+        e.Format = mf;
+        e.PlayRegion.dwOffset = offset;
+        e.PlayRegion.dwLength = wave.size() - offset;
+        if(opt->loops && !opt->compact) {
+            e.LoopRegion.dwStartSample = frames/4;
+            e.LoopRegion.dwTotalSamples = frames/2;
+        }
+        compactFormat = mf.dwValue;
+    }
+    wave.resize((wave.size() + alignment - 1) / alignment * alignment);
+
+    // header, bank data, entries, names, then the wave data
+    WAVEBANKHEADER header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.dwSignature, "WBND", 4);
+    header.dwVersion = WAVEBANK_HEADER_VERSION;
+    header.dwHeaderVersion = WAVEBANK_HEADER_VERSION + 1;
+
+    WAVEBANKDATA bank;
+    memset(&bank, 0, sizeof(bank));
+    bank.dwFlags = WAVEBANK_TYPE_BUFFER;
+    if(opt->names)
+        bank.dwFlags |= WAVEBANK_FLAGS_ENTRYNAMES;
+    if(opt->compact)
+        bank.dwFlags |= WAVEBANK_FLAGS_COMPACT | WAVEBANK_TYPE_STREAMING;
+    bank.dwEntryCount = count;
+    snprintf(bank.szBankName, sizeof(bank.szBankName), "synthetic");
+    bank.dwEntryMetaDataElementSize = opt->compact? sizeof(WAVEBANKENTRYCOMPACT) : sizeof(WAVEBANKENTRY);
+    bank.dwEntryNameElementSize = opt->names? WAVEBANK_ENTRYNAME_LENGTH : 0;
+    bank.dwAlignment = alignment;
+    bank.CompactFormat = opt->compact? compactFormat : 0;
+
+    std::vector<uint8_t> metadata;
+    if(opt->compact) {
+        metadata.resize(count * sizeof(WAVEBANKENTRYCOMPACT));
+        WAVEBANKENTRYCOMPACT* c = (WAVEBANKENTRYCOMPACT*)metadata.data();
+        for(uint32_t j=0; j<count; ++j) {
+            uint32_t next = (j+1<count)? entries[j+1].PlayRegion.dwOffset : wave.size();
+            c[j].dwOffset = entries[j].PlayRegion.dwOffset / alignment;
+            c[j].dwLengthDeviation = next - entries[j].PlayRegion.dwOffset - entries[j].PlayRegion.dwLength;
+        }
+    } else {
+        metadata.resize(count * sizeof(WAVEBANKENTRY));
+        memcpy(metadata.data(), entries.data(), metadata.size());
+    }
+    std::vector<char> names(opt->names? count * WAVEBANK_ENTRYNAME_LENGTH : 0);
+    for(uint32_t j=0; opt->names && j<count; ++j)
+        snprintf(&names[j * WAVEBANK_ENTRYNAME_LENGTH], WAVEBANK_ENTRYNAME_LENGTH, "sound_%u", j);
+
+    uint32_t pos = sizeof(header);
+    header.Segments[WAVEBANK_SEGIDX_BANKDATA].dwOffset = pos;
+    header.Segments[WAVEBANK_SEGIDX_BANKDATA].dwLength = sizeof(bank);
+    pos += sizeof(bank);
+    header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwOffset = pos;
+    header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwLength = metadata.size();
+    pos += metadata.size();
+    header.Segments[WAVEBANK_SEGIDX_SEEKTABLES].dwOffset = pos;
+    header.Segments[WAVEBANK_SEGIDX_ENTRYNAMES].dwOffset = pos;
+    header.Segments[WAVEBANK_SEGIDX_ENTRYNAMES].dwLength = names.size();
+    pos += names.size();
+    uint32_t waveOffset = (pos + alignment - 1) / alignment * alignment;
+    header.Segments[WAVEBANK_SEGIDX_ENTRYWAVEDATA].dwOffset = waveOffset;
+    header.Segments[WAVEBANK_SEGIDX_ENTRYWAVEDATA].dwLength = wave.size();
+
+    FILE* f = fopen(filename, "wb");
+    if(!f) {
+        printf("ERROR: Cannot create %s\n", filename);
+        return -2;
+    }
+    std::vector<uint8_t> pad(waveOffset - pos, 0);
+    int ok = fwrite(&header, sizeof(header), 1, f)==1
+          && fwrite(&bank, sizeof(bank), 1, f)==1
+          && fwrite(metadata.data(), 1, metadata.size(), f)==metadata.size()
+          && fwrite(names.data(), 1, names.size(), f)==names.size()
+          && fwrite(pad.data(), 1, pad.size(), f)==pad.size()
+          && fwrite(wave.data(), 1, wave.size(), f)==wave.size();
+    if(fclose(f) || !ok) {
+        printf("ERROR: Cannot write %s\n", filename);
+        return -2;
+    }
+    return 0;
+}
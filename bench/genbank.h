@@ -0,0 +1,32 @@
+#ifndef _GENBANK_H_
+#define _GENBANK_H_
+
+#include <stdint.h>
+
+// Synthetic wavebanks, for benchmarks and tests
+enum {
+    GENBANK_PCM8 = 0,
+    GENBANK_PCM16,
+    GENBANK_ADPCM,
+    GENBANK_MIXED,      // entries cycle through the 3 formats (not for compact banks)
+};
+
+typedef struct {
+    uint32_t    entries;
+    float       seconds;    // average duration of an entry, each one is 50% to 150% of it
+    int         rate;
+    int         format;     // GENBANK_*
+    int         channels;   // 1, 2, or 0 for a mix of mono and stereo (not for compact banks)
+    int         loops;      // entries loop over their middle half
+    int         compact;    // compact bank (one format for all entries)
+    int         names;      // entry names
+    float       silence;    // seconds of digital silence before and after each sound
+    int         alike;      // the channels of multi-channels entries are the same (pseudo stereo)
+    uint32_t    seed;
+} GENBANKOPTIONS;
+
+void GenBankDefaults( GENBANKOPTIONS* opt );
+// Write a wavebank of tones and noise. Return 0 on success
+int  GenerateWaveBank( const char* filename, const GENBANKOPTIONS* opt );
+
+#endif //_GENBANK_H_
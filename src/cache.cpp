@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+static const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t Rotl( uint64_t x, int r ) { return (x<<r) | (x>>(64-r)); }
+static inline uint64_t Read64( const uint8_t* p ) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline uint32_t Read32( const uint8_t* p ) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+static inline uint64_t HashRound( uint64_t acc, uint64_t in )
+{
+    acc += in * PRIME2;
+    acc = Rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+static inline uint64_t HashMerge( uint64_t acc, uint64_t v )
+{
+    acc ^= HashRound(0, v);
+    return acc * PRIME1 + PRIME4;
+}
+
+uint64_t HashBytes( const void* data, size_t length, uint64_t seed )
+{
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + length;
+    uint64_t h;
+    if(length >= 32) {
+        uint64_t v1 = seed + PRIME1 + PRIME2, v2 = seed + PRIME2, v3 = seed, v4 = seed - PRIME1;
+        // 4 independent lanes of 8 bytes
+        for(const uint8_t* limit = end - 32; p <= limit; p += 32) {
+            v1 = HashRound(v1, Read64(p));
+            v2 = HashRound(v2, Read64(p+8));
+            v3 = HashRound(v3, Read64(p+16));
+            v4 = HashRound(v4, Read64(p+24));
+        }
+        h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+        h = HashMerge(h, v1);
+        h = HashMerge(h, v2);
+        h = HashMerge(h, v3);
+        h = HashMerge(h, v4);
+    } else
+        h = seed + PRIME5;
+    h += length;
+    for(; p + 8 <= end; p += 8) {
+        h ^= HashRound(0, Read64(p));
+        h = Rotl(h, 27) * PRIME1 + PRIME4;
+    }
+    if(p + 4 <= end) {
+        h ^= (uint64_t)Read32(p) * PRIME1;
+        h = Rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for(; p < end; ++p) {
+        h ^= *p * PRIME5;
+        h = Rotl(h, 11) * PRIME1;
+    }
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+typedef struct {
+    uint32_t                version;
+    uint32_t                format;         // MINIWAVEFORMAT::dwValue
+    uint32_t                length;
+    uint32_t                flagsAndDuration;
+    WAVEBANKSAMPLEREGION    LoopRegion;
+    int32_t                 rate;
+    int32_t                 force;
+    int32_t                 mono;
+    int32_t                 bits8;
+    int32_t                 silent;
+    int32_t                 quality;
+    int32_t                 exhaustive;
+    int32_t                 trimtail;
+    int32_t                 adaptive;
+    int32_t                 rates[16];
+    int32_t                 bandloss;
+    int32_t                 trimsilence;
+    int32_t                 silencelevel;
+    int32_t                 automono;
+    int32_t                 monodiff;
+} CACHEPARAMS;
+
+uint64_t CacheKey( const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt )
+{
+    CACHEPARAMS params;
+    memset(&params, 0, sizeof(params));
+    params.version = REXWB_CACHE_VERSION;
+    params.format = info->Format.dwValue;
+    params.length = info->dwLength;
+    if(info->entry) {
+        params.flagsAndDuration = info->entry->dwFlagsAndDuration;
+        params.LoopRegion = info->entry->LoopRegion;
+    }
+    params.rate = opt->rate;
+    params.force = opt->force;
+    params.mono = opt->mono;
+    params.bits8 = opt->bits8;
+    params.silent = opt->silent;
+    params.quality = opt->quality;
+    params.exhaustive = opt->exhaustive;
+    params.trimtail = opt->trimtail;
+    params.adaptive = opt->adaptive;
+    if(opt->adaptive) {
+        memcpy(params.rates, opt->rates, sizeof(params.rates));
+        params.bandloss = opt->bandloss;
+    }
+    params.trimsilence = opt->trimsilence;
+    if(opt->trimsilence)
+        params.silencelevel = opt->silencelevel;
+    params.automono = opt->automono;
+    if(opt->automono)
+        params.monodiff = opt->monodiff;
+    return HashBytes(info->data, info->dwLength, HashBytes(&params, sizeof(params), 0));
+}
+
+// Cache file: this header, then the converted data
+typedef struct {
+    char                    magic[4];       // "RXWC"
+    uint32_t                version;
+    uint64_t                key;
+    uint32_t                length;
+    uint32_t                format;         // MINIWAVEFORMAT::dwValue
+    uint32_t                Duration;
+    WAVEBANKSAMPLEREGION    LoopRegion;
+} CACHEHEADER;
+
+static void CacheName( char* name, size_t size, const char* dir, uint64_t key )
+{
+    snprintf(name, size, "%s/%016llx.rxc", dir, (unsigned long long)key);
+}
+
+int CacheOpen( const char* dir )
+{
+    struct stat st;
+    if(mkdir(dir, 0755) && errno!=EEXIST) {
+        printf("WARNING: Cannot create cache directory %s, the cache is not used\n", dir);
+        return -1;
+    }
+    if(stat(dir, &st) || !S_ISDIR(st.st_mode) || access(dir, W_OK)) {
+        printf("WARNING: %s is not a writable directory, the cache is not used\n", dir);
+        return -1;
+    }
+    return 0;
+}
+
+int CacheLoad( const char* dir, uint64_t key, CONVERTEDENTRY* out )
+{
+    char name[4096];
+    CacheName(name, sizeof(name), dir, key);
+    MAPPEDFILE* map = new MAPPEDFILE;
+    if(MapFile(map, name)) {
+        delete map;
+        return -1;
+    }
+    const CACHEHEADER* head = (const CACHEHEADER*)MapRange(map, 0, sizeof(CACHEHEADER));
+    const uint8_t* data = head? (const uint8_t*)MapRange(map, sizeof(CACHEHEADER), head->length) : NULL;
+    // anything unexpected (older version, truncated file) is a miss, it will be overwritten
+    if(!data || memcmp(head->magic, "RXWC", 4) || head->version!=REXWB_CACHE_VERSION || head->key!=key
+     || !head->length || map->size!=sizeof(CACHEHEADER)+head->length) {
+        UnmapFile(map);
+        delete map;
+        return -1;
+    }
+    out->convert = 1;
+    out->silence = 0;
+    out->data = data;
+    out->length = head->length;
+    out->Format.dwValue = head->format;
+    out->Duration = head->Duration;
+    out->LoopRegion = head->LoopRegion;
+    out->cache = map;
+    return 0;
+}
+
+int CacheBegin( CACHEWRITER* cw, const char* dir, uint64_t key )
+{
+    memset(cw, 0, sizeof(*cw));
+    cw->key = key;
+    // unique temporary name in the same directory, renamed once complete
+    snprintf(cw->tmpname, sizeof(cw->tmpname), "%s/%016llx.XXXXXX", dir, (unsigned long long)key);
+    int fd = mkstemp(cw->tmpname);
+    if(fd<0)
+        return -1;
+    fchmod(fd, 0644);
+    cw->f = fdopen(fd, "wb");
+    if(!cw->f) {
+        close(fd);
+        unlink(cw->tmpname);
+        return -1;
+    }
+    CACHEHEADER head;
+    memset(&head, 0, sizeof(head));
+    if(fwrite(&head, 1, sizeof(head), cw->f)!=sizeof(head)) {
+        CacheAbort(cw);
+        return -1;
+    }
+    return 0;
+}
+
+void CacheWrite( CACHEWRITER* cw, const void* data, uint32_t length )
+{
+    if(!cw->f)
+        return;
+    if(fwrite(data, 1, length, cw->f)!=length)
+        CacheAbort(cw);
+    else
+        cw->length += length;
+}
+
+void CacheEnd( CACHEWRITER* cw, const char* dir, const CONVERTEDENTRY* e )
+{
+    if(!cw->f)
+        return;
+    CACHEHEADER head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, "RXWC", 4);
+    head.version = REXWB_CACHE_VERSION;
+    head.key = cw->key;
+    head.length = cw->length;
+    head.format = e->Format.dwValue;
+    head.Duration = e->Duration;
+    head.LoopRegion = e->LoopRegion;
+    if(fseek(cw->f, 0, SEEK_SET) || fwrite(&head, 1, sizeof(head), cw->f)!=sizeof(head)) {
+        CacheAbort(cw);
+        return;
+    }
+    int err = fclose(cw->f);
+    cw->f = NULL;
+    char name[4096];
+    CacheName(name, sizeof(name), dir, cw->key);
+    if(err || rename(cw->tmpname, name))
+        unlink(cw->tmpname);
+}
+
+void CacheAbort( CACHEWRITER* cw )
+{
+    if(!cw->f)
+        return;
+    fclose(cw->f);
+    cw->f = NULL;
+    unlink(cw->tmpname);
+}
+
+void CacheStore( const char* dir, uint64_t key, const CONVERTEDENTRY* e )
+{
+    CACHEWRITER cw;
+    if(CacheBegin(&cw, dir, key))
+        return;
+    CacheWrite(&cw, e->data, e->length);
+    CacheEnd(&cw, dir, e);
+}
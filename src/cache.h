@@ -0,0 +1,42 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "rexwb.h"
+
+// Bump when the conversion output changes for the same input and options, so older cache files are ignored
+#define REXWB_CACHE_VERSION 1
+
+// Fast 64bits hash (xxHash64)
+uint64_t HashBytes( const void* data, size_t length, uint64_t seed );
+
+// Key of a converted entry: its raw wave bytes, format, length, duration and loop,
+// and the options changing the output (not -j or -M, the output doesn't depend on them)
+uint64_t CacheKey( const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt );
+
+// Create the cache directory if needed. Return 0 if it can be used
+int  CacheOpen( const char* dir );
+
+// Look for key in the cache. On a hit, out gets the converted data (a view in the mapped cache file,
+// freed by FreeConvertedEntry) and its new format, duration and loop, and 0 is returned
+int  CacheLoad( const char* dir, uint64_t key, CONVERTEDENTRY* out );
+
+// Cache file being written, it only shows up under its key name once complete
+typedef struct {
+    FILE*       f;
+    uint64_t    key;
+    uint32_t    length;
+    char        tmpname[4096];
+} CACHEWRITER;
+
+int  CacheBegin( CACHEWRITER* cw, const char* dir, uint64_t key );
+void CacheWrite( CACHEWRITER* cw, const void* data, uint32_t length );
+// Store the format of e and publish the file (if every write succeeded)
+void CacheEnd( CACHEWRITER* cw, const char* dir, const CONVERTEDENTRY* e );
+void CacheAbort( CACHEWRITER* cw );
+// CacheBegin+CacheWrite+CacheEnd for an entry converted in memory
+void CacheStore( const char* dir, uint64_t key, const CONVERTEDENTRY* e );
+
+#endif //_CACHE_H_
@@ -0,0 +1,908 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#include <sox.h>
+
+#include "rexwb.h"
+#include "msadpcm.h"
+#include "resample.h"
+#include "cache.h"
+#include "stats.h"
+#include "spectrum.h"
+#include "pcmscan.h"
+
+// sox formats and effects chains are created and destroyed under this lock,
+// only the flow itself runs concurrently when entries are converted in parallel
+static std::mutex sox_lock;
+
+size_t BuildWavHeader( const MINIWAVEFORMAT* miniFmt, uint32_t dwLength, uint8_t* wavhead )
+{
+    if(miniFmt->wFormatTag==MINIWAVEFORMAT::TAG_ADPCM) {
+        // Write MS ADPCM WAV Header
+        WAVHEADER_ADPCM head;
+        memcpy(&head.sign, "RIFF", 4);
+        head.filesize = dwLength + sizeof(WAVHEADER_ADPCM) - 8;
+        memcpy(&head.format, "WAVE", 4);
+        // fmt
+        memcpy(&head.formatid, "fmt ", 4);
+        head.blocksize = 0x10 + 32 + 2;
+        head.audioformat = 2;
+        head.channels = miniFmt->nChannels;
+        head.rate = miniFmt->nSamplesPerSec;
+        head.bytepersec = miniFmt->AvgBytesPerSec();
+        head.byteperblock = miniFmt->BlockAlign();
+        head.bitspersample = miniFmt->BitsPerSample();
+        // extra
+        head.extrassz = 32;
+        head.newsz =  (((head.byteperblock - (7 * head.channels)) * 8) / (head.bitspersample * head.channels)) + 2;
+        head.ncoeff = 7;
+        head.coef[0] = 0x00000100;
+        head.coef[1] = 0xFF000200;
+        head.coef[2] = 0x00000000;
+        head.coef[3] = 0x004000C0;
+        head.coef[4] = 0x000000F0;
+        head.coef[5] = 0xFF3001CC;
+        head.coef[6] = 0xFF180188;
+        memcpy(&head.factid, "fact", 4);
+        head.factsz = 4;
+        if(head.byteperblock && head.channels) {
+            head.factdata = ((head.byteperblock - (7 * head.channels)) * 8) / head.bitspersample;
+            head.factdata = (dwLength / head.byteperblock ) * head.factdata;
+            head.factdata /= head.channels;
+        } else
+            head.factdata = 0;
+        // data
+        memcpy(&head.blockid, "data", 4);
+        head.datasize = dwLength;
+        memcpy(wavhead, &head, sizeof(head));
+        return sizeof(head);
+    } else {
+        // Write simple PCM WAV Header
+        WAVHEADER_SIMPLE head;
+        memcpy(&head.sign, "RIFF", 4);
+        head.filesize = dwLength + 44 - 8;
+        memcpy(&head.format, "WAVE", 4);
+        // fmt
+        memcpy(&head.formatid, "fmt ", 4);
+        head.blocksize = 0x10;
+        head.audioformat = 1;
+        head.channels = miniFmt->nChannels;
+        head.rate = miniFmt->nSamplesPerSec;
+        head.bytepersec = miniFmt->AvgBytesPerSec();
+        head.byteperblock = miniFmt->BlockAlign();
+        head.bitspersample = miniFmt->BitsPerSample();
+        // data
+        memcpy(&head.blockid, "data", 4);
+        head.datasize = dwLength;
+        memcpy(wavhead, &head, sizeof(head));
+        return sizeof(head);
+    }
+}
+
+// Number of frames of the entry once decoded to 16bits PCM
+static uint32_t EntryFrames( const WAVEBANKENTRYINFO* info )
+{
+    const MINIWAVEFORMAT* miniFmt = &info->Format;
+    uint32_t chans = miniFmt->nChannels;
+    if(!chans)
+        return 0;
+    switch(miniFmt->wFormatTag) {
+    case MINIWAVEFORMAT::TAG_ADPCM:
+        return AdpcmSamplesIn(info->dwLength, chans, miniFmt->BlockAlign(), miniFmt->AdpcmSamplesPerBlock());
+    case MINIWAVEFORMAT::TAG_PCM:
+        return info->dwLength / (chans * miniFmt->BitsPerSample()/8);
+    }
+    return 0;
+}
+
+// Decode count frames from first as interleaved 16bits PCM. For MS ADPCM, first must be on a block
+// and count a whole number of blocks, unless it goes to the end. Return the number of frames
+static uint32_t DecodeEntryRange( const WAVEBANKENTRYINFO* info, uint32_t first, uint32_t count, int16_t* pcm )
+{
+    const MINIWAVEFORMAT* miniFmt = &info->Format;
+    uint32_t chans = miniFmt->nChannels;
+    switch(miniFmt->wFormatTag) {
+    case MINIWAVEFORMAT::TAG_ADPCM:
+        {
+            uint32_t spb = miniFmt->AdpcmSamplesPerBlock();
+            uint32_t blockAlign = miniFmt->BlockAlign();
+            uint32_t offset = first/spb * blockAlign;
+            uint32_t length = (count + spb - 1)/spb * blockAlign;
+            if(offset >= info->dwLength)
+                return 0;
+            if(length > info->dwLength - offset)
+                length = info->dwLength - offset;
+            return AdpcmDecode(info->data + offset, length, miniFmt, pcm);
+        }
+    case MINIWAVEFORMAT::TAG_PCM:
+        if(miniFmt->BitsPerSample()==16)
+            memcpy(pcm, info->data + (size_t)first*chans*2, (size_t)count*chans*2);
+        else {
+            const uint8_t* d = info->data + (size_t)first*chans;
+            for(size_t i=0; i<(size_t)count*chans; ++i)
+                pcm[i] = (d[i] - 128) << 8;
+        }
+        return count;
+    }
+    return 0;
+}
+
+// Mix all channels in the first one, in place (like sox "channels 1")
+static void DownmixMono( int16_t* pcm, uint32_t frames, uint32_t chans )
+{
+    for(uint32_t i=0; i<frames; ++i) {
+        int sum = 0;
+        for(uint32_t ch=0; ch<chans; ++ch)
+            sum += pcm[i*chans+ch];
+        pcm[i] = (sum>=0)? (sum + (int)chans/2)/(int)chans : -((-sum + (int)chans/2)/(int)chans);
+    }
+}
+
+// Legacy path: resample with the sox "rate" effect. Return the number of frames, -3 on error
+static int ResampleSox( const int16_t* pcm, uint32_t frames, uint32_t chans, int inrate, int outrate, std::vector<int16_t>& res, STAGETIMES* times )
+{
+    double t = StageClock();
+    // The in-memory wav is read by sox straight from this buffer (no temporary file),
+    // so it has to stay alive, untouched, until format_in is closed.
+    MINIWAVEFORMAT pcmFmt = {};
+    pcmFmt.wFormatTag = MINIWAVEFORMAT::TAG_PCM;
+    pcmFmt.nChannels = chans;
+    pcmFmt.nSamplesPerSec = inrate;
+    pcmFmt.wBlockAlign = 2 * chans;
+    pcmFmt.wBitsPerSample = MINIWAVEFORMAT::BITDEPTH_16;
+    uint32_t pcmLength = frames * chans * 2;
+    std::vector<uint8_t> wavfile(sizeof(WAVHEADER_SIMPLE) + pcmLength);
+    size_t wavheadsize = BuildWavHeader( &pcmFmt, pcmLength, wavfile.data() );
+    memcpy(wavfile.data() + wavheadsize, pcm, pcmLength);
+    times->time[STAGE_HEADER] += StageClock() - t;
+
+    std::unique_lock<std::mutex> l(sox_lock);
+    sox_format_t * format_in = sox_open_mem_read(wavfile.data(), wavfile.size(), NULL, NULL, "WAV");
+    if(!format_in) {
+        printf("ERROR: SOX cannot create read format\n");
+        return -3;
+    }
+    // copy in to out format
+    sox_signalinfo_t signal_out = format_in->signal;
+    sox_encodinginfo_t encoding_out = format_in->encoding;
+    signal_out.rate = outrate;
+    signal_out.length = ((uint64_t)frames * outrate / inrate + 1024) * chans; // some margin? Cannot use SOX_UNKNOWN_LEN here, the memstream output is not seekable so the WAV header cannot be fixed afterward
+    char* buffout = NULL;
+    size_t buffer_size;
+    sox_format_t * format_out = sox_open_memstream_write(&buffout, &buffer_size, &signal_out, &encoding_out, "WAV", NULL);
+    if(!format_out) {
+        printf("ERROR: SOX cannot create write format\n");
+        sox_close(format_in);
+        return -3;
+    }
+
+    sox_signalinfo_t interm_signal = format_in->signal;
+    sox_effects_chain_t *chain = sox_create_effects_chain(&format_in->encoding, &format_out->encoding);
+    char * args[10];
+    sox_effect_t *e = sox_create_effect(sox_find_effect("input"));
+    args[0] = (char *)format_in;
+    if(sox_effect_options(e, 1, args) != SOX_SUCCESS) {
+        printf("ERROR: SOX cannot validate input effect\n");
+        return -3;
+    }
+    if(sox_add_effect(chain, e, &interm_signal, &format_in->signal) != SOX_SUCCESS) {
+        printf("ERROR: SOX cannot add input effect\n");
+        return -3;
+    }
+    free(e);
+    e = sox_create_effect(sox_find_effect("rate"));
+    if(sox_effect_options(e, 0, NULL) != SOX_SUCCESS) {
+        printf("ERROR: SOX cannot validate rate effect\n");
+        return -3;
+    }
+    if(sox_add_effect(chain, e, &interm_signal, &format_out->signal) != SOX_SUCCESS) {
+        printf("ERROR: SOX cannot add rate effect\n");
+        return -3;
+    }
+    free(e);
+    e = sox_create_effect(sox_find_effect("output"));
+    args[0] = (char *)format_out;
+    if(sox_effect_options(e, 1, args) != SOX_SUCCESS) {
+        printf("ERROR: SOX cannot validate out effect\n");
+        return -3;
+    }
+    if(sox_add_effect(chain, e, &interm_signal, &format_out->signal) != SOX_SUCCESS) {
+        printf("ERROR: SOX cannot add out effect\n");
+        return -3;
+    }
+    free(e);
+
+    l.unlock();
+    int err = sox_flow_effects(chain, NULL, NULL);
+    if(err!=SOX_SUCCESS) {
+        printf("ERROR: SOX: %s\n", sox_strerror(err));
+    }
+
+    l.lock();
+    sox_delete_effects_chain(chain);
+    sox_close(format_out);
+    sox_close(format_in);
+    l.unlock();
+    // read back the file, PCM is already in the memory buffer as RAW
+    WAVHEADER_SIMPLE *head = (WAVHEADER_SIMPLE*)buffout;
+    // check the header is as expected
+    if(buffer_size < sizeof(WAVHEADER_SIMPLE) || memcmp(&head->sign, "RIFF", 4)) {
+        printf("ERROR: Converted WAV is not a WAV file???\n");
+        free(buffout);
+        return -3;
+    }
+    if(head->blocksize!=16) {
+        printf("ERROR: Converted WAV doesn't have the expected header...(0x%x!=0x10)\n", head->blocksize);
+        free(buffout);
+        return -3;
+    }
+    uint32_t nout = (buffer_size - sizeof(WAVHEADER_SIMPLE)) / (2*chans);
+    res.resize((size_t)nout*chans);
+    memcpy(res.data(), buffout + sizeof(WAVHEADER_SIMPLE), (size_t)nout*chans*2);
+    free(buffout);
+    return nout;
+}
+
+static int ResamplerPreset( int quality )
+{
+    switch(quality) {
+    case REXWB_QUALITY_QUICK:       return RESAMPLE_QUICK;
+    case REXWB_QUALITY_MEDIUM:      return RESAMPLE_MEDIUM;
+    case REXWB_QUALITY_VERYHIGH:    return RESAMPLE_VERYHIGH;
+    default:                        return RESAMPLE_HIGH;
+    }
+}
+
+// What the conversion of an entry does
+typedef struct {
+    int         convert;        // 0 if the entry is copied as is
+    int         silence;
+    int         adpcm_in;
+    int         adpcm_out;
+    int         pcm8_out;
+    int         chans;
+    int         newchannels;
+    int         inrate;
+    int         rate;
+    uint32_t    frames;         // decoded frames, from lead
+    uint32_t    newframes;      // resampled frames
+    uint32_t    tail;           // frames dropped after the loop end
+    uint32_t    lead;           // silent frames dropped at the start
+    uint32_t    trail;          // silent frames dropped at the end
+} ENTRYPLAN;
+
+// Frames up to the loop end of an entry flagged to have its tail removed (never played), or all of them.
+// MS ADPCM is cut after the block holding the loop end
+static uint32_t LoopTailStart( const WAVEBANKENTRYINFO* info, uint32_t frames )
+{
+    const WAVEBANKENTRY* entry = info->entry;
+    if(!entry || !(entry->dwFlags & WAVEBANKENTRY_FLAGS_REMOVELOOPTAIL) || (entry->dwFlags & WAVEBANKENTRY_FLAGS_IGNORELOOP)
+     || !entry->LoopRegion.dwTotalSamples)
+        return frames;
+    uint64_t end = (uint64_t)entry->LoopRegion.dwStartSample + entry->LoopRegion.dwTotalSamples;
+    if(info->Format.wFormatTag==MINIWAVEFORMAT::TAG_ADPCM) {
+        uint32_t spb = info->Format.AdpcmSamplesPerBlock();
+        end = (end + spb - 1) / spb * spb;
+    }
+    return (end < frames)? (uint32_t)end : frames;
+}
+
+static void PlanEntry( const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt, ENTRYPLAN* plan )
+{
+    const MINIWAVEFORMAT* miniFmt = &info->Format;
+    memset(plan, 0, sizeof(*plan));
+
+    plan->convert = 1;
+    switch( miniFmt->wFormatTag )
+    {
+    case MINIWAVEFORMAT::TAG_WMA:
+    case MINIWAVEFORMAT::TAG_XMA:
+        plan->convert = 0;
+        break;
+    }
+    plan->adpcm_in = miniFmt->wFormatTag==MINIWAVEFORMAT::TAG_ADPCM?1:0;
+    plan->adpcm_out = (opt->force || opt->bits8)?0:plan->adpcm_in;
+    plan->pcm8_out = opt->bits8 || (miniFmt->wFormatTag==MINIWAVEFORMAT::TAG_PCM && miniFmt->wBitsPerSample==MINIWAVEFORMAT::BITDEPTH_8);
+    plan->silence = (plan->convert && opt->silent && info->seconds>opt->silent);
+    plan->chans = miniFmt->nChannels;
+    plan->newchannels = (opt->mono && plan->chans>1)?1:plan->chans;
+    plan->inrate = miniFmt->nSamplesPerSec;
+    plan->rate = opt->rate;
+    if(opt->adaptive && plan->inrate < plan->rate)
+        plan->rate = plan->inrate;
+    if(plan->convert && !plan->silence) {
+        plan->frames = EntryFrames(info);
+        if(opt->trimtail) {
+            uint32_t frames = LoopTailStart(info, plan->frames);
+            plan->tail = plan->frames - frames;
+            plan->frames = frames;
+        }
+        plan->newframes = (plan->inrate==plan->rate)? plan->frames : (uint64_t)plan->frames * plan->rate / plan->inrate;
+    }
+}
+
+static const int adaptiveRates[] = { 8000, 11025, 16000, 22050, 32000, 44100, 48000, 0 };
+
+#define ADAPTIVE_WINDOWS    64
+
+// Adaptive rate: lower plan->rate to the lowest rate that keeps the bandwidth of the entry, from the spectrum of
+// up to ADAPTIVE_WINDOWS windows spread over it. Not for compact banks, their entries share one format
+static void AdaptEntryRate( const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt, ENTRYPLAN* plan )
+{
+    if(!opt->adaptive || !info->entry || !plan->convert || plan->silence || !plan->frames)
+        return;
+    SPECTRUM sp;
+    SpectrumInit(&sp);
+    uint32_t spb = plan->adpcm_in? info->Format.AdpcmSamplesPerBlock() : 1;
+    uint32_t span = (SPECTRUM_SIZE + spb - 1) / spb * spb;  // MS ADPCM is decoded by whole blocks
+    std::vector<int16_t> pcm((size_t)span*plan->chans);
+    uint32_t windows = plan->frames / SPECTRUM_SIZE;
+    windows = (windows<1)? 1 : ((windows>ADAPTIVE_WINDOWS)? ADAPTIVE_WINDOWS : windows);
+    for(uint32_t w=0; w<windows; ++w) {
+        uint32_t first = (uint64_t)plan->frames * w / windows / spb * spb;
+        uint32_t count = (plan->frames - first < span)? plan->frames - first : span;
+        uint32_t frames = DecodeEntryRange(info, first, count, pcm.data());
+        SpectrumAdd(&sp, pcm.data(), (frames<count)? frames : count, plan->chans);
+    }
+
+    // what is above the passband of the resampler is lost
+    double limit = pow(10.0, -(opt->bandloss>0? opt->bandloss : 30) / 10.0);
+    double cutoff = ResamplerCutoff(ResamplerPreset(opt->quality)) / 2;
+    int rate = plan->rate;
+    for(const int* r = opt->rates[0]? opt->rates : adaptiveRates; *r; ++r)
+        if(*r < rate && SpectrumEnergyAbove(&sp, plan->inrate, cutoff * *r) <= limit)
+            rate = *r;
+    plan->rate = rate;
+    plan->newframes = (plan->inrate==plan->rate)? plan->frames : (uint64_t)plan->frames * plan->rate / plan->inrate;
+}
+
+#define SILENCE_PIECE   65536
+
+// Auto mono: the channels must also be that correlated, so quiet real stereo stays stereo
+#define AUTOMONO_CORRELATION    0.99
+
+// Auto mono: mix the entry to mono when all its channels are alike channel 0 (small peak difference and high
+// correlation), from pcm when it is already decoded whole, else by decoding pieces of it.
+// Not for compact banks, their entries share one format
+static void AutoMonoEntry( const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt, ENTRYPLAN* plan, const int16_t* pcm )
+{
+    if(!opt->automono || !info->entry || !plan->convert || plan->silence || plan->newchannels<2 || !plan->frames)
+        return;
+    uint32_t frames = plan->frames, chans = plan->chans;
+    std::vector<CHANNELMATCH> match(chans);
+    for(uint32_t c=1; c<chans; ++c)
+        ChannelMatchInit(&match[c]);
+    if(pcm) {
+        for(uint32_t c=1; c<chans; ++c)
+            ChannelMatchAdd(&match[c], pcm, frames, chans, c);
+    } else {
+        uint32_t spb = plan->adpcm_in? info->Format.AdpcmSamplesPerBlock() : 1;
+        uint32_t piece = (SILENCE_PIECE + spb - 1) / spb * spb;
+        std::vector<int16_t> buf((size_t)piece*chans);
+        for(uint32_t first=0; first<frames; first+=piece) {
+            uint32_t count = (frames - first < piece)? frames - first : piece;
+            uint32_t n = DecodeEntryRange(info, first, count, buf.data());
+            if(n < count)
+                memset(buf.data() + (size_t)n*chans, 0, (size_t)(count-n)*chans*2);
+            for(uint32_t c=1; c<chans; ++c)
+                ChannelMatchAdd(&match[c], buf.data(), count, chans, c);
+        }
+    }
+    int limit = (opt->monodiff>=0)? opt->monodiff : 256;
+    for(uint32_t c=1; c<chans; ++c)
+        if(match[c].peakdiff > limit || ChannelCorrelation(&match[c]) < AUTOMONO_CORRELATION)
+            return;
+    plan->newchannels = 1;
+}
+
+
+// Silence trimming: find the silent frames at both ends of the entry, in pcm when it is already decoded whole
+// (plan->frames, zero padded), else by decoding pieces of it. The entry is left alone when it is all silence
+// or when its loop reaches the silence. Done after AdaptEntryRate and AutoMonoEntry, which look at the whole entry
+static void TrimEntrySilence( const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt, ENTRYPLAN* plan, const int16_t* pcm )
+{
+    if(!opt->trimsilence || !plan->convert || plan->silence || !plan->frames)
+        return;
+    uint32_t frames = plan->frames, chans = plan->chans;
+    int level = (opt->silencelevel>0)? opt->silencelevel : 0;
+    uint32_t lead = 0, trail = 0;
+    if(pcm) {
+        lead = LeadingSilence(pcm, frames, chans, level);
+        if(lead < frames)
+            trail = TrailingSilence(pcm, frames, chans, level);
+    } else {
+        uint32_t spb = plan->adpcm_in? info->Format.AdpcmSamplesPerBlock() : 1;
+        uint32_t piece = (SILENCE_PIECE + spb - 1) / spb * spb;
+        std::vector<int16_t> buf((size_t)(piece + spb)*chans);
+        for(uint32_t first=0; first<frames; first+=piece) {
+            uint32_t count = (frames - first < piece)? frames - first : piece;
+            uint32_t n = DecodeEntryRange(info, first, count, buf.data());
+            if(n < count)
+                memset(buf.data() + (size_t)n*chans, 0, (size_t)(count-n)*chans*2);
+            n = LeadingSilence(buf.data(), count, chans, level);
+            lead += n;
+            if(n < count)
+                break;
+        }
+        // backward, by pieces that start on a MS ADPCM block
+        for(uint32_t end=frames; lead<frames && end>lead; ) {
+            uint32_t first = (end > piece)? (end - piece) / spb * spb : 0;
+            uint32_t count = end - first;
+            uint32_t n = DecodeEntryRange(info, first, count, buf.data());
+            if(n < count)
+                memset(buf.data() + (size_t)n*chans, 0, (size_t)(count-n)*chans*2);
+            n = TrailingSilence(buf.data(), count, chans, level);
+            trail += n;
+            if(n < count)
+                break;
+            end = first;
+        }
+    }
+    if(lead >= frames)
+        return;
+    const WAVEBANKENTRY* entry = info->entry;
+    if(entry && entry->LoopRegion.dwTotalSamples
+     && (entry->LoopRegion.dwStartSample < lead
+      || (uint64_t)entry->LoopRegion.dwStartSample + entry->LoopRegion.dwTotalSamples > frames - trail))
+        return;
+    plan->lead = lead;
+    plan->trail = trail;
+    plan->frames = frames - lead - trail;
+    plan->newframes = (plan->inrate==plan->rate)? plan->frames : (uint64_t)plan->frames * plan->rate / plan->inrate;
+}
+
+// Block size of the re-encoded MS ADPCM, the one sox uses (256 bytes per channel)
+static uint32_t AdpcmOutBlockAlign( const ENTRYPLAN* plan )
+{
+    return 256 * plan->newchannels;
+}
+
+// Length of the silence replacing a long entry (one second)
+static uint32_t SilenceLength( const ENTRYPLAN* plan, const REXWB_OPTIONS* opt )
+{
+    return plan->rate * (plan->adpcm_out?4:(opt->bits8?8:16)) * plan->newchannels / 8;
+}
+
+// 16bits PCM to the output PCM format. Return the number of bytes
+static uint32_t StorePCM( const ENTRYPLAN* plan, const int16_t* samples, uint32_t frames, uint8_t* out )
+{
+    uint32_t n = frames * plan->newchannels;
+    if(plan->pcm8_out) {
+        for(uint32_t i=0; i<n; ++i) {
+            int v = (samples[i] + 128) >> 8;
+            out[i] = ((v>127)?127:v) + 128;
+        }
+        return n;
+    }
+    memcpy(out, samples, n*2);
+    return n*2;
+}
+
+// Format, duration and loop of the converted entry
+static void SetConvertedFormat( const ENTRYPLAN* plan, const REXWB_OPTIONS* opt, uint32_t newDuration, CONVERTEDENTRY* out )
+{
+    MINIWAVEFORMAT* newminiFmt = &out->Format;
+    uint64_t oldrate = newminiFmt->nSamplesPerSec;
+    int newrate = plan->rate;
+    out->Duration = newDuration;
+    newminiFmt->nSamplesPerSec = newrate;
+    newminiFmt->nChannels = plan->newchannels;
+    // silence gets the same format as converted entries, entries of compact banks share it
+    if(plan->adpcm_out)
+        newminiFmt->wBlockAlign = AdpcmOutBlockAlign(plan)/plan->newchannels - MINIWAVEFORMAT::ADPCM_BLOCKALIGN_CONVERSION_OFFSET;
+    else
+        newminiFmt->wBlockAlign = plan->newchannels * (plan->pcm8_out?1:2);
+    if(plan->adpcm_in != plan->adpcm_out || opt->bits8) {
+        newminiFmt->wFormatTag=MINIWAVEFORMAT::TAG_PCM;
+        newminiFmt->wBitsPerSample=1-opt->bits8; // 16bits
+    }
+    if ( out->LoopRegion.dwTotalSamples > 0 )
+    {
+        if(plan->silence) {
+            out->LoopRegion.dwStartSample = 0;
+            out->LoopRegion.dwTotalSamples = newDuration;
+        } else {
+            out->LoopRegion.dwStartSample -= plan->lead;
+            out->LoopRegion.dwStartSample = ((uint64_t)(out->LoopRegion.dwStartSample/32) * newrate / oldrate)*32;
+            out->LoopRegion.dwTotalSamples = ((uint64_t)(out->LoopRegion.dwTotalSamples/32) * newrate / oldrate)*32;
+            if(out->LoopRegion.dwTotalSamples>newDuration)
+                out->LoopRegion.dwTotalSamples=newDuration;
+        }
+    }
+}
+
+static void InitConvertedEntry( const WAVEBANKENTRYINFO* info, const ENTRYPLAN* plan, CONVERTEDENTRY* out )
+{
+    memset(out, 0, sizeof(*out));
+    out->Format = info->Format;
+    out->Duration = info->Duration;
+    if(info->entry)
+        out->LoopRegion = info->entry->LoopRegion;
+    out->convert = plan->convert;
+    out->silence = plan->silence;
+}
+
+int ConvertEntry( const WaveBank* wb, const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt, WORKERPOOL* pool, CONVERTEDENTRY* out )
+{
+    (void)wb;
+    const MINIWAVEFORMAT* miniFmt = &info->Format;
+    uint32_t dwLength = info->dwLength;
+    uint32_t Duration = info->Duration;
+    int verbose = opt->verbose;
+
+    ENTRYPLAN plan;
+    PlanEntry(info, opt, &plan);
+    InitConvertedEntry(info, &plan, out);
+
+    const uint8_t* p;
+    if(!plan.silence && !info->data) {
+        printf("ERROR: reading wav data!\n");
+        return -1;
+    }
+    // silence is cheaper to build than to look up
+    int cached = opt->cachedir && plan.convert && !plan.silence;
+    double t = StageClock();
+    uint64_t key = cached? CacheKey(info, opt) : 0;
+    int hit = cached && !CacheLoad(opt->cachedir, key, out);
+    out->times.time[STAGE_READ] += StageClock() - t;
+    if(hit) {
+        if(verbose)
+            printf("\tFrom cache %u/%u:%dHz -> %u/%u:%dHz\n", dwLength, Duration, miniFmt->nSamplesPerSec, out->length, out->Duration, out->Format.nSamplesPerSec);
+        return 0;
+    }
+    int newLength = 0, newDuration = 0;
+    void* buffout = NULL;
+    if (plan.convert) {
+        if(plan.silence) {
+            newDuration = plan.rate;
+            newLength = SilenceLength(&plan, opt);
+            buffout = malloc(newLength);
+            memset(buffout, 0, newLength); // 0 should be silence, even in msadpcm
+            p = (const uint8_t*)buffout;
+        } else {
+            // everything is done on 16bits PCM: decode, mix, resample, then encode back
+            t = StageClock();
+            AdaptEntryRate(info, opt, &plan);
+            std::vector<int16_t> pcm((size_t)plan.frames*plan.chans);
+            uint32_t frames = DecodeEntryRange(info, 0, plan.frames, pcm.data());
+            AutoMonoEntry(info, opt, &plan, pcm.data());
+            TrimEntrySilence(info, opt, &plan, pcm.data());
+            if(plan.lead || plan.trail) {
+                pcm.erase(pcm.begin(), pcm.begin() + (size_t)plan.lead*plan.chans);
+                pcm.resize((size_t)plan.frames*plan.chans);
+                frames = plan.frames;
+            }
+            if(plan.newchannels != plan.chans)
+                DownmixMono(pcm.data(), frames, plan.chans);
+            double t2 = StageClock();
+            out->times.time[STAGE_DECODE] += t2 - t;
+            t = t2;
+            std::vector<int16_t> res;
+            if(plan.inrate == plan.rate) {
+                res.swap(pcm);
+                newDuration = frames;
+            } else if(opt->quality == REXWB_QUALITY_SOX) {
+                newDuration = ResampleSox(pcm.data(), frames, plan.newchannels, plan.inrate, plan.rate, res, &out->times);
+                if(newDuration<0)
+                    return -3;
+            } else {
+                // filter tables are built once per rates pair and shared by all entries
+                const RESAMPLER* rs = GetResampler(plan.inrate, plan.rate, ResamplerPreset(opt->quality));
+                if(!rs) {
+                    printf("ERROR: cannot create a resampler for %dHz -> %dHz\n", plan.inrate, plan.rate);
+                    return -3;
+                }
+                res.resize((size_t)ResampledLength(rs, frames)*plan.newchannels);
+                newDuration = Resample(rs, pcm.data(), frames, plan.newchannels, res.data());
+            }
+            t2 = StageClock();
+            // without the RIFF header built for sox, only timed there
+            out->times.time[STAGE_RESAMPLE] += t2 - t - out->times.time[STAGE_HEADER];
+            t = t2;
+            if(plan.adpcm_out) {
+                uint32_t blockAlign = AdpcmOutBlockAlign(&plan);
+                buffout = malloc(AdpcmEncodedSize(newDuration, plan.newchannels, blockAlign));
+                newLength = AdpcmEncode(res.data(), newDuration, plan.newchannels, blockAlign, opt->exhaustive, pool, (uint8_t*)buffout);
+            } else {
+                buffout = malloc((size_t)newDuration*plan.newchannels*2);
+                newLength = StorePCM(&plan, res.data(), newDuration, (uint8_t*)buffout);
+            }
+            out->times.time[STAGE_ENCODE] += StageClock() - t;
+            p = (const uint8_t*)buffout;
+            if(verbose && plan.tail)
+                printf("\tLoop tail of %u frames removed\n", plan.tail);
+            if(verbose && plan.newchannels != plan.chans && !opt->mono)
+                printf("\tChannels are alike, mixed to mono\n");
+            if(verbose && (plan.lead || plan.trail))
+                printf("\tSilence trimmed, %u frames at the start and %u at the end\n", plan.lead, plan.trail);
+            if(verbose)
+                printf("\tConvert %u/%u:%dHz -> %u/%u:%dHz\n", dwLength, Duration, miniFmt->nSamplesPerSec, newLength, newDuration, plan.rate);
+        }
+    } else {
+        // pass-through, written straight from the mapping
+        newLength = dwLength;
+        p = info->data;
+    }
+    if(!newLength) {
+        printf("ERROR: null buffer!\n");
+        free(buffout);
+        return -5;
+    }
+
+    out->buffer = buffout;
+    out->data = p;
+    out->length = newLength;
+    if(plan.convert)
+        SetConvertedFormat(&plan, opt, newDuration, out);
+    if(cached) {
+        t = StageClock();
+        CacheStore(opt->cachedir, key, out);
+        out->times.time[STAGE_WRITE] += StageClock() - t;
+    }
+
+    return 0;
+}
+
+size_t EntryOutputSize( const WaveBank* wb, const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt )
+{
+    ENTRYPLAN plan;
+    PlanEntry(info, opt, &plan);
+    (void)wb;
+    if(!plan.convert)
+        return info->dwLength;
+    uint32_t frames = plan.silence? plan.rate : plan.newframes + 1;
+    if(plan.adpcm_out)
+        return plan.silence? (size_t)frames*plan.newchannels/2 : AdpcmEncodedSize(frames, plan.newchannels, AdpcmOutBlockAlign(&plan));
+    return (size_t)frames*plan.newchannels*(plan.pcm8_out?1:2);
+}
+
+size_t EntryWorkingSet( const WaveBank* wb, const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt )
+{
+    ENTRYPLAN plan;
+    PlanEntry(info, opt, &plan);
+    (void)wb;
+    if(!plan.convert || plan.silence)
+        return 0;
+    // decoded PCM, its float copy for the resampler, resampled PCM and the output buffer
+    return (size_t)plan.frames * plan.chans * 2 + (size_t)plan.frames * 4
+         + (size_t)plan.newframes * plan.newchannels * 2 * 2;
+}
+
+int PredictEntry( const WaveBank* wb, const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt, CONVERTEDENTRY* out, ENTRYWORK* work )
+{
+    ENTRYPLAN plan;
+    PlanEntry(info, opt, &plan);
+    InitConvertedEntry(info, &plan, out);
+    (void)wb;
+    if(!plan.silence && plan.convert && !info->data) {
+        printf("ERROR: reading wav data!\n");
+        return -1;
+    }
+    AdaptEntryRate(info, opt, &plan);
+    AutoMonoEntry(info, opt, &plan, NULL);
+    TrimEntrySilence(info, opt, &plan, NULL);
+    memset(work, 0, sizeof(*work));
+    work->adpcm_in = plan.adpcm_in;
+    work->adpcm_out = plan.adpcm_out;
+    work->chans = plan.chans;
+    work->newchannels = plan.newchannels;
+    work->inrate = plan.inrate;
+    work->rate = plan.rate;
+    work->quality = (opt->quality == REXWB_QUALITY_SOX)? -1 : ResamplerPreset(opt->quality);
+    if(!plan.convert) {
+        out->length = info->dwLength;
+        return 0;
+    }
+    uint32_t newDuration;
+    if(plan.silence) {
+        newDuration = plan.rate;
+        out->length = SilenceLength(&plan, opt);
+    } else {
+        // the same lengths as ConvertEntry: exact with the built-in resampler, sox gives about the same
+        newDuration = plan.newframes;
+        if(plan.inrate != plan.rate && work->quality >= 0) {
+            const RESAMPLER* rs = GetResampler(plan.inrate, plan.rate, work->quality);
+            if(!rs) {
+                printf("ERROR: cannot create a resampler for %dHz -> %dHz\n", plan.inrate, plan.rate);
+                return -3;
+            }
+            newDuration = ResampledLength(rs, plan.frames);
+        }
+        work->frames = plan.frames;
+        work->newframes = newDuration;
+        if(plan.adpcm_out)
+            out->length = AdpcmEncodedSize(newDuration, plan.newchannels, AdpcmOutBlockAlign(&plan));
+        else
+            out->length = newDuration * plan.newchannels * (plan.pcm8_out?1:2);
+    }
+    if(!out->length) {
+        printf("ERROR: null buffer!\n");
+        return -5;
+    }
+    SetConvertedFormat(&plan, opt, newDuration, out);
+    return 0;
+}
+
+int ConvertEntryStreamed( const WaveBank* wb, const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt, WORKERPOOL* pool, BANKWRITER* w )
+{
+    ENTRYPLAN plan;
+    PlanEntry(info, opt, &plan);
+    if(!plan.convert || plan.silence || opt->quality == REXWB_QUALITY_SOX) {
+        // nothing big to hold in memory (or sox needs it whole)
+        CONVERTEDENTRY e;
+        int ret = ConvertEntry(wb, info, opt, pool, &e);
+        AddStageTimes(&w->times, &e.times);
+        if(!ret)
+            ret = WriteBankEntry(w, info, &e);
+        FreeConvertedEntry(&e);
+        return ret;
+    }
+    if(!info->data) {
+        printf("ERROR: reading wav data!\n");
+        return -1;
+    }
+
+    CONVERTEDENTRY out;
+    InitConvertedEntry(info, &plan, &out);
+
+    // the output is stored in the cache while it is written to the bank
+    CACHEWRITER cw;
+    memset(&cw, 0, sizeof(cw));
+    uint64_t key = 0;
+    if(opt->cachedir) {
+        double t = StageClock();
+        key = CacheKey(info, opt);
+        int hit = !CacheLoad(opt->cachedir, key, &out);
+        w->times.time[STAGE_READ] += StageClock() - t;
+        if(hit) {
+            if(opt->verbose)
+                printf("\tFrom cache %u/%u:%dHz -> %u/%u:%dHz\n", info->dwLength, info->Duration, info->Format.nSamplesPerSec, out.length, out.Duration, out.Format.nSamplesPerSec);
+            int ret = WriteBankEntry(w, info, &out);
+            FreeConvertedEntry(&out);
+            return ret;
+        }
+        CacheBegin(&cw, opt->cachedir, key);
+    }
+
+    double t = StageClock();
+    AdaptEntryRate(info, opt, &plan);
+    AutoMonoEntry(info, opt, &plan, NULL);
+    TrimEntrySilence(info, opt, &plan, NULL);
+    w->times.time[STAGE_DECODE] += StageClock() - t;
+
+    const MINIWAVEFORMAT* miniFmt = &info->Format;
+    uint32_t chans = plan.chans, newchannels = plan.newchannels;
+    const RESAMPLER* rs = NULL;
+    RESAMPLESTREAM* st = NULL;
+    if(plan.inrate != plan.rate) {
+        rs = GetResampler(plan.inrate, plan.rate, ResamplerPreset(opt->quality));
+        st = rs? CreateResampleStream(rs, newchannels, plan.frames) : NULL;
+        if(!st) {
+            printf("ERROR: cannot create a resampler for %dHz -> %dHz\n", plan.inrate, plan.rate);
+            CacheAbort(&cw);
+            return -3;
+        }
+    }
+
+    // MS ADPCM is encoded by groups of ADPCM_CHUNK_BLOCKS blocks, so the output is the same as in memory.
+    // All the full groups of a piece are encoded at once, the idle workers can take some
+    uint32_t blockAlign = AdpcmOutBlockAlign(&plan);
+    uint32_t spbOut = plan.adpcm_out? AdpcmSamplesIn(0, newchannels, blockAlign, 0) : 0;
+    uint32_t group = ADPCM_CHUNK_BLOCKS * spbOut;
+    size_t fixed = plan.adpcm_out? ((size_t)group*newchannels*2*2 + (size_t)ADPCM_CHUNK_BLOCKS*blockAlign) : 0;
+    // input piece: decoded PCM, float copy, resampled PCM and output (and its blocks)
+    size_t perFrame = chans*2 + newchannels*4 + (size_t)(newchannels*2*2) * plan.rate / plan.inrate + 1;
+    if(plan.adpcm_out)
+        perFrame += (size_t)newchannels * plan.rate / plan.inrate / 2 + 1;
+    size_t cap = (size_t)opt->memlimit << 20;
+    uint32_t piece = (cap > fixed)? (cap - fixed) / perFrame : 0;
+    if(piece < 4096)
+        piece = 4096;
+    if(plan.adpcm_in) {
+        uint32_t spbIn = miniFmt->AdpcmSamplesPerBlock();
+        piece = (piece + spbIn - 1) / spbIn * spbIn;
+    }
+    if(opt->verbose)
+        printf("\tStreamed by pieces of %u frames\n", piece);
+    if(opt->verbose && plan.tail)
+        printf("\tLoop tail of %u frames removed\n", plan.tail);
+    if(opt->verbose && newchannels != chans && !opt->mono)
+        printf("\tChannels are alike, mixed to mono\n");
+    if(opt->verbose && (plan.lead || plan.trail))
+        printf("\tSilence trimmed, %u frames at the start and %u at the end\n", plan.lead, plan.trail);
+
+    std::vector<int16_t> pcm((size_t)piece*chans);
+    std::vector<int16_t> pending;   // PCM waiting for a full group of ADPCM blocks
+    std::vector<int16_t> prevBlock;
+    std::vector<uint8_t> encoded;
+    uint32_t newDuration = 0;
+    int ret = BeginBankEntry(w);
+    // pieces start on a MS ADPCM block, the leading silence left in the first one is skipped
+    uint32_t start = plan.adpcm_in? plan.lead / miniFmt->AdpcmSamplesPerBlock() * miniFmt->AdpcmSamplesPerBlock() : plan.lead;
+    uint32_t end = plan.lead + plan.frames;
+    for(uint32_t first=start; !ret && first<end; first+=piece) {
+        uint32_t count = (end - first < piece)? end - first : piece;
+        double t = StageClock();
+        uint32_t frames = DecodeEntryRange(info, first, count, pcm.data());
+        if(frames < count) {
+            // the partial last MS ADPCM block decodes to less than expected
+            memset(pcm.data() + (size_t)frames*chans, 0, (size_t)(count-frames)*chans*2);
+        }
+        uint32_t skip = (first==start)? plan.lead - start : 0;
+        int16_t* in = pcm.data() + (size_t)skip*chans;
+        count -= skip;
+        if(newchannels != chans)
+            DownmixMono(in, count, chans);
+        double t2 = StageClock();
+        w->times.time[STAGE_DECODE] += t2 - t;
+        t = t2;
+        const int16_t* res = in;
+        uint32_t nres = count;
+        if(st)
+            nres = ResampleStreamPush(st, in, count, &res);
+        newDuration += nres;
+        t2 = StageClock();
+        w->times.time[STAGE_RESAMPLE] += t2 - t;
+        t = t2;
+        if(!plan.adpcm_out) {
+            encoded.resize((size_t)nres*newchannels*2);
+            uint32_t l = StorePCM(&plan, res, nres, encoded.data());
+            w->times.time[STAGE_ENCODE] += StageClock() - t;
+            ret = WriteBankEntryData(w, encoded.data(), l);
+            CacheWrite(&cw, encoded.data(), l);
+            continue;
+        }
+        pending.insert(pending.end(), res, res + (size_t)nres*newchannels);
+        int last = (first + skip + count >= end);
+        size_t pframes = pending.size()/newchannels;
+        while(!ret && (pframes >= group || (last && pframes))) {
+            uint32_t n = last? pframes : pframes / group * group;
+            uint32_t nblocks = (n + spbOut - 1) / spbOut;
+            // the last block is zero-filled
+            pending.resize(std::max(pending.size(), (size_t)nblocks*spbOut*newchannels), 0);
+            encoded.resize((size_t)nblocks*blockAlign);
+            t = StageClock();
+            uint32_t l = AdpcmEncodeBlocks(prevBlock.empty()?NULL:prevBlock.data(), pending.data(), nblocks, newchannels, blockAlign, opt->exhaustive, pool, encoded.data());
+            w->times.time[STAGE_ENCODE] += StageClock() - t;
+            ret = WriteBankEntryData(w, encoded.data(), l);
+            CacheWrite(&cw, encoded.data(), l);
+            size_t used = (size_t)nblocks*spbOut*newchannels;
+            prevBlock.assign(pending.begin() + used - (size_t)spbOut*newchannels, pending.begin() + used);
+            pending.erase(pending.begin(), pending.begin() + std::min(used, pending.size()));
+            pframes = pending.size()/newchannels;
+        }
+    }
+    if(!plan.frames) {
+        printf("ERROR: null buffer!\n");
+        ret = -5;
+    }
+    FreeResampleStream(st);
+    if(ret) {
+        CacheAbort(&cw);
+        return ret;
+    }
+    if(opt->verbose)
+        printf("\tConvert %u/%u:%dHz -> %u/%u:%dHz\n", info->dwLength, info->Duration, miniFmt->nSamplesPerSec, w->entryLength, newDuration, plan.rate);
+    SetConvertedFormat(&plan, opt, newDuration, &out);
+    CacheEnd(&cw, opt->cachedir, &out);
+    return EndBankEntry(w, info, &out);
+}
+
+void FreeConvertedEntry( CONVERTEDENTRY* out )
+{
+    free(out->buffer);
+    out->buffer = NULL;
+    if(out->cache) {
+        UnmapFile(out->cache);
+        delete out->cache;
+        out->cache = NULL;
+    }
+    out->data = NULL;
+}
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "estimate.h"
+#include "msadpcm.h"
+#include "resample.h"
+
+#define CALIBRATION_FRAMES  16384
+#define CALIBRATION_RUNS    3
+
+// A tone with some noise, so the ADPCM encoder and decoder do their usual work
+static void CalibrationSound( int16_t* pcm, uint32_t frames )
+{
+    uint32_t seed = 1;
+    for(uint32_t i=0; i<frames; ++i) {
+        seed = seed * 1103515245 + 12345;
+        int v = (int)(8000 * ((i % 100) < 50 ? 1 : -1)) + (int)((seed >> 16) & 0xfff) - 0x800;
+        pcm[i] = (int16_t)v;
+    }
+}
+
+void InitCostModel( COSTMODEL* model, const REXWB_OPTIONS* opt )
+{
+    model->exhaustive = opt->exhaustive;
+    model->resample.clear();
+
+    std::vector<int16_t> pcm(CALIBRATION_FRAMES);
+    CalibrationSound(pcm.data(), CALIBRATION_FRAMES);
+    uint32_t blockAlign = 256;
+    std::vector<uint8_t> adpcm(AdpcmEncodedSize(CALIBRATION_FRAMES, 1, blockAlign));
+    // the same block size as the output of the conversion, mono
+    MINIWAVEFORMAT fmt;
+    fmt.dwValue = 0;
+    fmt.wFormatTag = MINIWAVEFORMAT::TAG_ADPCM;
+    fmt.nChannels = 1;
+    fmt.nSamplesPerSec = 44100;
+    fmt.wBlockAlign = blockAlign - MINIWAVEFORMAT::ADPCM_BLOCKALIGN_CONVERSION_OFFSET;
+    fmt.wBitsPerSample = MINIWAVEFORMAT::BITDEPTH_16;
+    std::vector<int16_t> decoded(AdpcmSamplesIn(adpcm.size(), 1, blockAlign, fmt.AdpcmSamplesPerBlock()));
+
+    double encode = 1e30, decode = 1e30;
+    for(int r=0; r<CALIBRATION_RUNS; ++r) {
+        double t = StageClock();
+        uint32_t l = AdpcmEncode(pcm.data(), CALIBRATION_FRAMES, 1, blockAlign, opt->exhaustive, NULL, adpcm.data());
+        double t2 = StageClock();
+        AdpcmDecode(adpcm.data(), l, &fmt, decoded.data());
+        double t3 = StageClock();
+        encode = std::min(encode, t2 - t);
+        decode = std::min(decode, t3 - t2);
+    }
+    model->encode = encode / CALIBRATION_FRAMES;
+    model->decode = decode / CALIBRATION_FRAMES;
+}
+
+static double ResampleCost( COSTMODEL* model, int inrate, int rate, int quality )
+{
+    auto key = std::make_tuple(inrate, rate, quality);
+    auto it = model->resample.find(key);
+    if(it != model->resample.end())
+        return it->second;
+    // sox isn't measured, its "rate" effect is about as slow as the very high quality preset
+    const RESAMPLER* rs = GetResampler(inrate, rate, quality<0? RESAMPLE_VERYHIGH : quality);
+    double cost = 0;
+    if(rs) {
+        std::vector<int16_t> pcm(CALIBRATION_FRAMES);
+        std::vector<int16_t> out(ResampledLength(rs, CALIBRATION_FRAMES));
+        CalibrationSound(pcm.data(), CALIBRATION_FRAMES);
+        double best = 1e30;
+        for(int r=0; r<CALIBRATION_RUNS; ++r) {
+            double t = StageClock();
+            Resample(rs, pcm.data(), CALIBRATION_FRAMES, 1, out.data());
+            best = std::min(best, StageClock() - t);
+        }
+        cost = best / CALIBRATION_FRAMES;
+    }
+    model->resample[key] = cost;
+    return cost;
+}
+
+double EntryCost( COSTMODEL* model, const ENTRYWORK* work )
+{
+    if(!work->frames)
+        return 0;
+    double cost = 0;
+    if(work->adpcm_in)
+        cost += model->decode * work->frames * work->chans;
+    if(work->inrate != work->rate)
+        cost += ResampleCost(model, work->inrate, work->rate, work->quality) * work->frames * work->newchannels;
+    if(work->adpcm_out)
+        cost += model->encode * work->newframes * work->newchannels;
+    return cost;
+}
@@ -0,0 +1,22 @@
+#ifndef _ESTIMATE_H_
+#define _ESTIMATE_H_
+
+#include <map>
+#include <tuple>
+
+#include "rexwb.h"
+
+// Conversion time of an entry from the work it needs, for the dry run (--dry-run).
+// Each stage cost is measured once on this machine, on a short synthetic sound
+typedef struct {
+    int         exhaustive;
+    double      decode;         // seconds per MS ADPCM frame and channel (PCM is only copied, not counted)
+    double      encode;         // seconds per MS ADPCM frame and channel
+    std::map<std::tuple<int,int,int>, double> resample;    // per input frame and channel, for (inrate, rate, quality)
+} COSTMODEL;
+
+void   InitCostModel( COSTMODEL* model, const REXWB_OPTIONS* opt );
+// Estimated cpu seconds to convert the entry (0 if it's only copied)
+double EntryCost( COSTMODEL* model, const ENTRYWORK* work );
+
+#endif //_ESTIMATE_H_
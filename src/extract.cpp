@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "rexwb.h"
+#include "pool.h"
+
+// Entry by name, or by index when no entry has that name
+static int FindEntry( const WaveBank* wb, const char* entry, uint32_t* index )
+{
+    uint32_t count = wb->bank.dwEntryCount;
+    if(wb->entryNames) {
+        for(uint32_t j=0; j<count; ++j) {
+            const char* name = wb->entryNames + (size_t)j * wb->bank.dwEntryNameElementSize;
+            if(!strncmp(name, entry, wb->bank.dwEntryNameElementSize) && strlen(entry) <= wb->bank.dwEntryNameElementSize) {
+                *index = j;
+                return 0;
+            }
+        }
+    }
+    char* end;
+    unsigned long j = strtoul(entry, &end, 10);
+    if(entry[0] && !*end && j < count) {
+        *index = j;
+        return 0;
+    }
+    printf("ERROR: No entry \"%s\" in the bank (%u entries)\n", entry, count);
+    return -1;
+}
+
+// The entry data as is, after a RIFF header (the one built for sox). Only for PCM and MS ADPCM
+static int WriteEntryWav( const WaveBank* wb, uint32_t j, const char* outfile, int verbose )
+{
+    WAVEBANKENTRYINFO info;
+    int bad = GetWaveBankEntry(wb, j, &info, 0);
+    PrintWaveBankEntryErrors(&info);
+    if(bad || !info.data) {
+        printf("ERROR: reading entry %u\n", j);
+        return -1;
+    }
+    if(info.Format.wFormatTag!=MINIWAVEFORMAT::TAG_PCM && info.Format.wFormatTag!=MINIWAVEFORMAT::TAG_ADPCM) {
+        printf("WARNING: Entry %u is xWMA or XMA, not extracted\n", j);
+        return 1;
+    }
+    // only that entry is read, wherever it is in the bank
+    AdviseRange(&wb->file, info.data, info.dwLength, ADVISE_WILLNEED);
+    uint8_t head[sizeof(WAVHEADER_ADPCM)];
+    size_t headsize = BuildWavHeader(&info.Format, info.dwLength, head);
+    char* tmpname;
+    int fd = CreateOutputFile(outfile, &tmpname);
+    if(fd<0)
+        return -2;
+    int ret = WriteOutputAt(fd, head, headsize, 0);
+    if(!ret)
+        ret = WriteOutputAt(fd, info.data, info.dwLength, headsize);
+    if(ret) {
+        DiscardOutputFile(fd, tmpname);
+        return ret;
+    }
+    if(CommitOutputFile(fd, tmpname, outfile))
+        return -2;
+    if(verbose)
+        printf("  Entry %u%s%s%s -> %s, %u bytes, %dx%dHz %s\n", j, info.name[0]?" \"":"", info.name, info.name[0]?"\"":"", outfile,
+            info.dwLength, info.Format.nChannels, info.Format.nSamplesPerSec,
+            (info.Format.wFormatTag==MINIWAVEFORMAT::TAG_ADPCM)?"MS_ADPCM":"PCM");
+    return 0;
+}
+
+extern "C" int rexwb_extract_entry( const char* infile, const char* entry, const char* outfile, const REXWB_OPTIONS* opt )
+{
+    WaveBank wb;
+    if(OpenWaveBank(&wb, infile, 0))
+        return -1;
+    uint32_t j;
+    int ret = FindEntry(&wb, entry, &j);
+    if(!ret)
+        ret = WriteEntryWav(&wb, j, outfile, opt->verbose);
+    CloseWaveBank(&wb);
+    return ret;
+}
+
+// Output name of an entry: its index, and its name when the bank has them (kept to safe characters)
+static std::string EntryWavName( const WaveBank* wb, uint32_t j )
+{
+    char name[WAVEBANK_ENTRYNAME_LENGTH + 16];
+    int l = snprintf(name, sizeof(name), "%04u", j);
+    if(wb->entryNames) {
+        const char* n = wb->entryNames + (size_t)j * wb->bank.dwEntryNameElementSize;
+        if(*n)
+            name[l++] = '_';
+        for(uint32_t k=0; k<wb->bank.dwEntryNameElementSize && k<WAVEBANK_ENTRYNAME_LENGTH && n[k]; ++k)
+            name[l++] = (isalnum((unsigned char)n[k]) || n[k]=='-' || n[k]=='.')? n[k] : '_';
+        name[l] = 0;
+    }
+    return std::string(name) + ".wav";
+}
+
+struct EXTRACTJOB {
+    const WaveBank*     wb;
+    uint32_t            index;
+    std::string         outfile;
+    int                 verbose;
+    int                 ret;
+};
+
+static void ExtractEntryJob( void* arg )
+{
+    EXTRACTJOB* job = (EXTRACTJOB*)arg;
+    job->ret = WriteEntryWav(job->wb, job->index, job->outfile.c_str(), job->verbose);
+}
+
+extern "C" int rexwb_extract_bank( const char* infile, const char* outdir, const REXWB_OPTIONS* opt )
+{
+    struct stat st;
+    if((stat(outdir, &st) || !S_ISDIR(st.st_mode)) && mkdir(outdir, 0755)) {
+        printf("ERROR: Cannot create %s\n", outdir);
+        return -2;
+    }
+    WaveBank wb;
+    if(OpenWaveBank(&wb, infile, 0))
+        return -1;
+    uint32_t count = wb.bank.dwEntryCount;
+    std::vector<EXTRACTJOB> jobs(count);
+    for(uint32_t j=0; j<count; ++j) {
+        jobs[j].wb = &wb;
+        jobs[j].index = j;
+        jobs[j].outfile = std::string(outdir) + "/" + EntryWavName(&wb, j);
+        jobs[j].verbose = opt->verbose;
+        jobs[j].ret = 0;
+    }
+    // the input is mapped, so the workers only share the reads of the page cache
+    if(opt->jobs > 1 && count > 1) {
+        WORKERPOOL* pool = CreateWorkerPool(opt->jobs);
+        for(uint32_t j=0; j<count; ++j)
+            SubmitWork(pool, ExtractEntryJob, &jobs[j]);
+        DestroyWorkerPool(pool);
+    } else {
+        for(uint32_t j=0; j<count; ++j)
+            ExtractEntryJob(&jobs[j]);
+    }
+    int ret = 0;
+    uint32_t done = 0, skipped = 0;
+    for(uint32_t j=0; j<count; ++j) {
+        if(jobs[j].ret < 0 && !ret)
+            ret = jobs[j].ret;
+        done += !jobs[j].ret;
+        skipped += (jobs[j].ret > 0);
+    }
+    if(opt->verbose)
+        printf("%s: %u entries extracted to %s, %u skipped, %u failed\n", infile, done, outdir, skipped, count - done - skipped);
+    CloseWaveBank(&wb);
+    return ret;
+}
@@ -3,56 +3,127 @@
 #include <string.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
 
-#include <sox.h>
+#include <string>
+#include <vector>
+#include <algorithm>
 
-#include "xwb.h"
+#include "rexwb.h"
+#include "pool.h"
 
-uint32_t GetDuration( uint32_t length, const MINIWAVEFORMAT* miniFmt, const uint32_t* seekTable )
+static int IsDirectory( const char* path )
 {
-    switch( miniFmt->wFormatTag )
-    {
-    case MINIWAVEFORMAT::TAG_ADPCM:
-        {
-            uint32_t duration = ( length / miniFmt->BlockAlign() ) * miniFmt->AdpcmSamplesPerBlock();
-            uint32_t partial = length % miniFmt->BlockAlign();
-            if ( partial )
-            {
-                if ( partial >= ( 7 * miniFmt->nChannels ) )
-                    duration += ( partial * 2 / miniFmt->nChannels - 12 );
-            }
-            return duration;
-        }
+    struct stat st;
+    return !stat(path, &st) && S_ISDIR(st.st_mode);
+}
 
-    case MINIWAVEFORMAT::TAG_WMA:
-        if ( seekTable )
-        {
-            uint32_t seekCount = *seekTable;
-            if ( seekCount > 0 )
-            {
-               return seekTable[ seekCount ] / uint32_t( 2 * miniFmt->nChannels );
-            }
-        }
+// Batch inputs: a bank, a directory (all its .xwb) or @LIST (a text file, one bank per line)
+static int AddBatchInput( std::vector<std::string>& banks, const char* arg )
+{
+    if(arg[0]=='@') {
+        FILE* f = fopen(arg+1, "r");
+        if(!f) {
+            printf("ERROR: Cannot open list %s\n", arg+1);
+            return -1;
+        }
+        char line[PATH_MAX];
+        while(fgets(line, sizeof(line), f)) {
+            line[strcspn(line, "\r\n")] = 0;
+            if(line[0])
+                banks.push_back(line);
+        }
+        fclose(f);
         return 0;
-
-    case MINIWAVEFORMAT::TAG_XMA:
-        if ( seekTable )
-        {
-            uint32_t seekCount = *seekTable;
-            if ( seekCount > 0 )
-            {
-               return seekTable[ seekCount ];
-            }
-        }
+    }
+    if(!IsDirectory(arg)) {
+        banks.push_back(arg);
         return 0;
+    }
+    DIR* d = opendir(arg);
+    if(!d) {
+        printf("ERROR: Cannot read directory %s\n", arg);
+        return -1;
+    }
+    std::vector<std::string> found;
+    while(struct dirent* de = readdir(d)) {
+        size_t l = strlen(de->d_name);
+        if(l>4 && !strcasecmp(de->d_name+l-4, ".xwb"))
+            found.push_back(std::string(arg) + "/" + de->d_name);
+    }
+    closedir(d);
+    std::sort(found.begin(), found.end());
+    banks.insert(banks.end(), found.begin(), found.end());
+    return 0;
+}
+
+// Repack mode: -r INFILE MEMFILE STREAMFILE [options], nothing is converted
+static int RepackMain( int argc, const char** argv )
+{
+    REXWB_OPTIONS opt = {};
+    opt.verbose = 1;
+    int ok = (argc>=5);
+    for(int i=5; ok && i<argc; i++) {
+        if(!strncmp(argv[i], "--stream-size=", 14))
+            {sscanf(argv[i]+14,"%d", &opt.streamsize);}
+        else if(!strncmp(argv[i], "--stream-seconds=", 17))
+            {sscanf(argv[i]+17,"%d", &opt.streamseconds);}
+        else if(!strncmp(argv[i], "--report=", 9) && argv[i][9])
+            {opt.report=argv[i]+9;}
+        else {ok = 0; printf("Unknown option \"%s\", aborting\n", argv[i]);}
+    }
+    if(!ok) {
+        printf(
+            "usage: %s -r INFILE.xwb MEMFILE.xwb STREAMFILE.xwb [--stream-size=KB] [--stream-seconds=S] [--report=FILE]\n"
+            "Split the in-memory bank INFILE in two, without converting anything: the long sounds go to STREAMFILE,\n"
+            "a streaming bank aligned on DVD sectors, the others to MEMFILE (it can be INFILE)\n"
+            "Use --stream-size=KB to stream the sounds of KB kilobytes or more, --stream-seconds=S the ones of S seconds or more\n"
+            "  (default 10 seconds)\n"
+            "Use --report=FILE to write where each sound went, its new bank and index (- for stdout)\n"
+            , argv[0]);
+        return 1;
+    }
+    return rexwb_repack_bank(argv[2], argv[3], argv[4], &opt);
+}
 
-    default:
-        return ( length * 8 ) / ( miniFmt->BitsPerSample() * miniFmt->nChannels );
+// Extract mode: -x INFILE OUTFILE.wav ENTRY, or -x INFILE OUTDIR [-j N] for all the entries
+static int ExtractMain( int argc, const char** argv )
+{
+    REXWB_OPTIONS opt = {};
+    opt.verbose = 1;
+    opt.jobs = 1;
+    const char* entry = NULL;
+    int ok = (argc>=4);
+    for(int i=4; ok && i<argc; i++) {
+        if(!strcmp(argv[i], "-j") && argc>i+1)
+            {++i; sscanf(argv[i],"%d", &opt.jobs); if(opt.jobs<=0) opt.jobs=GetCPUCount();}
+        else if(!entry && argv[i][0]!='-')
+            {entry = argv[i];}
+        else {ok = 0; printf("Unknown option \"%s\", aborting\n", argv[i]);}
+    }
+    if(!ok) {
+        printf(
+            "usage: %s -x INFILE.xwb OUTFILE.wav ENTRY\n"
+            "Write the sound ENTRY (its name, or its index) of INFILE as a .wav file, as it is in the bank (PCM or MS ADPCM)\n"
+            "or:    %s -x INFILE.xwb OUTDIR [-j N]\n"
+            "Write all the sounds of INFILE in OUTDIR (created if needed), N at a time (0 for all cpus)\n"
+            , argv[0], argv[0]);
+        return 1;
     }
+    if(entry)
+        return rexwb_extract_entry(argv[2], entry, argv[3], &opt);
+    return rexwb_extract_bank(argv[2], argv[3], &opt);
 }
 
 int main(int argc, const char **argv) {
 
+    if(argc>1 && !strcmp(argv[1], "-r"))
+        return RepackMain(argc, argv);
+    if(argc>1 && !strcmp(argv[1], "-x"))
+        return ExtractMain(argc, argv);
+
     int rate = 0;
     int verbose = 1;
     int percentage = 0;
@@ -60,6 +131,29 @@ int main(int argc, const char **argv) {
     int mono = 0;
     int bits8 = 0;
     int silent = 0;
+    int jobs = 1;
+    int exhaustive = 0;
+    int quality = REXWB_QUALITY_DEFAULT;
+    int memlimit = 0;
+    int dedupe = 0;
+    int inplace = 0;
+    const char* cachedir = NULL;
+    const char* stats = NULL;
+    int slowest = 0;
+    int dryrun = 0;
+    int trimtail = 0;
+    int adaptive = 0;
+    int bandloss = 0;
+    int trimsilence = 0;
+    int silencelevel = 0;
+    int levelset = 0;   // --silence-level given
+    int automono = 0;
+    int monodiff = -1;  // -1: default
+    std::vector<int> rates;
+    int ratesset = 0;   // --rates or --band-loss given
+    // batch mode: -b OUTDIR rate [options] INPUT...
+    int batch = (argc>1 && !strcmp(argv[1], "-b"));
+    std::vector<std::string> banks;
 
     if(argc>3) {
         int t;
@@ -67,8 +161,6 @@ int main(int argc, const char **argv) {
             rate=t;
         if (rate<4000) rate=0;
     }
-    if(argc>3 && !strcmp(argv[1], argv[2]))
-        rate=0;
     if(argc>3) {
         for (int i=4; i<argc; i++) {
             if(!strcmp(argv[i], "-p"))
@@ -81,905 +173,185 @@ int main(int argc, const char **argv) {
                 {bits8=1; force=1;}
             else if(!strcmp(argv[i], "-s") && argc>=i+1)
                 {++i; sscanf(argv[i],"%d", &silent);}
+            else if(!strcmp(argv[i], "-e"))
+                {exhaustive=1;}
+            else if(!strcmp(argv[i], "-d"))
+                {dedupe=1;}
+            else if(!strcmp(argv[i], "-i"))
+                {inplace=1;}
+            else if(!strcmp(argv[i], "-t"))
+                {trimtail=1;}
+            else if(!strcmp(argv[i], "--auto-mono"))
+                {automono=1;}
+            else if(!strncmp(argv[i], "--auto-mono=", 12)) {
+                automono = 1;
+                if(sscanf(argv[i]+12,"%d", &monodiff)!=1 || monodiff<0) {rate = 0; printf("Invalid --auto-mono=\"%s\" (peak difference on 16 bits, 0 or more), aborting\n", argv[i]+12);}
+            }
+            else if(!strcmp(argv[i], "-z"))
+                {trimsilence=1;}
+            else if(!strncmp(argv[i], "--silence-level=", 16)) {
+                if(sscanf(argv[i]+16,"%d", &silencelevel)!=1 || silencelevel<0) {rate = 0; printf("Invalid --silence-level=\"%s\" (16 bits sample value, 0 or more), aborting\n", argv[i]+16);}
+                levelset = 1;
+            }
+            else if(!strcmp(argv[i], "-a"))
+                {adaptive=1;}
+            else if(!strncmp(argv[i], "--rates=", 8)) {
+                rates.clear();
+                for(const char* p=argv[i]+8; p; p=strchr(p, ',')?strchr(p, ',')+1:NULL) {
+                    char* end;
+                    long r = strtol(p, &end, 10);
+                    if(end==p || (*end && *end!=',') || r<4000) {rate = 0; printf("Invalid rate in --rates=\"%s\" (each one 4000 Hz or more), aborting\n", argv[i]+8); break;}
+                    if(rates.size()>=15) {rate = 0; printf("Too many rates in --rates=\"%s\" (15 at most), aborting\n", argv[i]+8); break;}
+                    rates.push_back(r);
+                }
+                ratesset = 1;
+            }
+            else if(!strncmp(argv[i], "--band-loss=", 12)) {
+                if(sscanf(argv[i]+12,"%d", &bandloss)!=1 || bandloss<=0) {rate = 0; printf("Invalid --band-loss=\"%s\" (dB, above 0), aborting\n", argv[i]+12);}
+                ratesset = 1;
+            }
+            else if(!strcmp(argv[i], "-q") && argc>i+1) {
+                ++i;
+                if(!strcmp(argv[i], "quick")) quality=REXWB_QUALITY_QUICK;
+                else if(!strcmp(argv[i], "medium")) quality=REXWB_QUALITY_MEDIUM;
+                else if(!strcmp(argv[i], "high")) quality=REXWB_QUALITY_HIGH;
+                else if(!strcmp(argv[i], "veryhigh")) quality=REXWB_QUALITY_VERYHIGH;
+                else if(!strcmp(argv[i], "sox")) quality=REXWB_QUALITY_SOX;
+                else {rate = 0; printf("Unknown quality \"%s\", aborting\n", argv[i]);}
+            }
+            else if(!strcmp(argv[i], "-M") && argc>i+1)
+                {++i; sscanf(argv[i],"%d", &memlimit); if(memlimit<0) memlimit=0;}
+            else if(!strcmp(argv[i], "-c") && argc>i+1)
+                {++i; cachedir = argv[i];}
+            else if(!strcmp(argv[i], "--dry-run"))
+                {dryrun=1;}
+            else if(!strcmp(argv[i], "--stats=json"))
+                {stats="-";}
+            else if(!strncmp(argv[i], "--stats=json:", 13) && argv[i][13])
+                {stats=argv[i]+13;}
+            else if(!strncmp(argv[i], "--slowest=", 10))
+                {sscanf(argv[i]+10,"%d", &slowest);}
+            else if(!strcmp(argv[i], "-j") && argc>i+1)
+                {++i; sscanf(argv[i],"%d", &jobs); if(jobs<=0) jobs=GetCPUCount();}
+            else if(batch && argv[i][0]!='-')
+                {if(AddBatchInput(banks, argv[i])) rate = 0;}
             else {rate = 0; printf("Unknown option \"%s\", aborting\n", argv[i]);}
         }
     }
+    if(ratesset && !adaptive) {
+        rate = 0;
+        printf("--rates and --band-loss only apply to the adaptive rate, add -a, aborting\n");
+    }
+    if(levelset && !trimsilence) {
+        rate = 0;
+        printf("--silence-level only applies to the silence trimming, add -z, aborting\n");
+    }
+    if(batch && banks.empty())
+        rate = 0;
     if(!rate) {
         printf(
-            "usage: %s INFILE.xwb OUTFILE.xwb rate [-f] [-p]\n"
+            "usage: %s INFILE.xwb OUTFILE.xwb rate [-f] [-e] [-q Q] [-p] [-j N] [-M MB] [-c DIR] [-d] [-i] [-t] [-z] [-a] [--auto-mono[=N]] [--dry-run] [--stats=json[:FILE]]\n"
             "Change samplerate to rate of all WaveSound from INFILE to OUTFILE\n"
-            "Warning, OUTFILE.xwb is overwiten (and must be different then INFILE.xwb)\n"
+            "Warning, OUTFILE.xwb is overwiten. It can be INFILE.xwb, it is then replaced once the conversion is complete\n"
+            "Use -i with OUTFILE same as INFILE to rewrite it in place, without the temporary copy (not safe if interrupted)\n"
             "Use -f to force MS ADPCM to simple PCM\n"
+            "Use -e to search every MS ADPCM predictor on each block (slower, slightly better quality)\n"
             "Use -m to force mono on all multi-channels ADPCM or PCM sounds\n"
+            "Use --auto-mono to mix to mono only the multi-channels sounds whose channels are alike (pseudo stereo),\n"
+            "  --auto-mono=N to allow a peak difference of N between the channels (16 bits, default 256, 0: identical channels)\n"
             "Use -8 to force PCM sounds and 8 bits (don't use)\n"
             "Use -s XX to replace sounds longer then XX sec to 1 sec silence\n"
+            "Use -a to choose the rate of each sound from its bandwidth, rate is then the highest rate used (never upsampled)\n"
+            "  --rates=R1,R2... are the rates to choose from, --band-loss=DB the energy lost above the new band (default 30dB below the total)\n"
+            "Use -t to remove the data after the loop end of the looping sounds flagged REMOVELOOPTAIL (never played)\n"
+            "Use -z to remove the silence at the start and at the end of the sounds (not if their loop reaches it)\n"
+            "  --silence-level=N is the highest sample value (16 bits) taken as silence (default 0: digital silence only)\n"
+            "Use -q Q to choose the resampler: quick, medium, high (default), veryhigh or sox (the older sox \"rate\")\n"
+            "Use -j N to convert N entries in parallel (0 for all cpus), output is the same as a serial run\n"
+            "Use -M MB to cap the memory used by the conversion to about MB megabytes, bigger entries are converted by pieces\n"
+            "Use -d to convert and store only once the sounds that are identical in the bank\n"
+            "Use -c DIR to keep converted sounds in the DIR cache, unchanged sounds are not converted again on the next runs\n"
+            "Use --stats=json to print JSON statistics at the end (time per stage, bytes, peak memory, slowest entries),\n"
+            "  --stats=json:FILE to write them to FILE, --slowest=N to list the N slowest entries (default 10)\n"
+            "Use --dry-run to only print the size of each converted sound and of the bank, and an estimate of the conversion time\n"
             "Use -p to display percentage (no verbose output, to be used with a zenity progress bar)\n"
-            , argv[0]);
+            "or:    %s -b OUTDIR rate [options] INPUT...\n"
+            "Convert several banks at once, sharing the -j workers, to OUTDIR (created if needed)\n"
+            "INPUT is a bank, a directory (all its .xwb) or @LIST, a text file with one bank per line\n"
+            "or:    %s -r INFILE.xwb MEMFILE.xwb STREAMFILE.xwb [options]\n"
+            "Split a bank in an in-memory bank and a streaming bank (run it alone for the options)\n"
+            "or:    %s -x INFILE.xwb OUTFILE.wav ENTRY  or  %s -x INFILE.xwb OUTDIR [-j N]\n"
+            "Extract one sound (by name or index) or all of them as .wav files\n"
+            , argv[0], argv[0], argv[0], argv[0], argv[0]);
         return 1;
     }
 
-    if(sox_init() != SOX_SUCCESS) {
-        printf("ERROR: Initializing SOX\n");
-        return -3;
+    std::vector<std::string> outs;
+    if(batch) {
+        const char* outdir = argv[2];
+        if(!dryrun && !IsDirectory(outdir) && mkdir(outdir, 0755)) {
+            printf("ERROR: Cannot create %s\n", outdir);
+            return -2;
+        }
+        for(auto& in : banks) {
+            size_t slash = in.find_last_of('/');
+            outs.push_back(std::string(outdir) + "/" + ((slash==std::string::npos)? in : in.substr(slash+1)));
+        }
+    } else {
+        banks.push_back(argv[1]);
+        outs.push_back(argv[2]);
     }
-    if(!verbose)
-        sox_get_globals()->verbosity = 0;
-
-    const char* infile = argv[1];
-    const char* outfile = argv[2];
 
     if(verbose)
-        printf("Will convert %s to %s @%d Hz%s%s%s\n", infile, outfile, rate, 
+        printf("Will convert %s to %s @%d Hz%s%s%s%s%s\n", batch?"banks":argv[1], argv[2], rate,
+            adaptive?" max, adaptive rate":"",
             force?" force PCM":"",
-            mono?" force Mono":"",
+            mono?" force Mono":(automono?" auto Mono":""),
             bits8?" force 8 bits":"",
             silent? " replace long sound with 3sec silence":"");
     
     if(percentage)
         setbuf(stdout, NULL);
 
-    FILE *fin, *fout;
-    fin = fopen(infile, "rb");
-    if(!fin) {
-        printf("Error opening %s for reading\n", infile);
-        return -1;
-    }
-
-    WAVEBANKHEADER header;
-    WAVEBANKHEADER newheader;
-    if ( fread( &header, 1, sizeof(header), fin ) != sizeof(header) )
-    {
-        printf( "ERROR: File too small for valid wavebank\n");
-        fclose(fin);
-        return -1;
-    }
-
-    if ( *(uint32_t*)header.dwSignature != (uint32_t)WAVEBANK_HEADER_SIGNATURE )
-    {
-        printf( "ERROR: File is not a wavebank - %ls\n", infile );
-        fclose(fin);
-        return -1;
-    }
-
-    memcpy(&newheader, &header, sizeof(newheader));
-
-    if(verbose)
-        printf( "WAVEBANK - %s\n%s\nHeader: File version %u, Tool version %u\n\tBankData %u, length %u\n\tEntryMetadata %u, length %u\n\tSeekTables %u, length %u\n\tEntryNames %u, length %u\n\tEntryWaveData %u, length %u\n",
-            infile, "LittleEndian (Windows wave bank)", 
-            header.dwHeaderVersion, header.dwVersion,
-            header.Segments[WAVEBANK_SEGIDX_BANKDATA].dwOffset, header.Segments[WAVEBANK_SEGIDX_BANKDATA].dwLength,
-            header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwOffset, header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwLength,
-            header.Segments[WAVEBANK_SEGIDX_SEEKTABLES].dwOffset, header.Segments[WAVEBANK_SEGIDX_SEEKTABLES].dwLength,
-            header.Segments[WAVEBANK_SEGIDX_ENTRYNAMES].dwOffset, header.Segments[WAVEBANK_SEGIDX_ENTRYNAMES].dwLength,
-            header.Segments[WAVEBANK_SEGIDX_ENTRYWAVEDATA].dwOffset, header.Segments[WAVEBANK_SEGIDX_ENTRYWAVEDATA].dwLength );
-
-    // check that wavedata are at the end of the file!
-    uint32_t waveOffset = header.Segments[WAVEBANK_SEGIDX_ENTRYWAVEDATA].dwOffset;
-    if(    waveOffset<header.Segments[WAVEBANK_SEGIDX_ENTRYNAMES].dwOffset 
-        || waveOffset<header.Segments[WAVEBANK_SEGIDX_SEEKTABLES].dwOffset
-        || waveOffset<header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwOffset
-        || waveOffset<header.Segments[WAVEBANK_SEGIDX_BANKDATA].dwOffset
-    ) {
-        printf("ERROR: Only wxb where WaveData are last entry is supported\n");
-        return -3;
-    }
-
-    WAVEBANKDATA bank;
-
-    if(fseek(fin, header.Segments[WAVEBANK_SEGIDX_BANKDATA].dwOffset, SEEK_SET))
-    {
-        printf( "ERROR: while fseek on Bankdata\n ");
-        fclose(fin);
-        return -1;
-    }
-    if ( fread( &bank, 1, sizeof(bank), fin ) != sizeof(bank) )
-    {
-        printf( "ERROR: Failed reading bank data\n");
-        fclose(fin);
-        return -1;
-    }
-
-    if(verbose) {
-        printf( "Bank Data:\n\tFlags %08X\n", bank.dwFlags );
-        printf( "\t\t%s\n", ( bank.dwFlags & WAVEBANK_TYPE_STREAMING ) ? "Streaming" : "In-memory" );
-        if ( bank.dwFlags & WAVEBANK_FLAGS_ENTRYNAMES )
-        {
-            printf( "\t\tFLAGS_ENTRYNAMES\n" );
-        }
-        if ( bank.dwFlags & WAVEBANK_FLAGS_COMPACT )
-        {
-            printf( "\t\tFLAGS_COMPACT\n" );
-
-            if ( !( bank.dwFlags & WAVEBANK_TYPE_STREAMING ) )
-            {
-                printf( "WARNING: XACT only supports streaming with compact wavebanks\n");
-            }
-        }
-        if ( bank.dwFlags & WAVEBANK_FLAGS_SYNC_DISABLED )
-        {
-            printf( "\t\tFLAGS_SYNC_DISABLED\n" );
-        }
-        if ( bank.dwFlags & WAVEBANK_FLAGS_SEEKTABLES )
-        {
-            printf( "\t\tFLAGS_SEEKTABLES\n" );
-        }
-        if ( *bank.szBankName )
-            printf( "\tName \"%s\"\n", bank.szBankName );
-
-        printf( "\tEntry metadata size %u\n\tEntry name element size %u\n\tEntry alignment %u\n",
-                bank.dwEntryMetaDataElementSize, bank.dwEntryNameElementSize, bank.dwAlignment );
-        if ( bank.dwFlags & WAVEBANK_FLAGS_COMPACT )
-        {
-            if ( bank.dwEntryMetaDataElementSize != sizeof(WAVEBANKENTRYCOMPACT) )
-            {
-                printf( "ERROR: Compact banks expect a metadata element size of %zu\n", sizeof(WAVEBANKENTRYCOMPACT) );
-                return 1;
-            }
-        }
-        else
-        {
-            if ( bank.dwEntryMetaDataElementSize != sizeof(WAVEBANKENTRY) )
-            {
-                printf( "ERROR: Banks expect a metadata element size of %zu\n", sizeof(WAVEBANKENTRY) );
-                return 1;
-            }
-        }
-        if ( ( bank.dwAlignment < WAVEBANK_ALIGNMENT_MIN ) || ( bank.dwAlignment > WAVEBANK_ALIGNMENT_DVD ) )
-        {
-            printf( "WARNING: XACT expects alignment to be in the range %zu...%zu \n", WAVEBANK_ALIGNMENT_MIN, WAVEBANK_ALIGNMENT_DVD );
-        }
-
-        if ( ( bank.dwFlags & WAVEBANK_TYPE_STREAMING ) && ( bank.dwAlignment < WAVEBANK_DVD_SECTOR_SIZE ) )
-        {
-            printf( "WARNING: XACT expects streaming buffers to be aligned to DVD sector size\n");
-        }
-    }
-/*
-    WAVEBANKSYSTEMTIME st;
-    if ( FileTimeToSystemTime( &bank.BuildTime, &st ) )
-    {
-        WAVEBANKSYSTEMTIME lst;
-        if ( SystemTimeToTzSpecificLocalTime( nullptr, &st, &lst ) )
-        {
-            wchar_t szLocalDate[256] = {};
-            GetDateFormatW( LOCALE_USER_DEFAULT, DATE_LONGDATE, &lst, nullptr, szLocalDate, 256 );
-
-            wchar_t szLocalTime[256] = {};
-            GetTimeFormatW( LOCALE_USER_DEFAULT, 0, &lst, nullptr, szLocalTime, 256 );
-
-            wprintf( L"\tBuild time: %ls, %ls\n", szLocalDate, szLocalTime );
-        }
-    }
-*/
-    if ( !bank.dwEntryCount )
-    {
-        printf( "NOTE: Empty wave bank\n");
-        // TODO: Write an empty out file ?
-        fout = fopen(outfile, "wb+");
-        if(!fout) {
-            printf("ERROR: cannot create %s\n", outfile);
-            fclose(fin);
-            return -2;
-        }
-        fseek(fout, 0, SEEK_SET);
-        fseek(fin, 0, SEEK_END);
-        size_t l = ftell(fin);
-        fseek(fin, 0, SEEK_SET);
-        void* buff = malloc(l);
-        fread(buff, 1, l, fin);
-        if(fwrite(buff, 1, l, fout)!=l) {
-            printf("ERROR: error writing %d bytes\n", l);
-            fclose(fout);
-            fclose(fin);
-            return -2;
-        }
-        fclose(fout);
-        fclose(fin);
-        return 0;
-    }
-
-    // Entry Names
-    uint32_t metadataBytes = header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwLength;
-    if ( metadataBytes != ( bank.dwEntryMetaDataElementSize * bank.dwEntryCount ) )
-    {
-        printf( "ERROR: Mismatch in entries %u and metadata size %u\n", bank.dwEntryCount, metadataBytes );
-        fclose(fin);
-        return 1;
-    }
-
-    if(verbose)
-        printf( "%u entries in wave bank:\n", bank.dwEntryCount );
-
-    char* entryNames = NULL;
-
-    uint32_t namesBytes = header.Segments[WAVEBANK_SEGIDX_ENTRYNAMES].dwLength;
-
-    if ( namesBytes > 0 )
-    {
-        if ( namesBytes != ( bank.dwEntryNameElementSize * bank.dwEntryCount ) )
-        {
-            printf( "ERROR: Mismatch in entries %u and entry names size %u\n", bank.dwEntryCount, namesBytes );
-        }
-        else
-        {
-            entryNames = new char[ namesBytes ];
-
-            if ( fseek(fin, header.Segments[WAVEBANK_SEGIDX_ENTRYNAMES].dwOffset , SEEK_SET ))
-            {
-                printf( "ERROR: Failed to seek to entry names data %u\n", header.Segments[WAVEBANK_SEGIDX_ENTRYNAMES].dwOffset );
-                return 1;
-            }
-
-            if ( !fread( entryNames, 1, namesBytes, fin ) != namesBytes )
-            {
-                printf( "ERROR: Failed reading entry names\n");
-                return 1;
-            }
-        }
-    }
-
-    // Seek tables
-    uint32_t *seekTables = NULL;
-
-    uint32_t seekLen = header.Segments[WAVEBANK_SEGIDX_SEEKTABLES].dwLength;
-    if ( seekLen > 0 )
-    {
-        if ( seekLen < ( bank.dwEntryCount * sizeof(uint32_t) ) )
-        {
-            printf( "ERROR: Seek table is too small, needs at least %zu bytes; only %u bytes\n", bank.dwEntryCount * sizeof(uint32_t), seekLen );
-        }
-        else if ( ( seekLen % 4 ) != 0 )
-        {
-            printf( "ERROR: Seek table should be a multiple of 4 in size (%u bytes)\n", seekLen );
-        }
-        else
-        {
-            size_t seekCount = seekLen / 4;
-
-            seekTables = new uint32_t[ seekCount ];
-
-            if ( fseek( fin, header.Segments[WAVEBANK_SEGIDX_SEEKTABLES].dwOffset, SEEK_SET ))
-            {
-                printf( "ERROR: Failed to seek to seek tables %u\n", header.Segments[WAVEBANK_SEGIDX_SEEKTABLES].dwOffset );
-                return 1;
-            }
-
-            if ( fread( seekTables, 1, seekLen, fin )!=seekLen )
-            {
-                printf( "ERROR: Failed reading seek tables\n");
-                return 1;
-            }
-
-        }
-    }
-
-    if(seekLen>0) {
-        // xwb with seekTables not supported for now...
-        printf("ERROR: wxb with seekTables are not supported\n");
+    if(rexwb_init(verbose))
         return -3;
-    }
-
-    // Entries
-    uint8_t *entries = NULL;
-
-    if ( bank.dwFlags & WAVEBANK_FLAGS_COMPACT )
-    {
-        entries = reinterpret_cast<uint8_t*>( new WAVEBANKENTRYCOMPACT[ bank.dwEntryCount ] );
-    }
-    else
-    {
-        entries = reinterpret_cast<uint8_t*>( new WAVEBANKENTRY[ bank.dwEntryCount ] );
-    }
-
-    if ( fseek( fin, header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwOffset, SEEK_SET ) )
-    {
-        printf( "ERROR: Failed to seek to entry metadata data %u\n", header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwOffset );
-        return 1;
-    }
-
-    if ( fread( entries, 1, metadataBytes, fin )!=metadataBytes )
-    {
-        printf( "ERROR: Failed reading entry metadata\n");
-        return 1;
-    }
-
-    size_t waveBytes = 0;
-    size_t newwaveBytes = 0;
-
-    size_t waveLen = header.Segments[WAVEBANK_SEGIDX_ENTRYWAVEDATA].dwLength;
-
-    if ( ( bank.dwFlags & WAVEBANK_FLAGS_COMPACT ) && ( waveLen > WAVEBANK_MAX_COMPACT_DATA_SEGMENT_SIZE * bank.dwAlignment ) )
-    {
-        printf( "ERROR: data segment too large for a valid compact wavebank" );
-        return 1;
-    }
-
-    // all header analysed, now creating outfile and filing out the hedears...
-    fout = fopen(outfile, "wb");
-    if(!fout) {
-        printf("ERROR: Cannot create %s`\n", outfile);
-        fclose(fin);
-        return -2;
-    }
-    // lets bulk copy all headers
-    {
-        uint32_t t = ftell(fin);
-        fseek(fin, 0, SEEK_SET);
-        void* buff = malloc(t);
-        fread(buff, 1, t, fin);
-        if(fwrite(buff, 1, t, fout)!=t) {
-            printf("ERROR: Cannot write %d bytes\n", t);
-            fclose(fout);
-            fclose(fin);
-            return -2;
-        }
-        free(buff);
-    }
-    // get a copy of entries that will be changed
-    uint8_t *newentries = NULL;
-    if ( bank.dwFlags & WAVEBANK_FLAGS_COMPACT )
-    {
-        newentries = reinterpret_cast<uint8_t*>( new WAVEBANKENTRYCOMPACT[ bank.dwEntryCount ] );
-        memcpy(newentries, entries, sizeof(WAVEBANKENTRYCOMPACT)*bank.dwEntryCount);
-    }
-    else
-    {
-        newentries = reinterpret_cast<uint8_t*>( new WAVEBANKENTRY[ bank.dwEntryCount ] );
-        memcpy(newentries, entries, sizeof(WAVEBANKENTRY)*bank.dwEntryCount);
-    }
-
-    bool hasxma = false;
-    for( uint32_t j=0; j < bank.dwEntryCount; ++j)
-    {
-        uint32_t dwOffset;
-        uint32_t dwLength;
-        uint32_t Duration = 0;
-        uint32_t DurationCompact = 0;
-        const MINIWAVEFORMAT* miniFmt;
-        MINIWAVEFORMAT* newminiFmt;
-
-        if(percentage)
-            printf("%d\n", j*100/bank.dwEntryCount);
-
-        uint32_t* seekTable = nullptr;
-        if ( seekTables )
-        {
-            uint32_t baseOffset = bank.dwEntryCount * sizeof(uint32_t);
-            uint32_t offset = seekTables[ j ];
-            if ( offset != uint32_t(-1) )
-            {
-                if ( ( baseOffset + offset ) >= seekLen )
-                {
-                    printf( "ERROR: Invalid seek table offset entry\n" );
-                }
-                else
-                {
-                    seekTable = reinterpret_cast<uint32_t*>( reinterpret_cast<uint8_t*>( seekTables ) + baseOffset + offset );
-
-                    if ( ( ( ( *seekTable + 1 ) * sizeof(uint32_t) ) + baseOffset + offset ) > seekLen )
-                    {
-                        printf( "ERROR: Too many seek table entries for size of seek tables segment\n");
-                    }
-                }
-            }
-        }
-
-        int32_t offset_shift = 0;
-        uint32_t dwNewOffset = 0;
-        int convert = 1;
-
-        if ( bank.dwFlags & WAVEBANK_FLAGS_COMPACT )
-        {
-            auto& entry = reinterpret_cast<WAVEBANKENTRYCOMPACT*>( entries )[j];
-
-            if(verbose)
-                printf( "  Entry %u (%d, %d)\n", j, entry.dwOffset, entry.dwLengthDeviation );
-
-            miniFmt = (const MINIWAVEFORMAT*)&bank.CompactFormat;
-            dwOffset = entry.dwOffset * bank.dwAlignment;
-
-            if ( j < ( bank.dwEntryCount - 1 ) )
-            {
-                dwLength = ( reinterpret_cast<const WAVEBANKENTRYCOMPACT*>( entries )[j + 1].dwOffset * bank.dwAlignment ) - dwOffset - entry.dwLengthDeviation;
-            }
-            else
-            {
-                dwLength = static_cast<uint32_t>(waveLen - dwOffset - entry.dwLengthDeviation);
-            }
-
-            DurationCompact = GetDuration( dwLength, miniFmt, seekTable );
-        }
-        else
-        {
-            auto& entry = reinterpret_cast<WAVEBANKENTRY*>( entries )[j];
-
-            if(verbose) {
-                printf( "  Entry %u\n\tFlags %08X\n", j, entry.dwFlags );
-                if ( entry.dwFlags & WAVEBANKENTRY_FLAGS_READAHEAD )
-                {
-                    printf( "\tFLAGS_READAHEAD\n");
-                }
-                if ( entry.dwFlags & WAVEBANKENTRY_FLAGS_LOOPCACHE )
-                {
-                    printf( "\tFLAGS_LOOPCACHE\n");
-                }
-                if ( entry.dwFlags & WAVEBANKENTRY_FLAGS_REMOVELOOPTAIL )
-                {
-                    printf( "\tFLAGS_REMOVELOOPTAIL\n");
-                }
-                if ( entry.dwFlags & WAVEBANKENTRY_FLAGS_IGNORELOOP )
-                {
-                    printf( "\tFLAGS_IGNORELOOP\n");
-                }
-            }
-
-            miniFmt = &entry.Format;
-            dwOffset = entry.PlayRegion.dwOffset;
-            dwLength = entry.PlayRegion.dwLength;
-            Duration = entry.Duration;
-            DurationCompact = GetDuration( entry.PlayRegion.dwLength, miniFmt, seekTable );
-        }
-
-        if ( entryNames )
-        {
-            uint32_t n = bank.dwEntryNameElementSize * j;
-
-            char name[ 64 ] = {};
-            strncpy( name, &entryNames[ n ], 64 );
-            if(verbose)
-                printf( "\t\"%s\"\n", name );
-        }
-
-        float seconds;
-        if ( bank.dwFlags & WAVEBANK_FLAGS_COMPACT )
-        {
-            seconds = float( DurationCompact ) / float( miniFmt->nSamplesPerSec );
-            if(verbose)
-                printf( "\tEstDuration %u samples (%f seconds)\n", DurationCompact, seconds );
-        }
-        else
-        {
-            seconds = float( Duration ) / float( miniFmt->nSamplesPerSec );
-            if(verbose)
-                printf( "\tDuration %u samples (%f seconds), EstDuration %u\n", Duration, seconds, DurationCompact );
-        }
-
-        if(verbose)
-            printf( "\tPlay Region %u, Length %u\n", dwOffset, dwLength );
-
-        if ( !( bank.dwFlags & WAVEBANK_FLAGS_COMPACT ) )
-        {
-            auto& entry = reinterpret_cast<const WAVEBANKENTRY*>( entries )[j];
-
-            if(verbose)
-                if ( entry.LoopRegion.dwTotalSamples > 0 )
-                {
-                    printf( "\tLoop Region %u...%u\n", entry.LoopRegion.dwStartSample, entry.LoopRegion.dwTotalSamples );
-                }
-        } else convert = 0; // no conversion for compact format for now
 
-        const char* fmtstr = nullptr;
-        switch( miniFmt->wFormatTag )
-        {
-        case MINIWAVEFORMAT::TAG_PCM:   fmtstr = "PCM"; break; 
-        case MINIWAVEFORMAT::TAG_ADPCM: fmtstr = "MS ADPCM"; break;
-        case MINIWAVEFORMAT::TAG_WMA:   fmtstr = "xWMA"; convert=0; break;
-        case MINIWAVEFORMAT::TAG_XMA:   fmtstr = "XMA"; convert=0; break;
-        }
-
-        if(verbose)
-            printf( "\t%s %u channels, %u-bit, %u Hz\n\tblockAlign %u, avgBytesPerSec %u\n",
-                fmtstr,
-                miniFmt->nChannels, miniFmt->BitsPerSample(), miniFmt->nSamplesPerSec,
-                miniFmt->BlockAlign(), miniFmt->AvgBytesPerSec() );
-
-        if ( !dwLength )
-        {
-            printf( "ERROR: Entry length is 0\n");
-        }
-
-        if ( dwOffset > waveLen
-             || (dwOffset+dwLength) > waveLen )
-        {
-            printf( "ERROR: Invalid wave data region for entry\n");
-        }
-
-        if ( ( dwOffset % bank.dwAlignment ) != 0 )
-        {
-            printf( "ERROR: Entry offset doesn't match alignment\n");
-        }
-
-        if ( seekTable )
-        {
-            if(verbose)
-                printf( "\tSeek table with %u entries", *seekTable );
-
-            for ( uint32_t k = 0; k < *seekTable; ++k )
-            {
-                if ( verbose && ( k % 6 ) == 0 )
-                    printf( "\n\t");
-
-                if(verbose)
-                    printf( "%u ", seekTable[ k + 1 ] );
-            }
-
-            if(verbose)
-                printf( "\n");
-        }
-
-        switch( miniFmt->wFormatTag  )
-        {
-        case MINIWAVEFORMAT::TAG_XMA:
-            hasxma = true;
-            if ( ( dwOffset % 2048 ) != 0 )
-            {
-                printf( "ERROR: XMA2 data needs to be aligned to a 2K boundary\n" );
-            }
-
-            if ( !seekTable )
-            {
-                printf( "ERROR: Missing seek table entry for XMA2 wave\n" );
-            }
-            break;
-
-        case MINIWAVEFORMAT::TAG_WMA:
-            if ( !seekTable )
-            {
-                printf( "ERROR: Missing seek table entry for xWMA wave\n" );
-            }
-            break;
-        }
-
-        int adpcm_in = miniFmt->wFormatTag==MINIWAVEFORMAT::TAG_ADPCM?1:0;
-        int adpcm_out = (force)?0:adpcm_in;
-
-        // convert!
-        {
-            // load the data in a buffer
-            void* buffin = NULL;
-            char* p;
-            int silence = (convert && silent && seconds>silent);
-            if(!silence) {
-                // read input wav
-                buffin = malloc(dwLength + (convert?(adpcm_in?sizeof(WAVHEADER_ADPCM):sizeof(WAVHEADER_SIMPLE)):0));
-                fseek(fin, waveOffset + dwOffset, SEEK_SET);
-                p = (char*)buffin;
-                if(convert) {
-                    if(adpcm_in) {
-                        // Write MS ADPCM WAV Header
-                        WAVHEADER_ADPCM head;
-                        memcpy(&head.sign, "RIFF", 4);
-                        head.filesize = dwLength + sizeof(WAVHEADER_ADPCM) - 8;
-                        memcpy(&head.format, "WAVE", 4);
-                        // fmt
-                        memcpy(&head.formatid, "fmt ", 4);
-                        head.blocksize = 0x10 + 32 + 2;
-                        head.audioformat = 2;
-                        head.channels = miniFmt->nChannels;
-                        head.rate = miniFmt->nSamplesPerSec;
-                        head.bytepersec = miniFmt->AvgBytesPerSec();
-                        head.byteperblock = miniFmt->BlockAlign();
-                        head.bitspersample = miniFmt->BitsPerSample();
-                        // extra
-                        head.extrassz = 32;
-                        head.newsz =  (((head.byteperblock - (7 * head.channels)) * 8) / (head.bitspersample * head.channels)) + 2;
-                        head.ncoeff = 7;
-                        head.coef[0] = 0x00000100;
-                        head.coef[1] = 0xFF000200;
-                        head.coef[2] = 0x00000000;
-                        head.coef[3] = 0x004000C0;
-                        head.coef[4] = 0x000000F0;
-                        head.coef[5] = 0xFF3001CC;
-                        head.coef[6] = 0xFF180188;
-                        memcpy(&head.factid, "fact", 4);
-                        head.factsz = 4;
-                        if(head.byteperblock && head.channels) {
-                            head.factdata = ((head.byteperblock - (7 * head.channels)) * 8) / head.bitspersample;
-                            head.factdata = (dwLength / head.byteperblock ) * head.factdata;
-                            head.factdata /= head.channels;
-                        } else
-                            head.factdata = 0;
-                        // data
-                        memcpy(&head.blockid, "data", 4);
-                        head.datasize = dwLength;
-                        memcpy(p, &head, sizeof(head));
-                        p+=sizeof(head);  // WAV Header
-                    } else {
-                        // Write simple PCM WAV Header
-                        WAVHEADER_SIMPLE head;
-                        memcpy(&head.sign, "RIFF", 4);
-                        head.filesize = dwLength + 44 - 8;
-                        memcpy(&head.format, "WAVE", 4);
-                        // fmt
-                        memcpy(&head.formatid, "fmt ", 4);
-                        head.blocksize = 0x10;
-                        head.audioformat = 1;
-                        head.channels = miniFmt->nChannels;
-                        head.rate = miniFmt->nSamplesPerSec;
-                        head.bytepersec = miniFmt->AvgBytesPerSec();
-                        head.byteperblock = miniFmt->BlockAlign();
-                        head.bitspersample = miniFmt->BitsPerSample();
-                        // data
-                        memcpy(&head.blockid, "data", 4);
-                        head.datasize = dwLength;
-                        memcpy(p, &head, sizeof(head));
-                        p+=sizeof(head);  // WAV Header
-                    }
-                }
-                if(fread(p, 1, dwLength, fin)!=dwLength) {
-                    printf("ERROR: reading wav data!\n");
-                    return -1;
-                }
-            }
-            int newLength, newDuration, newrate, newsamples, newBlockAlign, newchannels;
-            void* buffout = NULL;
-            if (convert) {
-                if(silence) {
-                    newchannels = mono?1:miniFmt->nChannels;
-                    newrate = rate;
-                    newDuration = rate;
-                    newLength = newDuration * (adpcm_out?4:(bits8?8:16)) * newchannels / 8;
-                    newBlockAlign = (adpcm_out)?miniFmt->wBlockAlign:2;
-                    newsamples = newDuration * newchannels;
-                    buffout = malloc(newLength);
-                    memset(buffout, 0, newLength); // 0 should be silence, even in msadpcm
-                    p = (char*)buffout;
-                } else {
-                    // find the new rate
-                    newchannels = mono?1:miniFmt->nChannels;
-                    uint32_t nsamples = Duration * newchannels;
-                    int nblocks = dwLength / miniFmt->BlockAlign();
-                    nblocks = (uint64_t)nblocks * rate / miniFmt->nSamplesPerSec;
-                    newLength = nblocks * miniFmt->BlockAlign();
-                    if(adpcm_in != adpcm_out)   // converting adpcm -> PCM : size * 4!
-                        newLength *= 4;
-                    if(bits8)
-                        newLength>>=1;
-                    newDuration = (uint64_t)Duration * rate / miniFmt->nSamplesPerSec;
-                    newrate = (uint64_t)newDuration * miniFmt->nSamplesPerSec / Duration;
-                    newsamples = newDuration * newchannels;
-                    newBlockAlign = miniFmt->wBlockAlign;
-                    // Using Mem Buffer as input seems to have some nasty side effects in the long run... So using an actual file instead for now.
-                    //sox_format_t * format_in = sox_open_mem_read(buffin, dwLength + (adpcm_in?sizeof(WAVHEADER_ADPCM):sizeof(WAVHEADER_SIMPLE)), NULL, NULL, "WAV");
-                    #define TMPWAV "/tmp/rewxb_tmp.wav"
-                    {
-                        FILE *tmp = fopen(TMPWAV, "wb");
-                        fwrite(buffin, 1, dwLength + (adpcm_in?sizeof(WAVHEADER_ADPCM):sizeof(WAVHEADER_SIMPLE)), tmp);
-                        fclose(tmp);
-                    }
-                    sox_format_t * format_in = sox_open_read(TMPWAV, NULL, NULL, "WAV");
-                    if(!format_in) {
-                        printf("ERROR: SOX cannot create read format\n");
-                        return -3;
-                    }
-                    // copy in to out format
-                    sox_signalinfo_t signal_out = {};
-                    sox_encodinginfo_t encoding_out;
-                    signal_out.channels = newchannels;
-                    signal_out.rate = newrate;
-                    signal_out.length = newLength*4; // some margin? Cannot use SOX_UNKNOWN_LEN here, maybe because format_in is a mem buffer and so non-seekable?
-                    signal_out.precision = format_in->signal.precision;
-                    memcpy(&encoding_out, &format_in->encoding, sizeof(encoding_out));
-                    if(adpcm_in != adpcm_out || bits8) {   // converting adpcm -> PCM
-                        encoding_out.encoding = bits8?SOX_ENCODING_UNSIGNED:SOX_ENCODING_SIGN2;
-                        encoding_out.bits_per_sample = bits8?8:16;
-                        signal_out.precision = bits8?8:16;
-                    }
-                    sox_format_t * format_out = NULL;
-                    size_t buffer_size;
-                    format_out = sox_open_memstream_write((char**)&buffout, &buffer_size, &signal_out, &encoding_out, "WAV", NULL);
-                    if(!format_out) {
-                        printf("ERROR: SOX cannot create write format\n");
-                        return -3;
-                    }
-
-                    sox_signalinfo_t interm_signal = format_in->signal;
-                    sox_effects_chain_t *chain = sox_create_effects_chain(&format_in->encoding, &format_out->encoding);
-                    char * args[10];
-                    sox_effect_t *e = sox_create_effect(sox_find_effect("input"));
-                    args[0] = (char *)format_in;
-                    if(sox_effect_options(e, 1, args) != SOX_SUCCESS) {
-                        printf("ERROR: SOX cannot validate input effect\n");
-                        return -3;
-                    }
-                    if(sox_add_effect(chain, e, &interm_signal, &format_in->signal) != SOX_SUCCESS) {
-                        printf("ERROR: SOX cannot add input effect\n");
-                        return -3;
-                    }
-                    free(e);
-                    e = sox_create_effect(sox_find_effect("rate"));
-                    if(sox_effect_options(e, 0, NULL) != SOX_SUCCESS) {
-                        printf("ERROR: SOX cannot validate rate effect\n");
-                        return -3;
-                    }
-                    if(sox_add_effect(chain, e, &interm_signal, &format_out->signal) != SOX_SUCCESS) {
-                        printf("ERROR: SOX cannot add rate effect\n");
-                        return -3;
-                    }
-                    free(e);
-                    if(format_in->signal.channels != format_out->signal.channels) {
-                        e = sox_create_effect(sox_find_effect("channels"));
-                        if(sox_effect_options(e, 0, NULL) != SOX_SUCCESS) {
-                            printf("ERROR: SOX cannot validate rate effect\n");
-                            return -3;
-                        }
-                        if(sox_add_effect(chain, e, &interm_signal, &format_out->signal) != SOX_SUCCESS) {
-                            printf("ERROR: SOX cannot add rate effect\n");
-                            return -3;
-                        }
-                        free(e);
-                    }
-                    e = sox_create_effect(sox_find_effect("output"));
-                    args[0] = (char *)format_out;
-                    if(sox_effect_options(e, 1, args) != SOX_SUCCESS) {
-                        printf("ERROR: SOX cannot validate out effect\n");
-                        return -3;
-                    }
-                    if(sox_add_effect(chain, e, &interm_signal, &format_out->signal) != SOX_SUCCESS) {
-                        printf("ERROR: SOX cannot add out effect\n");
-                        return -3;
-                    }
-                    free(e);
-                    // convert !
-                    if(verbose)
-                        printf("\tConvert %u/%u:%dHz -> %u/%u:%dHz\n", dwLength, Duration, miniFmt->nSamplesPerSec, newLength, newDuration, newrate);
-
-                    int err = sox_flow_effects(chain, NULL, NULL);
-                    if(err!=SOX_SUCCESS) {
-                        printf("ERROR: SOX: %s\n", sox_strerror(err));
-                    }
-
-                    sox_delete_effects_chain(chain);
-                    sox_close(format_out);
-                    sox_close(format_in);
-                    // read back the file (only for adpcm, for PCM it's already in the memory buffer as RAW)
-                    if(adpcm_out) {
-                        WAVHEADER_ADPCM *head = (WAVHEADER_ADPCM*)buffout;
-                        // check the header is as expected
-                        if(memcmp(&head->sign, "RIFF", 4)) {
-                            printf("ERROR: Converted WAV is not a WAV file???\n");
-                            return -3;
-                        }
-                        if(head->extrassz!=32 || memcmp(&head->factid, "fact", 4) || head->factsz!=4) {
-                            printf("ERROR: Converted WAV doesn't have the expected header...\n");
-                            return -3;
-                        }
-                        newLength = buffer_size - sizeof(WAVHEADER_ADPCM);//head->datasize;
-                        newrate = head->rate;
-                        newchannels = head->channels;
-                        newBlockAlign = head->byteperblock/head->channels - MINIWAVEFORMAT::ADPCM_BLOCKALIGN_CONVERSION_OFFSET;
-                        newDuration = newLength * 8 / (newchannels*4);
-                        p = (char*)buffout+sizeof(WAVHEADER_ADPCM);
-                    } else {
-                        WAVHEADER_SIMPLE *head = (WAVHEADER_SIMPLE*)buffout;
-                        // check the header is as expected
-                        if(memcmp(&head->sign, "RIFF", 4)) {
-                            printf("ERROR: Converted WAV is not a WAV file???\n");
-                            return -3;
-                        }
-                        if(head->blocksize!=16) {
-                            printf("ERROR: Converted WAV doesn't have the expected header...(0x%x!=0x10)\n", head->blocksize);
-                            return -3;
-                        }
-                        newLength = buffer_size - sizeof(WAVHEADER_SIMPLE);//head->datasize;
-                        newrate = head->rate;
-                        newchannels = head->channels;
-                        newBlockAlign = head->byteperblock;
-                        newDuration = newLength * 8 / (newchannels*head->bitspersample); 
-                        p = (char*)buffout+sizeof(WAVHEADER_SIMPLE);
-                    }
-                    remove(TMPWAV);
-                }
-            } else {
-                newLength = dwLength;
-                buffout = buffin;
-                p = (char*)buffout;
-            }
-            if(!newLength) {
-                printf("ERROR: null buffer!\n");
-                return -5;
-            }
-            // save data to file (check offset?)
-            uint32_t newOffset = ftell(fout);
-            fwrite(p, 1, newLength, fout);
-            newwaveBytes += newLength;
-            if(convert) {
-                auto& newentry = reinterpret_cast<WAVEBANKENTRY*>( newentries )[j];
-                newminiFmt = &newentry.Format;
-                if(verbose)
-                    printf("\tnew entry %u->%u/%dx%dHz %s -> ", newentry.PlayRegion.dwOffset, newentry.PlayRegion.dwLength, newminiFmt->nChannels, newminiFmt->nSamplesPerSec, adpcm_in?"MS_ADPCM":"PCM");
-                newentry.PlayRegion.dwOffset = newOffset - waveOffset;
-                newentry.PlayRegion.dwLength = newLength;
-                newentry.Duration = newDuration;
-                uint64_t oldrate = newminiFmt->nSamplesPerSec;
-                newminiFmt->nSamplesPerSec = newrate;
-                newminiFmt->wBlockAlign = newBlockAlign;
-                newminiFmt->nChannels = newchannels;
-                if(adpcm_in != adpcm_out || bits8) {
-                    newminiFmt->wFormatTag=MINIWAVEFORMAT::TAG_PCM;
-                    newminiFmt->wBitsPerSample=1-bits8; // 16bits
-                }
-                if(verbose)
-                    printf("%u->%u/%dx%dHz %s%s\n", newentry.PlayRegion.dwOffset, newentry.PlayRegion.dwLength, newminiFmt->nChannels, newminiFmt->nSamplesPerSec, adpcm_out?"MS_ADPCM":"PCM", bits8?" 8bits":"");
-                if ( newentry.LoopRegion.dwTotalSamples > 0 )
-                {
-                    if(silence) {
-                        newentry.LoopRegion.dwStartSample = 0;
-                        newentry.LoopRegion.dwTotalSamples = newDuration;
-                    } else {
-                        newentry.LoopRegion.dwStartSample = ((uint64_t)(newentry.LoopRegion.dwStartSample/32) * newrate / oldrate)*32;
-                        newentry.LoopRegion.dwTotalSamples = ((uint64_t)(newentry.LoopRegion.dwTotalSamples/32) * newrate / oldrate)*32;
-                        if(newentry.LoopRegion.dwTotalSamples>newDuration)
-                            newentry.LoopRegion.dwTotalSamples=newDuration;
-                    }
-                }
-            } else {
-                if ( bank.dwFlags & WAVEBANK_FLAGS_COMPACT ) {
-                    auto& newentry = reinterpret_cast<WAVEBANKENTRYCOMPACT*>( newentries )[j];
-                    newentry.dwOffset = dwOffset / bank.dwAlignment;
-                } else {
-                    auto& newentry = reinterpret_cast<WAVEBANKENTRY*>( newentries )[j];
-                    newentry.PlayRegion.dwOffset = newOffset - waveOffset;
-                }
-            }
-            // add some padding if lenght is not aligned
-            if(newLength%bank.dwAlignment) {
-                uint8_t pad[2048] = {};
-                fwrite(pad, 1, bank.dwAlignment-(newLength%bank.dwAlignment), fout);
-                newwaveBytes += bank.dwAlignment-(newLength%bank.dwAlignment);
-            }
-            if(buffout!=buffin)
-                free(buffout);
-            free(buffin);
-        }
-
-        waveBytes += dwLength;
-    }
-
-    sox_quit();
-
-    if ( hasxma )
-    {
-        if ( ( header.Segments[WAVEBANK_SEGIDX_ENTRYWAVEDATA].dwOffset % 2048 ) != 0 )
-        {
-            printf( "WARNING: Wave banks containing XMA2 data should have the wave segment offset aligned to a 2K boundary\n" );
-        }
-    }
-
-    if(verbose)
-        printf( "  Total wave bytes %zu -> %zu\n", waveBytes, newwaveBytes );
-
-    if ( waveBytes > waveLen )
-    {
-        printf( "ERROR: Invalid wave data region\n");
-    }
-
-    // write back new entries
-    uint32_t t = ftell(fout);
-    if ( fseek( fout, header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwOffset, SEEK_SET ) )
-    {
-        printf( "ERROR: Failed to seek to entry metadata data %u on out file\n", waveOffset );
-        return -2;
-    }
-
-    if ( fwrite( newentries, 1, metadataBytes, fout )!=metadataBytes ) {
-        printf(" ERROR: Failed to write updated entrie table\n");
-        return -2;
-    }
-    // write back header with new wavesize
-    newheader.Segments[WAVEBANK_SEGIDX_ENTRYWAVEDATA].dwLength = newwaveBytes;
-    fseek( fout, 0, SEEK_SET );
-    fwrite( &newheader, 1, sizeof(newheader), fout);
-
-    // go to the end and truncate (incase the file already exist)
-    fseek(fout, t, SEEK_SET);
-    fclose(fout);
-
-    delete[] entryNames;
-    delete[] seekTables;
-    delete[] entries;
-
-    fclose(fin);
-
-    return 0;
+    REXWB_OPTIONS opt = {};
+    opt.rate = rate;
+    opt.force = force;
+    opt.mono = mono;
+    opt.bits8 = bits8;
+    opt.silent = silent;
+    opt.verbose = verbose;
+    opt.percentage = percentage;
+    opt.jobs = jobs;
+    opt.exhaustive = exhaustive;
+    opt.quality = quality;
+    opt.memlimit = memlimit;
+    opt.cachedir = cachedir;
+    opt.dedupe = dedupe;
+    opt.inplace = inplace;
+    opt.stats = stats;
+    opt.slowest = slowest;
+    opt.dryrun = dryrun;
+    opt.trimtail = trimtail;
+    opt.adaptive = adaptive;
+    opt.bandloss = bandloss;
+    opt.automono = automono;
+    opt.monodiff = monodiff;
+    opt.trimsilence = trimsilence;
+    opt.silencelevel = silencelevel;
+    for(size_t r=0; r<rates.size(); ++r)
+        opt.rates[r] = rates[r];
+
+    std::vector<const char*> infiles, outfiles;
+    for(size_t b=0; b<banks.size(); ++b) {
+        infiles.push_back(banks[b].c_str());
+        outfiles.push_back(outs[b].c_str());
+    }
+    int ret = rexwb_convert_banks(infiles.data(), outfiles.data(), (int)infiles.size(), &opt);
+
+    rexwb_quit();
+
+    return ret;
 }
@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mapfile.h"
+
+int MapFile( MAPPEDFILE* map, const char* filename )
+{
+    memset(map, 0, sizeof(*map));
+    map->fd = open(filename, O_RDONLY);
+    if(map->fd<0)
+        return -1;
+
+    struct stat st;
+    if(fstat(map->fd, &st) || !S_ISREG(st.st_mode)) {
+        close(map->fd);
+        map->fd = -1;
+        return -1;
+    }
+    map->size = st.st_size;
+    if(!map->size)
+        return 0;   // nothing to map, MapRange will refuse everything
+
+    void* p = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, map->fd, 0);
+    if(p==MAP_FAILED) {
+        close(map->fd);
+        map->fd = -1;
+        map->size = 0;
+        return -1;
+    }
+    map->data = (const uint8_t*)p;
+    return 0;
+}
+
+void UnmapFile( MAPPEDFILE* map )
+{
+    if(map->data)
+        munmap((void*)map->data, map->size);
+    if(map->fd>=0)
+        close(map->fd);
+    map->data = NULL;
+    map->size = 0;
+    map->fd = -1;
+}
+
+const void* MapRange( const MAPPEDFILE* map, size_t offset, size_t length )
+{
+    if(!map->data || offset>map->size || length>map->size-offset)
+        return NULL;
+    return map->data + offset;
+}
+
+void AdviseRange( const MAPPEDFILE* map, const void* p, size_t length, int advice )
+{
+    const uint8_t* start = (const uint8_t*)p;
+    if(!map->data || !length || start<map->data || start>=map->data+map->size)
+        return;
+    if(length > (size_t)(map->data + map->size - start))
+        length = map->data + map->size - start;
+    // madvise wants a page aligned address, the mapping itself is
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t skip = (size_t)(start - map->data) % page;
+    int a = (advice==ADVISE_SEQUENTIAL)? MADV_SEQUENTIAL : (advice==ADVISE_RANDOM)? MADV_RANDOM : MADV_WILLNEED;
+    madvise((void*)(start - skip), length + skip, a);
+}
@@ -0,0 +1,29 @@
+#ifndef _MAPFILE_H_
+#define _MAPFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Read-only mapping of a whole file.
+// Everything read from a wavebank is a view inside that mapping, nothing is copied.
+typedef struct {
+    int             fd;
+    const uint8_t*  data;
+    size_t          size;
+} MAPPEDFILE;
+
+int  MapFile( MAPPEDFILE* map, const char* filename );
+void UnmapFile( MAPPEDFILE* map );
+
+// Pointer to [offset, offset+length) in the mapping, or NULL if that range is not inside the file
+const void* MapRange( const MAPPEDFILE* map, size_t offset, size_t length );
+
+// How [p, p+length) of the mapping is going to be read (madvise), the whole mapping is left to the default
+enum {
+    ADVISE_SEQUENTIAL,  // front to back, once
+    ADVISE_RANDOM,
+    ADVISE_WILLNEED,    // read soon, start reading ahead now
+};
+void AdviseRange( const MAPPEDFILE* map, const void* p, size_t length, int advice );
+
+#endif //_MAPFILE_H_
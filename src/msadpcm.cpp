@@ -0,0 +1,484 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ADPCM_X86
+#endif
+
+#include "msadpcm.h"
+#include "pool.h"
+
+static const int AdaptationTable[16] = {
+    230, 230, 230, 230, 307, 409, 512, 614,
+    768, 614, 512, 409, 307, 230, 230, 230
+};
+
+// same as MINIWAVEFORMAT::AdpcmFillCoefficientTable
+static const int AdpcmCoef[7][2] = {
+    { 256, 0 }, { 512, -256 }, { 0, 0 }, { 192, 64 }, { 240, 0 }, { 460, -208 }, { 392, -232 }
+};
+
+static inline int ReadS16( const uint8_t* p )
+{
+    return (int16_t)(p[0] | (p[1]<<8));
+}
+
+uint32_t AdpcmSamplesIn( uint32_t length, uint32_t channels, uint32_t blockAlign, uint32_t samplesPerBlock )
+{
+    uint32_t n, m;
+    if(samplesPerBlock) {
+        n = (length / blockAlign) * samplesPerBlock;
+        m = length % blockAlign;
+    } else {
+        n = 0;
+        m = blockAlign;
+    }
+    if(m >= 7*channels) {
+        m -= 7*channels;            // bytes beyond block header
+        m = (2*m)/channels + 2;     // nibbles per channel + 2 in header
+        if(samplesPerBlock && m>samplesPerBlock)
+            m = samplesPerBlock;
+        n += m;
+    }
+    return n;
+}
+
+// One nibble, exactly like sox's AdpcmDecode
+static inline int DecodeNibble( int c, int& step, int coef0, int coef1, int sample1, int sample2 )
+{
+    int s = step;
+    int nstep = (AdaptationTable[c] * s) >> 8;
+    step = (nstep < 16)? 16 : nstep;
+
+    int vlin = ((sample1 * coef0) + (sample2 * coef1)) >> 8;
+    c -= (c & 0x08) << 1;
+    int sample = (c * s) + vlin;
+    if(sample > 0x7fff) sample = 0x7fff;
+    else if(sample < -0x8000) sample = -0x8000;
+    return sample;
+}
+
+// Scalar decode of one block with n samples per channel (sox's block_expand)
+static void DecodeBlock( const uint8_t* ip, uint32_t chans, uint32_t n, int16_t* op )
+{
+    int coef0[8], coef1[8], step[8];
+
+    for(uint32_t ch=0; ch<chans; ++ch) {
+        uint8_t bpred = *ip++;
+        if(bpred >= 7)
+            bpred = 0;  // sox: "arbitrarily using 0"
+        coef0[ch] = AdpcmCoef[bpred][0];
+        coef1[ch] = AdpcmCoef[bpred][1];
+    }
+    for(uint32_t ch=0; ch<chans; ++ch, ip+=2)
+        step[ch] = ReadS16(ip);
+    // sample1's, then sample2's, sample2 comes first
+    for(uint32_t ch=0; ch<chans; ++ch, ip+=2)
+        op[chans+ch] = ReadS16(ip);
+    for(uint32_t ch=0; ch<chans; ++ch, ip+=2)
+        op[ch] = ReadS16(ip);
+
+    int16_t* o = op + 2*chans;
+    int16_t* top = op + n*chans;
+    uint32_t ch = 0;
+    while(o < top) {
+        uint8_t b = *ip++;
+        *o = DecodeNibble(b>>4, step[ch], coef0[ch], coef1[ch], o[-(int)chans], o[-(int)(2*chans)]);
+        ++o;
+        if(++ch == chans) ch = 0;
+        if(o < top) {
+            *o = DecodeNibble(b&0x0f, step[ch], coef0[ch], coef1[ch], o[-(int)chans], o[-(int)(2*chans)]);
+            ++o;
+            if(++ch == chans) ch = 0;
+        }
+    }
+}
+
+// Split the data bytes of nblocks full blocks in nibbles (high nibble first).
+// This is the channel interleaved nibble stream: nibble k is channel k%chans.
+static void UnpackNibbles( const uint8_t* data, uint32_t nblocks, uint32_t blockAlign, uint32_t chans, uint8_t* nib )
+{
+    uint32_t header = 7*chans;
+    uint32_t bytes = blockAlign - header;
+    for(uint32_t b=0; b<nblocks; ++b) {
+        const uint8_t* ip = data + b*blockAlign + header;
+        uint8_t* op = nib + b*bytes*2;
+        uint32_t i = 0;
+#ifdef ADPCM_X86
+        const __m128i mask = _mm_set1_epi8(0x0f);
+        for(; i+16<=bytes; i+=16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(ip+i));
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+            __m128i lo = _mm_and_si128(v, mask);
+            _mm_storeu_si128((__m128i*)(op+i*2), _mm_unpacklo_epi8(hi, lo));
+            _mm_storeu_si128((__m128i*)(op+i*2+16), _mm_unpackhi_epi8(hi, lo));
+        }
+#endif
+        for(; i<bytes; ++i) {
+            op[i*2] = ip[i]>>4;
+            op[i*2+1] = ip[i]&0x0f;
+        }
+    }
+}
+
+// A stream is one channel of one full block. Several streams are decoded side by side in SIMD lanes.
+typedef struct {
+    const uint8_t*  nib;        // first nibble of that channel in the block nibbles
+    int16_t*        out;        // first output sample
+    int             coef0, coef1, step, sample1, sample2;
+} ADPCMSTREAM;
+
+static void InitStream( ADPCMSTREAM* s, const uint8_t* blk, const uint8_t* nib, uint32_t chans, uint32_t ch, int16_t* out )
+{
+    uint8_t bpred = blk[ch];
+    if(bpred >= 7)
+        bpred = 0;
+    s->coef0 = AdpcmCoef[bpred][0];
+    s->coef1 = AdpcmCoef[bpred][1];
+    s->step = ReadS16(blk + chans + 2*ch);
+    s->sample1 = ReadS16(blk + 3*chans + 2*ch);
+    s->sample2 = ReadS16(blk + 5*chans + 2*ch);
+    s->nib = nib + ch;
+    s->out = out + ch;
+    s->out[0] = s->sample2;
+    s->out[chans] = s->sample1;
+}
+
+static void DecodeStreamsScalar( ADPCMSTREAM* s, int nstreams, uint32_t chans, uint32_t n )
+{
+    for(int l=0; l<nstreams; ++l) {
+        int step = s[l].step, s1 = s[l].sample1, s2 = s[l].sample2;
+        for(uint32_t i=2; i<n; ++i) {
+            int v = DecodeNibble(s[l].nib[(i-2)*chans], step, s[l].coef0, s[l].coef1, s1, s2);
+            s[l].out[i*chans] = v;
+            s2 = s1;
+            s1 = v;
+        }
+    }
+}
+
+#ifdef ADPCM_X86
+// 4 streams in the 4 lanes. Wider kernels (AVX2, or 2x4 lanes) were measured slower:
+// the gather of nibbles and scatter of samples dominate, not the arithmetic
+__attribute__((target("sse4.1")))
+static void DecodeStreamsSSE41( ADPCMSTREAM* s, uint32_t chans, uint32_t n )
+{
+    const __m128i tlo = _mm_setr_epi8(230&0xff, 230&0xff, 230&0xff, 230&0xff, 307&0xff, 409&0xff, 512&0xff, 614&0xff,
+                                      768&0xff, 614&0xff, 512&0xff, 409&0xff, 307&0xff, 230&0xff, 230&0xff, 230&0xff);
+    const __m128i thi = _mm_setr_epi8(230>>8, 230>>8, 230>>8, 230>>8, 307>>8, 409>>8, 512>>8, 614>>8,
+                                      768>>8, 614>>8, 512>>8, 409>>8, 307>>8, 230>>8, 230>>8, 230>>8);
+    const __m128i bytemask = _mm_set1_epi32(0xff);
+    const __m128i eight = _mm_set1_epi32(8);
+    const __m128i sixteen = _mm_set1_epi32(16);
+    const __m128i smax = _mm_set1_epi32(0x7fff);
+    const __m128i smin = _mm_set1_epi32(-0x8000);
+
+    __m128i coef0 = _mm_setr_epi32(s[0].coef0, s[1].coef0, s[2].coef0, s[3].coef0);
+    __m128i coef1 = _mm_setr_epi32(s[0].coef1, s[1].coef1, s[2].coef1, s[3].coef1);
+    __m128i step = _mm_setr_epi32(s[0].step, s[1].step, s[2].step, s[3].step);
+    __m128i s1 = _mm_setr_epi32(s[0].sample1, s[1].sample1, s[2].sample1, s[3].sample1);
+    __m128i s2 = _mm_setr_epi32(s[0].sample2, s[1].sample2, s[2].sample2, s[3].sample2);
+    const uint8_t *n0 = s[0].nib, *n1 = s[1].nib, *n2 = s[2].nib, *n3 = s[3].nib;
+    int16_t *o0 = s[0].out, *o1 = s[1].out, *o2 = s[2].out, *o3 = s[3].out;
+
+    for(uint32_t i=2; i<n; ++i) {
+        uint32_t k = (i-2)*chans;
+        __m128i c = _mm_setr_epi32(n0[k], n1[k], n2[k], n3[k]);
+        // step adaptation
+        __m128i adj = _mm_or_si128(_mm_and_si128(_mm_shuffle_epi8(tlo, c), bytemask),
+                                   _mm_slli_epi32(_mm_and_si128(_mm_shuffle_epi8(thi, c), bytemask), 8));
+        __m128i nstep = _mm_max_epi32(_mm_srai_epi32(_mm_mullo_epi32(adj, step), 8), sixteen);
+        // prediction
+        __m128i vlin = _mm_srai_epi32(_mm_add_epi32(_mm_mullo_epi32(s1, coef0), _mm_mullo_epi32(s2, coef1)), 8);
+        __m128i cs = _mm_sub_epi32(c, _mm_slli_epi32(_mm_and_si128(c, eight), 1));
+        __m128i v = _mm_add_epi32(_mm_mullo_epi32(cs, step), vlin);
+        v = _mm_min_epi32(_mm_max_epi32(v, smin), smax);
+        step = nstep;
+        s2 = s1;
+        s1 = v;
+        uint32_t o = i*chans;
+        o0[o] = _mm_extract_epi32(v, 0);
+        o1[o] = _mm_extract_epi32(v, 1);
+        o2[o] = _mm_extract_epi32(v, 2);
+        o3[o] = _mm_extract_epi32(v, 3);
+    }
+}
+#endif
+
+typedef void (*DECODESTREAMS)( ADPCMSTREAM* s, uint32_t chans, uint32_t n );
+
+static int GetStreamKernel( DECODESTREAMS* kernel )
+{
+#ifdef ADPCM_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse4.1")) {
+        *kernel = DecodeStreamsSSE41;
+        return 4;
+    }
+#endif
+    *kernel = NULL;
+    return 1;
+}
+
+uint32_t AdpcmDecode( const uint8_t* data, uint32_t length, const MINIWAVEFORMAT* fmt, int16_t* pcm )
+{
+    uint32_t chans = fmt->nChannels;
+    uint32_t blockAlign = fmt->BlockAlign();
+    uint32_t spb = fmt->AdpcmSamplesPerBlock();
+    if(!chans || blockAlign <= 7*chans)
+        return 0;
+
+    uint32_t nfull = length / blockAlign;
+    uint32_t partial = length % blockAlign;
+
+    static DECODESTREAMS kernel = NULL;
+    static int lanes = GetStreamKernel(&kernel);
+
+    // full blocks, all their channels are independent streams of spb samples
+    if(nfull) {
+        std::vector<uint8_t> nib((size_t)nfull * (blockAlign - 7*chans) * 2);
+        UnpackNibbles(data, nfull, blockAlign, chans, nib.data());
+
+        uint32_t nstreams = nfull * chans;
+        uint32_t nibPerBlock = (blockAlign - 7*chans) * 2;
+        ADPCMSTREAM s[4];
+        uint32_t st = 0;
+        while(st < nstreams) {
+            int count = (nstreams - st < (uint32_t)lanes)? (int)(nstreams - st) : lanes;
+            for(int l=0; l<count; ++l) {
+                uint32_t b = (st + l) / chans;
+                uint32_t ch = (st + l) % chans;
+                InitStream(&s[l], data + (size_t)b*blockAlign, nib.data() + (size_t)b*nibPerBlock, chans, ch, pcm + (size_t)b*spb*chans);
+            }
+            if(count == lanes && kernel)
+                kernel(s, chans, spb);
+            else
+                DecodeStreamsScalar(s, count, chans, spb);
+            st += count;
+        }
+    }
+
+    // partial last block, decoded as far as its data goes
+    uint32_t total = nfull * spb;
+    if(partial) {
+        uint32_t n = AdpcmSamplesIn(0, chans, partial, 0);
+        if(n > spb)
+            n = spb;
+        if(n >= 2) {
+            // the block is padded so the last nibbles never read past the data
+            std::vector<uint8_t> blk(blockAlign, 0);
+            memcpy(blk.data(), data + (size_t)nfull*blockAlign, partial);
+            DecodeBlock(blk.data(), chans, n, pcm + (size_t)total*chans);
+            total += n;
+        }
+    }
+
+    return total;
+}
+
+uint32_t AdpcmEncodedSize( uint32_t samples, uint32_t channels, uint32_t blockAlign )
+{
+    uint32_t spb = AdpcmSamplesIn(0, channels, blockAlign, 0);
+    return (samples + spb - 1) / spb * blockAlign;
+}
+
+// Encode n samples of channel ch with a predictor and a starting step (sox's AdpcmMashS).
+// Return the rms error, write the nibbles and the channel header if obuff is not NULL
+static int EncodeChannel( uint32_t ch, uint32_t chans, const int16_t* ip, int n, int k, int* iostep, uint8_t* obuff )
+{
+    int coef0 = AdpcmCoef[k][0], coef1 = AdpcmCoef[k][1];
+    int v1 = ip[ch];
+    int v0 = ip[ch+chans];
+    double d2 = 0;
+    int step = *iostep;
+    uint8_t* op = obuff;
+    uint32_t ox = 0;
+    if(op) {
+        op[chans+2*ch] = step; op[chans+2*ch+1] = step>>8;
+        op[3*chans+2*ch] = v0; op[3*chans+2*ch+1] = v0>>8;
+        op[5*chans+2*ch] = v1; op[5*chans+2*ch+1] = v1>>8;
+        op += 7*chans;
+        ox = 4*ch;
+    }
+    const int16_t* top = ip + n*chans;
+    for(const int16_t* p = ip + 2*chans + ch; p < top; p += chans) {
+        int vlin = (v0 * coef0 + v1 * coef1) >> 8;
+        int d3 = *p - vlin;
+        int dp = d3 + (step<<3) + (step>>1);
+        int c = 0;
+        if(dp > 0) {
+            c = dp / step;
+            if(c > 15) c = 15;
+        }
+        c -= 8;
+        dp = c * step;
+        c &= 0x0f;
+        v1 = v0;
+        v0 = vlin + dp;
+        if(v0 < -0x8000) v0 = -0x8000;
+        else if(v0 > 0x7fff) v0 = 0x7fff;
+        d3 = *p - v0;
+        d2 += (double)d3*d3;
+        if(op) {
+            op[ox>>3] |= (ox&4)? c : (c<<4);
+            ox += 4*chans;
+        }
+        step = (AdaptationTable[c] * step) >> 8;
+        if(step < 16) step = 16;
+    }
+    *iostep = step;
+    return (int)sqrt(d2 / n);
+}
+
+// Pick the step to start the block with, from the current one (sox's AdpcmMashChannel).
+// Return the rms error of the block encoded with that step
+static int ChooseStep( uint32_t ch, uint32_t chans, const int16_t* ip, int n, int k, int* step )
+{
+    int n0 = n/2;
+    if(n0 > 32) n0 = 32;
+    int s0 = *step, ss = s0;
+    int d0 = EncodeChannel(ch, chans, ip, n, k, &ss, NULL);
+    int s1 = s0;
+    EncodeChannel(ch, chans, ip, n0, k, &s1, NULL);
+    ss = s1 = (3*s0 + s1) / 4;
+    int d1 = EncodeChannel(ch, chans, ip, n, k, &ss, NULL);
+    if(d0 <= d1) {
+        *step = s0;
+        return d0;
+    }
+    *step = s1;
+    return d1;
+}
+
+// Predictor with the lowest residual energy on the input itself
+static int GuessPredictor( uint32_t ch, uint32_t chans, const int16_t* ip, int n )
+{
+    int64_t e[7] = {0};
+    for(int i=2; i<n; ++i) {
+        int x = ip[i*chans+ch], x1 = ip[(i-1)*chans+ch], x2 = ip[(i-2)*chans+ch];
+        for(int k=0; k<7; ++k) {
+            int d = x - ((x1 * AdpcmCoef[k][0] + x2 * AdpcmCoef[k][1]) >> 8);
+            e[k] += (int64_t)d*d;
+        }
+    }
+    int kmin = 0;
+    for(int k=1; k<7; ++k)
+        if(e[k] < e[kmin])
+            kmin = k;
+    return kmin;
+}
+
+// Encode one block of n samples per channel. st holds the step of each channel, updated
+static void EncodeBlock( const int16_t* ip, uint32_t chans, int n, int* st, int exhaustive, uint8_t* obuff, uint32_t blockAlign )
+{
+    if(obuff)
+        memset(obuff, 0, blockAlign);
+    for(uint32_t ch=0; ch<chans; ++ch) {
+        if(st[ch] < 16)
+            st[ch] = 16;
+        int kmin = 0, smin = st[ch];
+        if(exhaustive) {
+            // every predictor, with 2 starting steps each
+            int dmin = 0;
+            for(int k=0; k<7; ++k) {
+                int s = st[ch];
+                int d = ChooseStep(ch, chans, ip, n, k, &s);
+                if(!k || d < dmin) {
+                    kmin = k;
+                    dmin = d;
+                    smin = s;
+                }
+            }
+        } else {
+            kmin = GuessPredictor(ch, chans, ip, n);
+            ChooseStep(ch, chans, ip, n, kmin, &smin);
+        }
+        st[ch] = smin;
+        EncodeChannel(ch, chans, ip, n, kmin, &st[ch], obuff);
+        if(obuff)
+            obuff[ch] = kmin;
+    }
+}
+
+// Blocks are encoded by chunks of ADPCM_CHUNK_BLOCKS. Inside a chunk the step goes from block to block like
+// in sox, a chunk starts with the step left by a trial encoding of the block before it. Chunks don't depend
+// on each other, nor on the thread encoding them, so the output is always the same.
+typedef struct {
+    const int16_t*  pcm;        // first block of the chunk
+    const int16_t*  prev;       // block before it, NULL for the first block of the stream
+    uint32_t        chans;
+    uint32_t        blockAlign;
+    uint32_t        spb;
+    int             exhaustive;
+    uint8_t*        out;
+    uint32_t        count;
+} ADPCMCHUNK;
+
+static void EncodeChunk( void* arg )
+{
+    ADPCMCHUNK* c = (ADPCMCHUNK*)arg;
+    int st[8] = {0};
+    size_t blockSamples = (size_t)c->spb * c->chans;
+    if(c->prev)
+        EncodeBlock(c->prev, c->chans, c->spb, st, c->exhaustive, NULL, c->blockAlign);
+    for(uint32_t b=0; b<c->count; ++b)
+        EncodeBlock(c->pcm + b*blockSamples, c->chans, c->spb, st, c->exhaustive, c->out + (size_t)b*c->blockAlign, c->blockAlign);
+}
+
+uint32_t AdpcmEncodeBlocks( const int16_t* prev, const int16_t* pcm, uint32_t nblocks, uint32_t channels, uint32_t blockAlign, int exhaustive, WORKERPOOL* pool, uint8_t* out )
+{
+    if(!channels || channels > 8 || blockAlign <= 7*channels || !nblocks)
+        return 0;
+    uint32_t spb = AdpcmSamplesIn(0, channels, blockAlign, 0);
+    size_t blockSamples = (size_t)spb * channels;
+
+    uint32_t nchunks = (nblocks + ADPCM_CHUNK_BLOCKS - 1) / ADPCM_CHUNK_BLOCKS;
+    std::vector<ADPCMCHUNK> chunks(nchunks);
+    for(uint32_t i=0; i<nchunks; ++i) {
+        ADPCMCHUNK* c = &chunks[i];
+        uint32_t first = i * ADPCM_CHUNK_BLOCKS;
+        c->pcm = pcm + first*blockSamples;
+        c->prev = first? (c->pcm - blockSamples) : prev;
+        c->chans = channels;
+        c->blockAlign = blockAlign;
+        c->spb = spb;
+        c->exhaustive = exhaustive;
+        c->out = out + (size_t)first*blockAlign;
+        c->count = (nblocks - first < ADPCM_CHUNK_BLOCKS)? (nblocks - first) : ADPCM_CHUNK_BLOCKS;
+    }
+    if(pool && nchunks > 1) {
+        // the workers busy with other entries don't take any, the calling thread then encodes them all
+        WORKGROUP group;
+        memset(&group, 0, sizeof(group));
+        for(uint32_t i=0; i<nchunks; ++i)
+            SubmitGroupWork(pool, &group, EncodeChunk, &chunks[i]);
+        WaitWorkGroup(pool, &group);
+    } else {
+        for(uint32_t i=0; i<nchunks; ++i)
+            EncodeChunk(&chunks[i]);
+    }
+    return nblocks * blockAlign;
+}
+
+uint32_t AdpcmEncode( const int16_t* pcm, uint32_t samples, uint32_t channels, uint32_t blockAlign, int exhaustive, WORKERPOOL* pool, uint8_t* out )
+{
+    if(!channels || channels > 8 || blockAlign <= 7*channels || !samples)
+        return 0;
+    uint32_t spb = AdpcmSamplesIn(0, channels, blockAlign, 0);
+    uint32_t nblocks = (samples + spb - 1) / spb;
+
+    // the last block is zero-filled, like sox does
+    std::vector<int16_t> padded;
+    if(samples % spb) {
+        padded.resize((size_t)nblocks * spb * channels, 0);
+        memcpy(padded.data(), pcm, (size_t)samples * channels * 2);
+        pcm = padded.data();
+    }
+    return AdpcmEncodeBlocks(NULL, pcm, nblocks, channels, blockAlign, exhaustive, pool, out);
+}
@@ -0,0 +1,34 @@
+#ifndef _MSADPCM_H_
+#define _MSADPCM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "xwb.h"
+#include "pool.h"
+
+// Samples per channel in length bytes of MS ADPCM, a partial last block included (same rule as sox)
+uint32_t AdpcmSamplesIn( uint32_t length, uint32_t channels, uint32_t blockAlign, uint32_t samplesPerBlock );
+
+// Decode length bytes of MS ADPCM to interleaved 16bits PCM, bit exact with sox.
+// pcm must hold AdpcmSamplesIn()*nChannels samples. Return the number of samples per channel written
+uint32_t AdpcmDecode( const uint8_t* data, uint32_t length, const MINIWAVEFORMAT* fmt, int16_t* pcm );
+
+// Size in bytes of samples per channel encoded in blocks of blockAlign bytes (the last block is padded)
+uint32_t AdpcmEncodedSize( uint32_t samples, uint32_t channels, uint32_t blockAlign );
+
+// Encode interleaved 16bits PCM to MS ADPCM blocks of blockAlign bytes, with the same block layout as sox.
+// exhaustive tries every predictor on each block (like sox), else the predictor is guessed from the input.
+// Chunks of blocks are also encoded by the idle workers of pool (NULL: only on the calling thread, that can be a
+// worker of pool), the output doesn't depend on it. out must hold AdpcmEncodedSize() bytes. Return the number of bytes written
+uint32_t AdpcmEncode( const int16_t* pcm, uint32_t samples, uint32_t channels, uint32_t blockAlign, int exhaustive, WORKERPOOL* pool, uint8_t* out );
+
+// Blocks encoded by AdpcmEncode() only depend on the ADPCM_CHUNK_BLOCKS-aligned chunk they are in, and the block before it
+#define ADPCM_CHUNK_BLOCKS  64
+
+// Encode nblocks full blocks of a longer stream, prev is the block before them (NULL at the start of the stream).
+// When called on pieces of ADPCM_CHUNK_BLOCKS multiples, the output is the same as AdpcmEncode() on the whole stream
+uint32_t AdpcmEncodeBlocks( const int16_t* prev, const int16_t* pcm, uint32_t nblocks, uint32_t channels, uint32_t blockAlign, int exhaustive, WORKERPOOL* pool, uint8_t* out );
+
+#endif //_MSADPCM_H_
@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PCMSCAN_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PCMSCAN_NEON
+#endif
+
+#include "pcmscan.h"
+
+// Samples skipped from the start (forward) or from the end (backward) by whole silent vectors.
+// The scalar loop finds the exact sample after them
+typedef size_t (*SKIPFUNC)( const int16_t* pcm, size_t n, int level );
+
+static inline int Loud( int16_t v, int level )
+{
+    return v > level || v < -level;
+}
+
+#ifdef PCMSCAN_X86
+static inline __m128i LoudSSE( const int16_t* p, __m128i hi, __m128i lo )
+{
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    return _mm_or_si128(_mm_cmpgt_epi16(v, hi), _mm_cmplt_epi16(v, lo));
+}
+
+static size_t SkipForwardSSE( const int16_t* pcm, size_t n, int level )
+{
+    __m128i hi = _mm_set1_epi16(level), lo = _mm_set1_epi16(-level);
+    size_t i = 0;
+    for(; i+32<=n; i+=32) {
+        __m128i m = _mm_or_si128(_mm_or_si128(LoudSSE(pcm+i, hi, lo), LoudSSE(pcm+i+8, hi, lo)),
+                                 _mm_or_si128(LoudSSE(pcm+i+16, hi, lo), LoudSSE(pcm+i+24, hi, lo)));
+        if(_mm_movemask_epi8(m))
+            break;
+    }
+    return i;
+}
+
+static size_t SkipBackwardSSE( const int16_t* pcm, size_t n, int level )
+{
+    __m128i hi = _mm_set1_epi16(level), lo = _mm_set1_epi16(-level);
+    size_t i = n;
+    for(; i>=32; i-=32) {
+        const int16_t* p = pcm + i - 32;
+        __m128i m = _mm_or_si128(_mm_or_si128(LoudSSE(p, hi, lo), LoudSSE(p+8, hi, lo)),
+                                 _mm_or_si128(LoudSSE(p+16, hi, lo), LoudSSE(p+24, hi, lo)));
+        if(_mm_movemask_epi8(m))
+            break;
+    }
+    return n - i;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i LoudAVX2( const int16_t* p, __m256i hi, __m256i lo )
+{
+    __m256i v = _mm256_loadu_si256((const __m256i*)p);
+    return _mm256_or_si256(_mm256_cmpgt_epi16(v, hi), _mm256_cmpgt_epi16(lo, v));
+}
+
+__attribute__((target("avx2")))
+static size_t SkipForwardAVX2( const int16_t* pcm, size_t n, int level )
+{
+    __m256i hi = _mm256_set1_epi16(level), lo = _mm256_set1_epi16(-level);
+    size_t i = 0;
+    for(; i+64<=n; i+=64) {
+        __m256i m = _mm256_or_si256(_mm256_or_si256(LoudAVX2(pcm+i, hi, lo), LoudAVX2(pcm+i+16, hi, lo)),
+                                    _mm256_or_si256(LoudAVX2(pcm+i+32, hi, lo), LoudAVX2(pcm+i+48, hi, lo)));
+        if(!_mm256_testz_si256(m, m))
+            break;
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t SkipBackwardAVX2( const int16_t* pcm, size_t n, int level )
+{
+    __m256i hi = _mm256_set1_epi16(level), lo = _mm256_set1_epi16(-level);
+    size_t i = n;
+    for(; i>=64; i-=64) {
+        const int16_t* p = pcm + i - 64;
+        __m256i m = _mm256_or_si256(_mm256_or_si256(LoudAVX2(p, hi, lo), LoudAVX2(p+16, hi, lo)),
+                                    _mm256_or_si256(LoudAVX2(p+32, hi, lo), LoudAVX2(p+48, hi, lo)));
+        if(!_mm256_testz_si256(m, m))
+            break;
+    }
+    return n - i;
+}
+#endif
+
+#ifdef PCMSCAN_NEON
+static inline uint16x8_t LoudNEON( const int16_t* p, int16x8_t hi, int16x8_t lo )
+{
+    int16x8_t v = vld1q_s16(p);
+    return vorrq_u16(vcgtq_s16(v, hi), vcltq_s16(v, lo));
+}
+
+static inline int AnyNEON( uint16x8_t m )
+{
+    uint16x4_t h = vorr_u16(vget_low_u16(m), vget_high_u16(m));
+    return vget_lane_u64(vreinterpret_u64_u16(h), 0) != 0;
+}
+
+static size_t SkipForwardNEON( const int16_t* pcm, size_t n, int level )
+{
+    int16x8_t hi = vdupq_n_s16(level), lo = vdupq_n_s16(-level);
+    size_t i = 0;
+    for(; i+32<=n; i+=32) {
+        uint16x8_t m = vorrq_u16(vorrq_u16(LoudNEON(pcm+i, hi, lo), LoudNEON(pcm+i+8, hi, lo)),
+                                 vorrq_u16(LoudNEON(pcm+i+16, hi, lo), LoudNEON(pcm+i+24, hi, lo)));
+        if(AnyNEON(m))
+            break;
+    }
+    return i;
+}
+
+static size_t SkipBackwardNEON( const int16_t* pcm, size_t n, int level )
+{
+    int16x8_t hi = vdupq_n_s16(level), lo = vdupq_n_s16(-level);
+    size_t i = n;
+    for(; i>=32; i-=32) {
+        const int16_t* p = pcm + i - 32;
+        uint16x8_t m = vorrq_u16(vorrq_u16(LoudNEON(p, hi, lo), LoudNEON(p+8, hi, lo)),
+                                 vorrq_u16(LoudNEON(p+16, hi, lo), LoudNEON(p+24, hi, lo)));
+        if(AnyNEON(m))
+            break;
+    }
+    return n - i;
+}
+#endif
+
+#if !defined(PCMSCAN_X86) && !defined(PCMSCAN_NEON)
+static size_t SkipScalar( const int16_t* pcm, size_t n, int level )
+{
+    (void)pcm; (void)n; (void)level;
+    return 0;
+}
+#endif
+
+static SKIPFUNC GetSkipKernel( int backward )
+{
+#ifdef PCMSCAN_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return backward? SkipBackwardAVX2 : SkipForwardAVX2;
+    return backward? SkipBackwardSSE : SkipForwardSSE;
+#elif defined(PCMSCAN_NEON)
+    return backward? SkipBackwardNEON : SkipForwardNEON;
+#else
+    (void)backward;
+    return SkipScalar;
+#endif
+}
+
+static inline int ClampLevel( int level )
+{
+    return (level<0)? 0 : ((level>0x7fff)? 0x7fff : level);
+}
+
+uint32_t LeadingSilence( const int16_t* pcm, uint32_t frames, uint32_t chans, int level )
+{
+    static SKIPFUNC skip = GetSkipKernel(0);
+    level = ClampLevel(level);
+    size_t n = (size_t)frames * chans;
+    size_t i = skip(pcm, n, level);
+    while(i<n && !Loud(pcm[i], level))
+        ++i;
+    return i / chans;
+}
+
+uint32_t TrailingSilence( const int16_t* pcm, uint32_t frames, uint32_t chans, int level )
+{
+    static SKIPFUNC skip = GetSkipKernel(1);
+    level = ClampLevel(level);
+    size_t n = (size_t)frames * chans;
+    size_t i = n - skip(pcm, n, level);
+    while(i>0 && !Loud(pcm[i-1], level))
+        --i;
+    // the frame of the last loud sample is kept
+    return frames - (uint32_t)((i + chans - 1) / chans);
+}
+
+void ChannelMatchInit( CHANNELMATCH* m )
+{
+    memset(m, 0, sizeof(*m));
+}
+
+#ifdef PCMSCAN_X86
+static inline __m128i AddWide( __m128i acc, __m128i x )
+{
+    __m128i sign = _mm_srai_epi32(x, 31);
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(x, sign));
+    return _mm_add_epi64(acc, _mm_unpackhi_epi32(x, sign));
+}
+
+// Stereo kernels: return the frames done, the rest is left to the scalar loop
+static uint32_t StereoMatchSSE( CHANNELMATCH* m, const int16_t* pcm, uint32_t frames )
+{
+    __m128i maskA = _mm_set1_epi32(0xffff);
+    __m128i aa = _mm_setzero_si128(), bb = _mm_setzero_si128(), ab = _mm_setzero_si128();
+    __m128i peak = _mm_set1_epi16(m->peakdiff);
+    uint32_t i = 0;
+    for(; i+4<=frames; i+=4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(pcm + i*2));
+        __m128i va = _mm_and_si128(v, maskA);
+        __m128i vb = _mm_andnot_si128(maskA, v);
+        __m128i sw = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2,3,0,1)), _MM_SHUFFLE(2,3,0,1));
+        // one product per 32 bits lane, it can't overflow
+        aa = AddWide(aa, _mm_madd_epi16(va, v));
+        bb = AddWide(bb, _mm_madd_epi16(vb, v));
+        ab = AddWide(ab, _mm_madd_epi16(va, sw));
+        // a-b and b-a side by side, the max is the absolute difference
+        peak = _mm_max_epi16(peak, _mm_subs_epi16(v, sw));
+    }
+    int64_t s[6];
+    _mm_storeu_si128((__m128i*)s, aa);
+    _mm_storeu_si128((__m128i*)(s+2), bb);
+    _mm_storeu_si128((__m128i*)(s+4), ab);
+    m->aa += s[0] + s[1];
+    m->bb += s[2] + s[3];
+    m->ab += s[4] + s[5];
+    int16_t p[8];
+    _mm_storeu_si128((__m128i*)p, peak);
+    for(int k=0; k<8; ++k)
+        if(p[k] > m->peakdiff)
+            m->peakdiff = p[k];
+    return i;
+}
+#endif
+
+#ifdef PCMSCAN_NEON
+static uint32_t StereoMatchNEON( CHANNELMATCH* m, const int16_t* pcm, uint32_t frames )
+{
+    int64x2_t aa = vdupq_n_s64(0), bb = vdupq_n_s64(0), ab = vdupq_n_s64(0);
+    int16x8_t peak = vdupq_n_s16(m->peakdiff);
+    uint32_t i = 0;
+    for(; i+8<=frames; i+=8) {
+        int16x8x2_t v = vld2q_s16(pcm + i*2);
+        int16x4_t al = vget_low_s16(v.val[0]), ah = vget_high_s16(v.val[0]);
+        int16x4_t bl = vget_low_s16(v.val[1]), bh = vget_high_s16(v.val[1]);
+        aa = vpadalq_s32(vpadalq_s32(aa, vmull_s16(al, al)), vmull_s16(ah, ah));
+        bb = vpadalq_s32(vpadalq_s32(bb, vmull_s16(bl, bl)), vmull_s16(bh, bh));
+        ab = vpadalq_s32(vpadalq_s32(ab, vmull_s16(al, bl)), vmull_s16(ah, bh));
+        peak = vmaxq_s16(peak, vmaxq_s16(vqsubq_s16(v.val[0], v.val[1]), vqsubq_s16(v.val[1], v.val[0])));
+    }
+    m->aa += vgetq_lane_s64(aa, 0) + vgetq_lane_s64(aa, 1);
+    m->bb += vgetq_lane_s64(bb, 0) + vgetq_lane_s64(bb, 1);
+    m->ab += vgetq_lane_s64(ab, 0) + vgetq_lane_s64(ab, 1);
+    int16_t p[8];
+    vst1q_s16(p, peak);
+    for(int k=0; k<8; ++k)
+        if(p[k] > m->peakdiff)
+            m->peakdiff = p[k];
+    return i;
+}
+#endif
+
+void ChannelMatchAdd( CHANNELMATCH* m, const int16_t* pcm, uint32_t frames, uint32_t chans, uint32_t c )
+{
+    uint32_t i = 0;
+    if(chans==2 && c==1) {
+#ifdef PCMSCAN_X86
+        i = StereoMatchSSE(m, pcm, frames);
+#elif defined(PCMSCAN_NEON)
+        i = StereoMatchNEON(m, pcm, frames);
+#endif
+    }
+    for(; i<frames; ++i) {
+        int a = pcm[(size_t)i*chans], b = pcm[(size_t)i*chans + c];
+        m->aa += a*a;
+        m->bb += b*b;
+        m->ab += a*b;
+        int d = (a>b)? a-b : b-a;
+        if(d > 0x7fff)
+            d = 0x7fff;
+        if(d > m->peakdiff)
+            m->peakdiff = d;
+    }
+}
+
+double ChannelCorrelation( const CHANNELMATCH* m )
+{
+    if(!m->aa || !m->bb)
+        return 1;
+    return (double)m->ab / sqrt((double)m->aa * (double)m->bb);
+}
@@ -0,0 +1,26 @@
+#ifndef _PCMSCAN_H_
+#define _PCMSCAN_H_
+
+#include <stdint.h>
+
+// Vectorized scans of interleaved 16bits PCM (SSE2/AVX2 or NEON, scalar otherwise)
+
+// Frames at the start / at the end where every sample is within [-level, level]
+uint32_t LeadingSilence( const int16_t* pcm, uint32_t frames, uint32_t chans, int level );
+uint32_t TrailingSilence( const int16_t* pcm, uint32_t frames, uint32_t chans, int level );
+
+// How alike channel 0 and another channel are: exact sums of the products, and the peak difference
+typedef struct {
+    int64_t     aa;         // sum of a*a (channel 0)
+    int64_t     bb;         // sum of b*b (the other channel)
+    int64_t     ab;         // sum of a*b
+    int         peakdiff;   // highest |a-b| (saturated to 32767)
+} CHANNELMATCH;
+
+void ChannelMatchInit( CHANNELMATCH* m );
+// Add frames of channel 0 and channel c to m. Sums are exact, so pieces can be added in any order
+void ChannelMatchAdd( CHANNELMATCH* m, const int16_t* pcm, uint32_t frames, uint32_t chans, uint32_t c );
+// Correlation of the two channels, 1 when one of them is silent (the peak difference tells then)
+double ChannelCorrelation( const CHANNELMATCH* m );
+
+#endif //_PCMSCAN_H_
@@ -0,0 +1,132 @@
+#include <unistd.h>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+#include "pool.h"
+
+struct WORKITEM {
+    WORKFUNC    fn;
+    void*       arg;
+    WORKGROUP*  group;
+};
+
+struct WORKERPOOL {
+    std::mutex                  lock;
+    std::condition_variable     cond;
+    std::condition_variable     groupdone;
+    std::deque<WORKITEM>        queue;      // group items first
+    size_t                      grouped;    // group items at the front of the queue
+    std::vector<std::thread>    threads;
+    bool                        quit;
+};
+
+static void WorkerThread( WORKERPOOL* pool )
+{
+    for(;;) {
+        WORKITEM item;
+        {
+            std::unique_lock<std::mutex> l(pool->lock);
+            while(pool->queue.empty() && !pool->quit)
+                pool->cond.wait(l);
+            if(pool->queue.empty())
+                return;
+            item = pool->queue.front();
+            pool->queue.pop_front();
+            if(item.group)
+                --pool->grouped;
+        }
+        item.fn(item.arg);
+        if(item.group) {
+            {
+                std::lock_guard<std::mutex> l(pool->lock);
+                --item.group->pending;
+            }
+            pool->groupdone.notify_all();
+        }
+    }
+}
+
+WORKERPOOL* CreateWorkerPool( int nthreads )
+{
+    if(nthreads<1)
+        nthreads = 1;
+    WORKERPOOL* pool = new WORKERPOOL;
+    pool->quit = false;
+    pool->grouped = 0;
+    for(int i=0; i<nthreads; ++i)
+        pool->threads.push_back(std::thread(WorkerThread, pool));
+    return pool;
+}
+
+void SubmitWork( WORKERPOOL* pool, WORKFUNC fn, void* arg )
+{
+    {
+        std::lock_guard<std::mutex> l(pool->lock);
+        pool->queue.push_back({fn, arg, NULL});
+    }
+    pool->cond.notify_one();
+}
+
+void SubmitGroupWork( WORKERPOOL* pool, WORKGROUP* group, WORKFUNC fn, void* arg )
+{
+    {
+        std::lock_guard<std::mutex> l(pool->lock);
+        pool->queue.insert(pool->queue.begin() + pool->grouped, {fn, arg, group});
+        ++pool->grouped;
+        ++group->pending;
+    }
+    pool->cond.notify_one();
+}
+
+void WaitWorkGroup( WORKERPOOL* pool, WORKGROUP* group )
+{
+    std::unique_lock<std::mutex> l(pool->lock);
+    for(;;) {
+        auto it = pool->queue.begin();
+        auto end = it + pool->grouped;
+        while(it != end && it->group != group)
+            ++it;
+        if(it != end) {
+            WORKITEM item = *it;
+            pool->queue.erase(it);
+            --pool->grouped;
+            l.unlock();
+            item.fn(item.arg);
+            l.lock();
+            --group->pending;
+            continue;
+        }
+        if(!group->pending)
+            return;
+        pool->groupdone.wait(l);
+    }
+}
+
+void DestroyWorkerPool( WORKERPOOL* pool )
+{
+    if(!pool)
+        return;
+    {
+        std::lock_guard<std::mutex> l(pool->lock);
+        pool->quit = true;
+    }
+    pool->cond.notify_all();
+    for(auto& t: pool->threads)
+        t.join();
+    delete pool;
+}
+
+int WorkerPoolSize( const WORKERPOOL* pool )
+{
+    return (int)pool->threads.size();
+}
+
+int GetCPUCount( void )
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n<1)?1:(int)n;
+}
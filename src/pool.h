@@ -0,0 +1,28 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+// Fixed set of worker threads running queued work items in submission order
+typedef struct WORKERPOOL WORKERPOOL;
+
+typedef void (*WORKFUNC)( void* arg );
+
+WORKERPOOL* CreateWorkerPool( int nthreads );
+void        SubmitWork( WORKERPOOL* pool, WORKFUNC fn, void* arg );
+// Wait for all submitted work to be done, then stop the threads
+void        DestroyWorkerPool( WORKERPOOL* pool );
+int         WorkerPoolSize( const WORKERPOOL* pool );
+
+// Parts of a work item, run by the idle workers: a worker (or any thread) submits them to a group,
+// then WaitWorkGroup() runs on the calling thread the parts no worker took yet and waits for the others.
+// They go before the queued work, and never wait for it. Zero it before use
+typedef struct {
+    int         pending;
+} WORKGROUP;
+
+void        SubmitGroupWork( WORKERPOOL* pool, WORKGROUP* group, WORKFUNC fn, void* arg );
+void        WaitWorkGroup( WORKERPOOL* pool, WORKGROUP* group );
+
+// Number of online cpus, at least 1
+int         GetCPUCount( void );
+
+#endif //_POOL_H_
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <vector>
+#include <map>
+
+#include "rexwb.h"
+
+// Where an entry of the input went
+typedef struct {
+    int         streaming;
+    uint32_t    index;          // in its new bank
+    uint32_t    offset;         // in the wave data of its new bank
+} REPACKED;
+
+static int StreamedEntry( const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt )
+{
+    uint64_t size = (uint64_t)opt->streamsize << 10;
+    int seconds = opt->streamseconds;
+    if(!size && !seconds)
+        seconds = 10;
+    return (size && info->dwLength >= size) || (seconds && info->seconds >= seconds);
+}
+
+static uint32_t Align( uint32_t v, uint32_t alignment )
+{
+    return (v + alignment - 1) / alignment * alignment;
+}
+
+// Bank name from the output file name, without the directory and the extension
+static void BankName( const char* outfile, char* name )
+{
+    const char* base = strrchr(outfile, '/');
+    base = base? base+1 : outfile;
+    size_t l = strlen(base);
+    if(l>4 && !strcasecmp(base+l-4, ".xwb"))
+        l -= 4;
+    if(l > WAVEBANK_BANKNAME_LENGTH-1)
+        l = WAVEBANK_BANKNAME_LENGTH-1;
+    memset(name, 0, WAVEBANK_BANKNAME_LENGTH);
+    memcpy(name, base, l);
+}
+
+// Write the entries of wb listed in idx as a new bank: headers, then the wave data, each segment in order.
+// Entries sharing one region of the input (see -d) still share it. Fill map for the entries of idx
+static int WriteRepackedBank( const WaveBank* wb, const std::vector<uint32_t>& idx, int streaming, const char* outfile,
+    const char* name, std::vector<REPACKED>& map, uint64_t* waveBytes, int verbose )
+{
+    WAVEBANKHEADER header = wb->header;
+    WAVEBANKDATA bank = wb->bank;
+    uint32_t count = idx.size();
+    bank.dwEntryCount = count;
+    bank.dwFlags = (bank.dwFlags & ~WAVEBANK_TYPE_MASK) | (streaming? WAVEBANK_TYPE_STREAMING : WAVEBANK_TYPE_BUFFER);
+    if(streaming && bank.dwAlignment < WAVEBANK_ALIGNMENT_DVD)
+        bank.dwAlignment = WAVEBANK_ALIGNMENT_DVD;
+    if(name)
+        memcpy(bank.szBankName, name, sizeof(bank.szBankName));
+
+    std::vector<WAVEBANKENTRY> entries(count);
+    std::vector<char> names(wb->entryNames? (size_t)count * bank.dwEntryNameElementSize : 0);
+    std::vector<uint32_t> seek;
+    if(wb->seekTables)
+        seek.assign(count, uint32_t(-1));
+    std::map<const uint32_t*, uint32_t> seekDone;
+    // new offset of each input region already written
+    std::map<std::pair<uint32_t,uint32_t>, uint32_t> regions;
+    std::vector<uint32_t> written;  // entries whose data is written, in order
+    uint32_t waveLen = 0;
+    for(uint32_t k=0; k<count; ++k) {
+        uint32_t j = idx[k];
+        WAVEBANKENTRYINFO info;
+        int bad = GetWaveBankEntry(wb, j, &info, 0);
+        PrintWaveBankEntryErrors(&info);
+        if(bad || !info.data) {
+            printf("ERROR: reading entry %u\n", j);
+            return -1;
+        }
+        entries[k] = *info.entry;
+        auto key = std::make_pair(info.dwOffset, info.dwLength);
+        auto it = regions.find(key);
+        if(it == regions.end()) {
+            it = regions.insert(std::make_pair(key, waveLen)).first;
+            written.push_back(j);
+            waveLen = Align(waveLen + info.dwLength, bank.dwAlignment);
+        }
+        entries[k].PlayRegion.dwOffset = it->second;
+        map[j].streaming = streaming;
+        map[j].index = k;
+        map[j].offset = it->second;
+        if(!names.empty())
+            memcpy(&names[(size_t)k * bank.dwEntryNameElementSize], wb->entryNames + (size_t)j * bank.dwEntryNameElementSize, bank.dwEntryNameElementSize);
+        if(info.seekTable) {
+            auto s = seekDone.find(info.seekTable);
+            if(s == seekDone.end()) {
+                s = seekDone.insert(std::make_pair(info.seekTable, (uint32_t)(seek.size() - count) * 4)).first;
+                seek.insert(seek.end(), info.seekTable, info.seekTable + *info.seekTable + 1);
+            }
+            seek[k] = s->second;
+        }
+    }
+
+    // segments one after the other, the wave data on a DVD sector (XMA needs it, streaming too)
+    uint32_t pos = sizeof(header);
+    uint32_t lengths[WAVEBANK_SEGIDX_COUNT];
+    lengths[WAVEBANK_SEGIDX_BANKDATA] = sizeof(bank);
+    lengths[WAVEBANK_SEGIDX_ENTRYMETADATA] = count * sizeof(WAVEBANKENTRY);
+    lengths[WAVEBANK_SEGIDX_SEEKTABLES] = seek.size() * 4;
+    lengths[WAVEBANK_SEGIDX_ENTRYNAMES] = names.size();
+    lengths[WAVEBANK_SEGIDX_ENTRYWAVEDATA] = waveLen;
+    for(int s=0; s<WAVEBANK_SEGIDX_COUNT; ++s) {
+        if(s == WAVEBANK_SEGIDX_ENTRYWAVEDATA)
+            pos = Align(pos, WAVEBANK_DVD_SECTOR_SIZE);
+        header.Segments[s].dwOffset = pos;
+        header.Segments[s].dwLength = lengths[s];
+        pos += lengths[s];
+    }
+    uint32_t waveOffset = header.Segments[WAVEBANK_SEGIDX_ENTRYWAVEDATA].dwOffset;
+    std::vector<uint8_t> headers(waveOffset);
+    memcpy(&headers[0], &header, sizeof(header));
+    memcpy(&headers[header.Segments[WAVEBANK_SEGIDX_BANKDATA].dwOffset], &bank, sizeof(bank));
+    if(count)
+        memcpy(&headers[header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwOffset], entries.data(), count * sizeof(WAVEBANKENTRY));
+    if(!seek.empty())
+        memcpy(&headers[header.Segments[WAVEBANK_SEGIDX_SEEKTABLES].dwOffset], seek.data(), seek.size() * 4);
+    if(!names.empty())
+        memcpy(&headers[header.Segments[WAVEBANK_SEGIDX_ENTRYNAMES].dwOffset], names.data(), names.size());
+
+    char* tmpname;
+    int fd = CreateOutputFile(outfile, &tmpname);
+    if(fd<0)
+        return -2;
+    int ret = WriteOutputAt(fd, headers.data(), headers.size(), 0);
+    // straight from the mapping, the padding is left as a hole (zeros)
+    for(size_t k=0; !ret && k<written.size(); ++k) {
+        WAVEBANKENTRYINFO info;
+        GetWaveBankEntry(wb, written[k], &info, 0);
+        ret = WriteOutputAt(fd, info.data, info.dwLength, (uint64_t)waveOffset + map[written[k]].offset);
+    }
+    if(!ret && ftruncate(fd, (uint64_t)waveOffset + waveLen)) {
+        printf("ERROR: Cannot truncate %s\n", tmpname);
+        ret = -2;
+    }
+    if(ret) {
+        DiscardOutputFile(fd, tmpname);
+        return ret;
+    }
+    *waveBytes = waveLen;
+    if(verbose)
+        printf("  %s: %s bank \"%s\", %u entries, wave data %u bytes, alignment %u\n", outfile, streaming?"streaming":"in-memory",
+            bank.szBankName, count, waveLen, bank.dwAlignment);
+    return CommitOutputFile(fd, tmpname, outfile);
+}
+
+static int WriteRepackReport( const WaveBank* wb, const std::vector<REPACKED>& map, const char* memfile, const char* streamfile, const char* path )
+{
+    int tostdout = !strcmp(path, "-");
+    FILE* f = tostdout? stdout : fopen(path, "w");
+    if(!f) {
+        printf("ERROR: Cannot write the report to %s\n", path);
+        return -2;
+    }
+    fprintf(f, "entry\tname\tbank\tindex\toffset\tlength\tseconds\n");
+    for(uint32_t j=0; j<wb->bank.dwEntryCount; ++j) {
+        WAVEBANKENTRYINFO info;
+        GetWaveBankEntry(wb, j, &info, 0);
+        fprintf(f, "%u\t%s\t%s\t%u\t%u\t%u\t%.3f\n", j, info.name, map[j].streaming? streamfile : memfile,
+            map[j].index, map[j].offset, info.dwLength, info.seconds);
+    }
+    int ret = 0;
+    if(tostdout)
+        fflush(f);
+    else if(fclose(f)) {
+        printf("ERROR: Cannot write the report to %s\n", path);
+        ret = -2;
+    }
+    return ret;
+}
+
+extern "C" int rexwb_repack_bank( const char* infile, const char* memfile, const char* streamfile, const REXWB_OPTIONS* opt )
+{
+    if(SameOutput(memfile, streamfile)) {
+        printf("ERROR: The in-memory and the streaming banks would both be written to %s\n", streamfile);
+        return -2;
+    }
+    WaveBank wb;
+    if(OpenWaveBank(&wb, infile, opt->verbose))
+        return -1;
+    if(wb.bank.dwFlags & WAVEBANK_FLAGS_COMPACT) {
+        printf("ERROR: Compact banks cannot be repacked, %s is left as is\n", infile);
+        CloseWaveBank(&wb);
+        return -1;
+    }
+    if(wb.bank.dwFlags & WAVEBANK_TYPE_STREAMING) {
+        printf("ERROR: %s is already a streaming bank\n", infile);
+        CloseWaveBank(&wb);
+        return -1;
+    }
+
+    uint32_t count = wb.bank.dwEntryCount;
+    std::vector<uint32_t> inmemory, streamed;
+    for(uint32_t j=0; j<count; ++j) {
+        WAVEBANKENTRYINFO info;
+        GetWaveBankEntry(&wb, j, &info, 0);
+        if(StreamedEntry(&info, opt))
+            streamed.push_back(j);
+        else
+            inmemory.push_back(j);
+    }
+    if(streamed.empty())
+        printf("NOTE: No entry of %s is big enough to be streamed, %s is not written\n", infile, streamfile);
+
+    std::vector<REPACKED> map(count);
+    uint64_t memBytes = 0, streamBytes = 0;
+    char name[WAVEBANK_BANKNAME_LENGTH];
+    BankName(streamfile, name);
+    // the in-memory bank keeps its name, so the sound banks still find it
+    int ret = streamed.empty()? 0 : WriteRepackedBank(&wb, streamed, 1, streamfile, name, map, &streamBytes, opt->verbose);
+    if(!ret)
+        ret = WriteRepackedBank(&wb, inmemory, 0, memfile, NULL, map, &memBytes, opt->verbose);
+    if(!ret && opt->report)
+        ret = WriteRepackReport(&wb, map, memfile, streamfile, opt->report);
+    if(!ret && opt->verbose)
+        printf("%s: %u entries, %zu in memory (%llu bytes), %zu streamed (%llu bytes)\n", infile, count,
+            inmemory.size(), (unsigned long long)memBytes, streamed.size(), (unsigned long long)streamBytes);
+    CloseWaveBank(&wb);
+    return ret;
+}
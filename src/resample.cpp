@@ -0,0 +1,505 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <vector>
+#include <map>
+#include <mutex>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RESAMPLE_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RESAMPLE_NEON
+#endif
+
+#include "resample.h"
+
+// Phases above that are not stored, the 2 nearest ones are interpolated
+#define RESAMPLE_MAXPHASES  1024
+
+typedef struct {
+    int         zeros;      // zero crossings of the sinc on each side
+    float       cutoff;     // fraction of the lowest Nyquist frequency kept
+    float       beta;       // kaiser window
+} RESAMPLEPRESET;
+
+static constexpr RESAMPLEPRESET presets[] = {
+    {  4, 0.80f,  5.0f },   // RESAMPLE_QUICK
+    {  8, 0.88f,  7.0f },   // RESAMPLE_MEDIUM
+    { 16, 0.93f,  9.0f },   // RESAMPLE_HIGH
+    { 32, 0.96f, 11.0f },   // RESAMPLE_VERYHIGH
+};
+
+// Resample nout frames of one channel, starting at phase p0: x is the first input sample used, out is interleaved
+typedef void (*RESAMPLECHANNEL)( const RESAMPLER* rs, const float* x, uint32_t p0, uint32_t nout, int16_t* out, uint32_t chans );
+
+struct RESAMPLER {
+    uint32_t            L, M;       // output frame n is at input position n*M/L
+    uint32_t            phases;     // stored phases (L, or RESAMPLE_MAXPHASES+1 with interpolation)
+    int                 interp;
+    uint32_t            taps;       // per phase, multiple of 8
+    std::vector<float>  coefs;      // phases*taps
+    RESAMPLECHANNEL     kernel;
+};
+
+static uint32_t gcd( uint32_t a, uint32_t b )
+{
+    while(b) {
+        uint32_t t = a%b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// constexpr math, so the tables of the specialized kernels are built at compile time
+// with the very same code as the runtime ones
+static constexpr double cpi = 3.14159265358979323846;
+
+static constexpr double CSin( double x )
+{
+    while(x > cpi) x -= 2*cpi;
+    while(x < -cpi) x += 2*cpi;
+    double term = x, sum = x;
+    for(int k=1; k<24; ++k) {
+        term *= -x*x / ((2*k)*(2*k+1));
+        sum += term;
+    }
+    return sum;
+}
+
+static constexpr double CSqrt( double x )
+{
+    if(x <= 0)
+        return 0;
+    double r = (x > 1)? x : 1;
+    for(int i=0; i<64; ++i)
+        r = 0.5*(r + x/r);
+    return r;
+}
+
+static constexpr double BesselI0( double x )
+{
+    double sum = 1.0, term = 1.0;
+    for(int k=1; k<64; ++k) {
+        term *= (x/(2*k)) * (x/(2*k));
+        sum += term;
+        if(term < sum*1e-12)
+            break;
+    }
+    return sum;
+}
+
+// Taps per phase, for a cutoff relative to the input Nyquist
+static constexpr uint32_t FilterTaps( int zeros, double cutoff )
+{
+    double t = 2*zeros/cutoff;
+    uint32_t taps = (uint32_t)t;
+    if(taps < t)
+        ++taps;
+    return (taps+7)&~7u;
+}
+
+// Fill one phase: taps coefficients for an output at frac (0..1) after the input sample taps/2-1
+static constexpr void BuildPhase( float* h, uint32_t taps, double frac, double cutoff, double beta )
+{
+    double half = taps/2;
+    double i0beta = BesselI0(beta);
+    double sum = 0;
+    for(uint32_t k=0; k<taps; ++k) {
+        double u = frac + half - 1 - k;
+        double w = u/half;
+        double v = 0;
+        if(w > -1.0 && w < 1.0) {
+            double x = cpi * cutoff * u;
+            v = cutoff * ((x==0)? 1.0 : CSin(x)/x) * BesselI0(beta*CSqrt(1.0 - w*w)) / i0beta;
+        }
+        h[k] = v;
+        sum += v;
+    }
+    // unity gain on DC
+    if(sum != 0)
+        for(uint32_t k=0; k<taps; ++k)
+            h[k] /= sum;
+}
+
+typedef float (*DOTFUNC)( const float* a, const float* b, uint32_t n );
+
+static float DotScalar( const float* a, const float* b, uint32_t n )
+{
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for(uint32_t i=0; i<n; i+=4) {
+        s0 += a[i]*b[i];
+        s1 += a[i+1]*b[i+1];
+        s2 += a[i+2]*b[i+2];
+        s3 += a[i+3]*b[i+3];
+    }
+    return (s0+s1)+(s2+s3);
+}
+
+#ifdef RESAMPLE_X86
+static float DotSSE( const float* a, const float* b, uint32_t n )
+{
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    for(uint32_t i=0; i<n; i+=8) {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a+i+4), _mm_loadu_ps(b+i+4)));
+    }
+    s0 = _mm_add_ps(s0, s1);
+    s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+    s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 1));
+    return _mm_cvtss_f32(s0);
+}
+
+__attribute__((target("avx2,fma")))
+static float DotAVX2( const float* a, const float* b, uint32_t n )
+{
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    uint32_t i = 0;
+    for(; i+16<=n; i+=16) {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i), s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a+i+8), _mm256_loadu_ps(b+i+8), s1);
+    }
+    if(i<n)
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i), s0);
+    s0 = _mm256_add_ps(s0, s1);
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+#endif
+
+#ifdef RESAMPLE_NEON
+static float DotNEON( const float* a, const float* b, uint32_t n )
+{
+    float32x4_t s0 = vdupq_n_f32(0), s1 = vdupq_n_f32(0);
+    for(uint32_t i=0; i<n; i+=8) {
+        s0 = vmlaq_f32(s0, vld1q_f32(a+i), vld1q_f32(b+i));
+        s1 = vmlaq_f32(s1, vld1q_f32(a+i+4), vld1q_f32(b+i+4));
+    }
+    s0 = vaddq_f32(s0, s1);
+    float32x2_t s = vadd_f32(vget_low_f32(s0), vget_high_f32(s0));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+}
+#endif
+
+static DOTFUNC GetDotKernel( void )
+{
+#ifdef RESAMPLE_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return DotAVX2;
+    return DotSSE;
+#elif defined(RESAMPLE_NEON)
+    return DotNEON;
+#else
+    return DotScalar;
+#endif
+}
+
+static inline int16_t ToS16( float v )
+{
+    int s = lrintf(v);
+    if(s > 0x7fff) s = 0x7fff;
+    else if(s < -0x8000) s = -0x8000;
+    return s;
+}
+
+// Generic path, any ratio
+static void ResampleChannel( const RESAMPLER* rs, const float* x, uint32_t p0, uint32_t nout, int16_t* out, uint32_t chans )
+{
+    static DOTFUNC dot = GetDotKernel();
+    (void)DotScalar;
+
+    uint32_t taps = rs->taps;
+    const float* coefs = rs->coefs.data();
+    // input position i + p/L of output n, stepped by M/L
+    uint32_t i = 0, p = p0;
+    uint32_t di = rs->M / rs->L, dp = rs->M % rs->L;
+    for(uint32_t n=0; n<nout; ++n, i+=di, p+=dp) {
+        if(p >= rs->L) {
+            p -= rs->L;
+            ++i;
+        }
+        const float* xi = x + i;
+        float v;
+        if(rs->interp) {
+            double fp = (double)p * RESAMPLE_MAXPHASES / rs->L;
+            uint32_t p0 = (uint32_t)fp;
+            float f = fp - p0;
+            float v0 = dot(xi, coefs + (size_t)p0*taps, taps);
+            float v1 = dot(xi, coefs + (size_t)(p0+1)*taps, taps);
+            v = v0 + f*(v1-v0);
+        } else
+            v = dot(xi, coefs + (size_t)p*taps, taps);
+        out[n*chans] = ToS16(v);
+    }
+}
+
+// Integer decimation by D (44100->22050, 44100->11025, 48000->24000, 22050->11025...):
+// a single phase, known at compile time with its number of taps, so the dot product is fully unrolled
+template<int D, int Q>
+struct DECIMFILTER {
+    static constexpr double cutoff = (double)presets[Q].cutoff / D;
+    static constexpr uint32_t taps = FilterTaps(presets[Q].zeros, cutoff);
+    float h[taps];
+    constexpr DECIMFILTER() : h() { BuildPhase(h, taps, 0.0, cutoff, presets[Q].beta); }
+};
+
+template<uint32_t N>
+static inline float DotN( const float* a, const float* b )
+{
+#ifdef RESAMPLE_X86
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    for(uint32_t i=0; i<N; i+=8) {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a+i+4), _mm_loadu_ps(b+i+4)));
+    }
+    s0 = _mm_add_ps(s0, s1);
+    s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+    s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 1));
+    return _mm_cvtss_f32(s0);
+#elif defined(RESAMPLE_NEON)
+    return DotNEON(a, b, N);
+#else
+    return DotScalar(a, b, N);
+#endif
+}
+
+template<int D, int Q>
+static void DecimateChannel( const RESAMPLER* rs, const float* x, uint32_t p0, uint32_t nout, int16_t* out, uint32_t chans )
+{
+    static constexpr DECIMFILTER<D,Q> f;
+    (void)rs; (void)p0;
+    for(uint32_t n=0; n<nout; ++n)
+        out[n*chans] = ToS16(DotN<DECIMFILTER<D,Q>::taps>(x + n*D, f.h));
+}
+
+#ifdef RESAMPLE_X86
+template<uint32_t N>
+__attribute__((target("avx2,fma")))
+static inline float DotNAVX2( const float* a, const float* b )
+{
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    uint32_t i = 0;
+    for(; i+16<=N; i+=16) {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i), s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a+i+8), _mm256_loadu_ps(b+i+8), s1);
+    }
+    if(i<N)
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i), s0);
+    s0 = _mm256_add_ps(s0, s1);
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+template<int D, int Q>
+__attribute__((target("avx2,fma")))
+static void DecimateChannelAVX2( const RESAMPLER* rs, const float* x, uint32_t p0, uint32_t nout, int16_t* out, uint32_t chans )
+{
+    static constexpr DECIMFILTER<D,Q> f;
+    (void)rs; (void)p0;
+    for(uint32_t n=0; n<nout; ++n)
+        out[n*chans] = ToS16(DotNAVX2<DECIMFILTER<D,Q>::taps>(x + n*D, f.h));
+}
+#endif
+
+template<int D>
+static RESAMPLECHANNEL GetDecimateKernel( int quality )
+{
+#ifdef RESAMPLE_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        switch(quality) {
+        case RESAMPLE_QUICK:    return DecimateChannelAVX2<D, RESAMPLE_QUICK>;
+        case RESAMPLE_MEDIUM:   return DecimateChannelAVX2<D, RESAMPLE_MEDIUM>;
+        case RESAMPLE_HIGH:     return DecimateChannelAVX2<D, RESAMPLE_HIGH>;
+        default:                return DecimateChannelAVX2<D, RESAMPLE_VERYHIGH>;
+        }
+#endif
+    switch(quality) {
+    case RESAMPLE_QUICK:    return DecimateChannel<D, RESAMPLE_QUICK>;
+    case RESAMPLE_MEDIUM:   return DecimateChannel<D, RESAMPLE_MEDIUM>;
+    case RESAMPLE_HIGH:     return DecimateChannel<D, RESAMPLE_HIGH>;
+    default:                return DecimateChannel<D, RESAMPLE_VERYHIGH>;
+    }
+}
+
+static RESAMPLECHANNEL GetChannelKernel( const RESAMPLER* rs, int quality )
+{
+    if(rs->L == 1 && rs->M == 2)
+        return GetDecimateKernel<2>(quality);
+    if(rs->L == 1 && rs->M == 4)
+        return GetDecimateKernel<4>(quality);
+    return ResampleChannel;
+}
+
+RESAMPLER* CreateResampler( int inrate, int outrate, int quality )
+{
+    if(inrate<=0 || outrate<=0)
+        return NULL;
+    if(quality<RESAMPLE_QUICK || quality>RESAMPLE_VERYHIGH)
+        quality = RESAMPLE_HIGH;
+    const RESAMPLEPRESET* pr = &presets[quality];
+
+    RESAMPLER* rs = new RESAMPLER;
+    uint32_t g = gcd(inrate, outrate);
+    rs->L = outrate/g;
+    rs->M = inrate/g;
+    // cutoff relative to the input Nyquist, the sinc gets wider when downsampling
+    double cutoff = pr->cutoff * ((outrate<inrate)? (double)outrate/inrate : 1.0);
+    rs->taps = FilterTaps(pr->zeros, cutoff);
+    rs->interp = (rs->L > RESAMPLE_MAXPHASES);
+    rs->phases = rs->interp? RESAMPLE_MAXPHASES+1 : rs->L;
+    uint32_t div = rs->interp? RESAMPLE_MAXPHASES : rs->L;
+    rs->coefs.resize((size_t)rs->phases*rs->taps);
+    for(uint32_t p=0; p<rs->phases; ++p)
+        BuildPhase(&rs->coefs[(size_t)p*rs->taps], rs->taps, (double)p/div, cutoff, pr->beta);
+    rs->kernel = GetChannelKernel(rs, quality);
+    return rs;
+}
+
+void FreeResampler( RESAMPLER* rs )
+{
+    delete rs;
+}
+
+float ResamplerCutoff( int quality )
+{
+    if(quality<RESAMPLE_QUICK || quality>RESAMPLE_VERYHIGH)
+        quality = RESAMPLE_HIGH;
+    return presets[quality].cutoff;
+}
+
+uint32_t ResampledLength( const RESAMPLER* rs, uint32_t frames )
+{
+    return ((uint64_t)frames*rs->L + rs->M/2) / rs->M;
+}
+
+uint32_t Resample( const RESAMPLER* rs, const int16_t* in, uint32_t frames, uint32_t chans, int16_t* out )
+{
+    uint32_t nout = ResampledLength(rs, frames);
+    uint32_t taps = rs->taps;
+    // one channel at a time, as float with taps zeros before and after
+    uint32_t pad = taps;
+    std::vector<float> buf(frames + 2*pad);
+    for(uint32_t ch=0; ch<chans; ++ch) {
+        for(uint32_t i=0; i<frames; ++i)
+            buf[pad+i] = in[i*chans+ch];
+        rs->kernel(rs, &buf[pad - taps/2 + 1], 0, nout, out+ch, chans);
+    }
+    return nout;
+}
+
+struct RESAMPLESTREAM {
+    const RESAMPLER*    rs;
+    uint32_t            chans;
+    uint32_t            frames;     // total input frames
+    uint32_t            nout;       // total output frames
+    uint32_t            received;
+    uint32_t            next;       // next output frame
+    int64_t             start;      // input frame of buf[ch][0], negative for the leading zeros
+    std::vector<float>  buf[8];
+    std::vector<int16_t> out;
+};
+
+RESAMPLESTREAM* CreateResampleStream( const RESAMPLER* rs, uint32_t chans, uint32_t frames )
+{
+    if(!chans || chans>8)
+        return NULL;
+    RESAMPLESTREAM* st = new RESAMPLESTREAM;
+    st->rs = rs;
+    st->chans = chans;
+    st->frames = frames;
+    st->nout = ResampledLength(rs, frames);
+    st->received = 0;
+    st->next = 0;
+    // same taps zeros before the input as Resample()
+    st->start = -(int64_t)rs->taps;
+    for(uint32_t ch=0; ch<chans; ++ch)
+        st->buf[ch].assign(rs->taps, 0.0f);
+    return st;
+}
+
+void FreeResampleStream( RESAMPLESTREAM* st )
+{
+    delete st;
+}
+
+uint32_t ResampleStreamPush( RESAMPLESTREAM* st, const int16_t* in, uint32_t count, const int16_t** out )
+{
+    const RESAMPLER* rs = st->rs;
+    uint32_t chans = st->chans;
+    uint32_t taps = rs->taps;
+    if(count > st->frames - st->received)
+        count = st->frames - st->received;
+    st->received += count;
+    for(uint32_t ch=0; ch<chans; ++ch) {
+        std::vector<float>& b = st->buf[ch];
+        size_t o = b.size();
+        // and the same taps zeros after the input
+        b.resize(o + count + ((st->received==st->frames)? taps : 0), 0.0f);
+        for(uint32_t i=0; i<count; ++i)
+            b[o+i] = in[i*chans+ch];
+    }
+    // outputs whose whole filter span is already there
+    int64_t end = st->start + (int64_t)st->buf[0].size() - taps/2;
+    uint32_t last = st->next;
+    if(end > 0) {
+        uint64_t n = ((uint64_t)end*rs->L + rs->M - 1) / rs->M;
+        last = (n > st->nout)? st->nout : (uint32_t)n;
+    }
+    if(last <= st->next) {
+        *out = NULL;
+        return 0;
+    }
+    uint32_t nout = last - st->next;
+    uint64_t pos = (uint64_t)st->next*rs->M;
+    int64_t i0 = pos / rs->L;
+    uint32_t p0 = pos % rs->L;
+    st->out.resize((size_t)nout*chans);
+    for(uint32_t ch=0; ch<chans; ++ch)
+        rs->kernel(rs, &st->buf[ch][i0 - taps/2 + 1 - st->start], p0, nout, &st->out[ch], chans);
+    st->next = last;
+    // drop what the next outputs won't use
+    int64_t keep = (int64_t)(((uint64_t)st->next*rs->M) / rs->L) - taps/2 + 1 - st->start;
+    if(keep > 0) {
+        for(uint32_t ch=0; ch<chans; ++ch)
+            st->buf[ch].erase(st->buf[ch].begin(), st->buf[ch].begin() + keep);
+        st->start += keep;
+    }
+    *out = st->out.data();
+    return nout;
+}
+
+// Shared resamplers, one per (input rate, output rate, quality), kept until FreeResamplers
+static std::mutex resamplers_lock;
+static std::map<uint64_t, RESAMPLER*> resamplers;
+
+const RESAMPLER* GetResampler( int inrate, int outrate, int quality )
+{
+    uint64_t key = ((uint64_t)(uint32_t)inrate<<32) | ((uint64_t)(uint32_t)outrate<<4) | (quality&0xf);
+    std::lock_guard<std::mutex> l(resamplers_lock);
+    auto it = resamplers.find(key);
+    if(it != resamplers.end())
+        return it->second;
+    RESAMPLER* rs = CreateResampler(inrate, outrate, quality);
+    if(rs)
+        resamplers[key] = rs;
+    return rs;
+}
+
+void FreeResamplers( void )
+{
+    std::lock_guard<std::mutex> l(resamplers_lock);
+    for(auto& it: resamplers)
+        FreeResampler(it.second);
+    resamplers.clear();
+}
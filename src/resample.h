@@ -0,0 +1,41 @@
+#ifndef _RESAMPLE_H_
+#define _RESAMPLE_H_
+
+#include <stdint.h>
+
+// Polyphase windowed-sinc resampler, for one (input rate, output rate) pair.
+// The filter table is read only once built, a RESAMPLER can be used by several threads at once.
+typedef struct RESAMPLER RESAMPLER;
+
+enum {
+    RESAMPLE_QUICK = 0,
+    RESAMPLE_MEDIUM,
+    RESAMPLE_HIGH,
+    RESAMPLE_VERYHIGH,
+};
+
+RESAMPLER* CreateResampler( int inrate, int outrate, int quality );
+void       FreeResampler( RESAMPLER* rs );
+// Highest frequency kept by a preset, as a fraction of the lower Nyquist frequency
+float      ResamplerCutoff( int quality );
+
+// Number of output frames for frames input frames
+uint32_t   ResampledLength( const RESAMPLER* rs, uint32_t frames );
+// Resample frames of interleaved 16bits PCM. out must hold ResampledLength() frames. Return the number of frames written
+uint32_t   Resample( const RESAMPLER* rs, const int16_t* in, uint32_t frames, uint32_t chans, int16_t* out );
+
+// Streaming resampling, for an input of frames frames pushed by pieces, with the same output as Resample()
+typedef struct RESAMPLESTREAM RESAMPLESTREAM;
+
+RESAMPLESTREAM* CreateResampleStream( const RESAMPLER* rs, uint32_t chans, uint32_t frames );
+void       FreeResampleStream( RESAMPLESTREAM* st );
+// Push count input frames (interleaved). *out points to the output frames now available, valid until the next push.
+// Return the number of output frames
+uint32_t   ResampleStreamPush( RESAMPLESTREAM* st, const int16_t* in, uint32_t count, const int16_t** out );
+
+// Resampler shared by every entry and bank with the same rates and quality, built on first use (thread safe).
+// Don't free it, FreeResamplers() frees them all
+const RESAMPLER* GetResampler( int inrate, int outrate, int quality );
+void       FreeResamplers( void );
+
+#endif //_RESAMPLE_H_
@@ -0,0 +1,646 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include <sox.h>
+
+#include "rexwb.h"
+#include "pool.h"
+#include "resample.h"
+#include "cache.h"
+#include "stats.h"
+#include "estimate.h"
+
+extern "C" int rexwb_init( int verbose )
+{
+    if(sox_init() != SOX_SUCCESS) {
+        printf("ERROR: Initializing SOX\n");
+        return -3;
+    }
+    if(!verbose)
+        sox_get_globals()->verbosity = 0;
+    return 0;
+}
+
+extern "C" void rexwb_quit( void )
+{
+    FreeResamplers();
+    sox_quit();
+}
+
+static int CopyWaveBank( const WaveBank* wb, const char* outfile )
+{
+    char* tmpname;
+    int fd = CreateOutputFile(outfile, &tmpname);
+    if(fd<0)
+        return -2;
+    if(WriteOutputAt(fd, wb->file.data, wb->file.size, 0)) {
+        DiscardOutputFile(fd, tmpname);
+        return -2;
+    }
+    return CommitOutputFile(fd, tmpname, outfile);
+}
+
+// Entries converted on the worker pool, committed in bank and index order by the writer
+struct BATCHJOB {
+    REXWB_OPTIONS               opt;
+    WORKERPOOL*                 pool;       // also encodes the MS ADPCM blocks of the entries
+    std::mutex                  lock;
+    std::condition_variable     cond;
+};
+
+struct ENTRYJOB {
+    BATCHJOB*           batch;
+    const WaveBank*     wb;
+    WAVEBANKENTRYINFO   info;
+    CONVERTEDENTRY      out;
+    size_t              workingSet;
+    int                 streamed;   // too big for memory, converted by pieces by the writer
+    int                 ret;
+    int                 done;
+};
+
+// One bank of a batch: opened when its first entry is scheduled, closed once its last entry is written
+struct BANKRUN {
+    const char*             infile;
+    const char*             outfile;
+    WaveBank                wb;
+    BANKWRITER              writer;
+    std::vector<ENTRYJOB>   jobs;
+    std::vector<uint32_t>   alias;      // first identical entry of each entry, itself if unique (empty without dedupe)
+    uint32_t                dups;       // entries pointing to an identical entry, and their wave data size
+    size_t                  dupBytes;
+    uint32_t                count;      // entries to convert (0 if the bank is just copied or can't be opened)
+    int                     opened;
+    int                     ret;
+    // for the statistics: opening and planning, copying or closing the bank (the entries are counted apart)
+    double                  start;
+    STAGETIMES              times;
+    uint64_t                waveIn;
+    uint64_t                waveOut;
+    uint64_t                fileIn;
+    uint32_t                entries;
+};
+
+// Entries needing more than budget bytes are converted by pieces (0: no cap)
+static size_t EntryBudget( const REXWB_OPTIONS* opt, int jobs )
+{
+    return ((size_t)opt->memlimit << 20) / (jobs<1?1:jobs);
+}
+
+static int SameEntry( const WaveBank* wb, const WAVEBANKENTRYINFO* a, const WAVEBANKENTRYINFO* b )
+{
+    if(a->Format.dwValue != b->Format.dwValue
+     || a->dwLength != b->dwLength
+     || a->entry->dwFlagsAndDuration != b->entry->dwFlagsAndDuration
+     || memcmp(&a->entry->LoopRegion, &b->entry->LoopRegion, sizeof(a->entry->LoopRegion)))
+        return 0;
+    // a was just hashed, b is anywhere before it
+    AdviseRange(&wb->file, b->data, b->dwLength, ADVISE_WILLNEED);
+    return !memcmp(a->data, b->data, a->dwLength);
+}
+
+// Entries with the same wave data, format, flags, duration and loop convert to the same thing:
+// only the first one is converted and written, the others point to its region
+static void FindDuplicateEntries( BANKRUN* run )
+{
+    const WaveBank* wb = &run->wb;
+    uint32_t count = wb->bank.dwEntryCount;
+    std::vector<WAVEBANKENTRYINFO> infos(count);
+    std::unordered_map<uint64_t, std::vector<uint32_t>> seen;
+    run->dups = 0;
+    run->dupBytes = 0;
+    run->alias.resize(count);
+    for( uint32_t j=0; j < count; ++j)
+    {
+        WAVEBANKENTRYINFO& info = infos[j];
+        run->alias[j] = j;
+        GetWaveBankEntry(wb, j, &info, 0);
+        if(!info.data || !info.entry || !info.dwLength)
+            continue;
+        std::vector<uint32_t>& same = seen[HashBytes(info.data, info.dwLength, info.Format.dwValue)];
+        for(uint32_t k : same)
+            if(SameEntry(wb, &info, &infos[k])) {
+                run->alias[j] = k;
+                ++run->dups;
+                run->dupBytes += info.dwLength;
+                break;
+            }
+        if(run->alias[j] == j)
+            same.push_back(j);
+    }
+}
+
+static void PrintDuplicateEntries( const BANKRUN* run )
+{
+    if(run->dups)
+        printf("  %u duplicate entries (%zu bytes of wave data) are converted once\n", run->dups, run->dupBytes);
+}
+
+// outfile is the input file itself (whatever the path used to get to it)
+static int SameFile( const WaveBank* wb, const char* outfile )
+{
+    struct stat in, out;
+    return !fstat(wb->file.fd, &in) && !stat(outfile, &out) && in.st_dev==out.st_dev && in.st_ino==out.st_ino;
+}
+
+// Open the bank and its writer. Banks that don't need converting are copied straight away.
+// showbank prints the bank details (entries details are printed by the writer if opt->verbose)
+static int OpenBankRun( BANKRUN* run, const REXWB_OPTIONS* opt, int showbank )
+{
+    run->opened = 1;
+    run->count = 0;
+    run->start = StageClock();
+    memset(&run->times, 0, sizeof(run->times));
+    int ret = OpenWaveBank(&run->wb, run->infile, showbank);
+    if(ret)
+        return run->ret = ret;
+    // the wave data is converted front to back, once
+    AdviseRange(&run->wb.file, run->wb.waveData, run->wb.waveLen, ADVISE_SEQUENTIAL);
+    run->fileIn = run->wb.file.size;
+    run->entries = run->wb.bank.dwEntryCount;
+    run->waveIn = run->waveOut = run->wb.waveLen;
+
+    int inplace = SameFile(&run->wb, run->outfile);
+    if ( !run->wb.bank.dwEntryCount )
+    {
+        // nothing to convert, the output is the bank as is
+        run->times.time[STAGE_READ] = StageClock() - run->start;
+        ret = inplace? 0 : CopyWaveBank(&run->wb, run->outfile);
+        run->times.time[STAGE_WRITE] = StageClock() - run->start - run->times.time[STAGE_READ];
+        CloseWaveBank(&run->wb);
+        return run->ret = ret;
+    }
+
+    const WaveBank& wb = run->wb;
+    // compact entries can't share a region, their length comes from the next entry offset
+    if(opt->dedupe && !( wb.bank.dwFlags & WAVEBANK_FLAGS_COMPACT ))
+    {
+        FindDuplicateEntries(run);
+        if(showbank)
+            PrintDuplicateEntries(run);
+    }
+
+    // layout of the output: the headers stay as they are, then the converted wave data (estimated, an upper bound).
+    // To rewrite the input in place, the output of the entries up to each entry must end before the input
+    // of all the entries after it, that are still to be read (and before its own input if converted by pieces)
+    uint32_t count = wb.bank.dwEntryCount;
+    std::vector<uint64_t> end(count);       // output end of entries 0..j, from the wave data start
+    std::vector<uint64_t> next(count+1);    // input start of the first entry in j.. (lowest offset)
+    next[count] = UINT64_MAX;
+    uint64_t total = 0;
+    size_t budget = EntryBudget(opt, opt->jobs);
+    for( uint32_t j=0; j < count; ++j)
+    {
+        WAVEBANKENTRYINFO info;
+        GetWaveBankEntry(&wb, j, &info, 0);
+        if(run->alias.empty() || run->alias[j]==j)
+            total += (EntryOutputSize(&wb, &info, opt) + wb.bank.dwAlignment - 1) / wb.bank.dwAlignment * wb.bank.dwAlignment;
+        end[j] = total;
+        next[j] = info.dwOffset;
+    }
+    for( uint32_t j=count; j--; )
+        next[j] = std::min(next[j], next[j+1]);
+    int compact = 1;
+    for( uint32_t j=0; j < count && compact; ++j)
+    {
+        WAVEBANKENTRYINFO info;
+        GetWaveBankEntry(&wb, j, &info, 0);
+        int streamed = budget && EntryWorkingSet(&wb, &info, opt) > budget;
+        compact = end[j] <= next[streamed? j : j+1];
+    }
+    run->times.time[STAGE_READ] = StageClock() - run->start;
+    if ( wb.bank.dwFlags & WAVEBANK_FLAGS_COMPACT )
+    {
+        // compact offsets are 21 bits in alignment units, the converted data has to fit
+        uint64_t limit = (uint64_t)WAVEBANK_MAX_COMPACT_DATA_SEGMENT_SIZE * wb.bank.dwAlignment;
+        if ( total > limit )
+        {
+            printf("WARNING: converted compact wavebank would need %llu bytes of wave data, more than the %llu a compact bank can address. The bank is copied unchanged\n",
+                (unsigned long long)total, (unsigned long long)limit);
+            double t = StageClock();
+            ret = inplace? 0 : CopyWaveBank(&run->wb, run->outfile);
+            run->times.time[STAGE_WRITE] = StageClock() - t;
+            CloseWaveBank(&run->wb);
+            return run->ret = ret;
+        }
+    }
+
+    if(inplace && opt->inplace && !compact)
+        printf("WARNING: %s cannot be converted in place (the converted data doesn't fit before the data still to read), using a temporary copy\n", run->infile);
+    if(inplace && opt->inplace && compact) {
+        if(opt->verbose)
+            printf("  Converting %s in place\n", run->infile);
+        ret = OpenBankWriterInPlace(&run->writer, &run->wb, run->outfile, opt->verbose);
+    } else {
+        // a temporary file renamed over the output, even when it is the input: the input stays mapped
+        ret = OpenBankWriter(&run->writer, &run->wb, run->outfile, opt->verbose);
+        if(!ret)
+            PreallocateBankWriter(&run->writer, wb.waveOffset + total);
+    }
+    if(ret) {
+        CloseWaveBank(&run->wb);
+        return run->ret = ret;
+    }
+    run->count = count;
+    return 0;
+}
+
+static int CloseBankRun( BANKRUN* run )
+{
+    if(!run->count)
+        return run->ret;
+    run->waveIn = run->writer.waveBytes;
+    run->waveOut = run->writer.newwaveBytes;
+    double t = StageClock();
+    if(!run->ret)
+        run->ret = CloseBankWriter(&run->writer);
+    else
+        AbortBankWriter(&run->writer);
+    run->times.time[STAGE_WRITE] += StageClock() - t;
+    CloseWaveBank(&run->wb);
+    std::vector<ENTRYJOB>().swap(run->jobs);
+    std::vector<uint32_t>().swap(run->alias);
+    run->count = 0;
+    return run->ret;
+}
+
+static void AddBankStats( RUNSTATS* stats, const BANKRUN* run )
+{
+    if(!stats)
+        return;
+    BANKSTAT b;
+    b.infile = run->infile;
+    b.outfile = run->outfile;
+    b.ret = run->ret;
+    b.entries = 0;
+    b.waveIn = b.waveOut = b.fileIn = b.fileOut = 0;
+    b.time = 0;
+    struct stat st;
+    if(run->opened && run->fileIn) {
+        b.entries = run->entries;
+        b.waveIn = run->waveIn;
+        b.waveOut = run->ret? 0 : run->waveOut;
+        b.fileIn = run->fileIn;
+        b.time = StageClock() - run->start;
+        if(!run->ret && !stat(run->outfile, &st))
+            b.fileOut = st.st_size;
+    }
+    StatsAddBank(stats, &b, &run->times);
+}
+
+// Entry just written: its conversion time (on a worker) and what the writer spent on it since before
+static void AddEntryStats( RUNSTATS* stats, const BANKRUN* run, const WAVEBANKENTRYINFO* info, const CONVERTEDENTRY* out, const STAGETIMES* before, int streamed, int alias )
+{
+    if(!stats || run->ret)
+        return;
+    STAGETIMES times;
+    DiffStageTimes(&times, &run->writer.times, before);
+    AddStageTimes(&times, &out->times);
+    StatsAddEntry(stats, run->infile, info, &times, alias? 0 : run->writer.entryLength,
+        !alias && (streamed || out->convert), out->cache!=NULL, alias);
+}
+
+static void ConvertEntryJob( void* arg )
+{
+    ENTRYJOB* job = (ENTRYJOB*)arg;
+    BATCHJOB* batch = job->batch;
+    job->ret = ConvertEntry(job->wb, &job->info, &batch->opt, batch->pool, &job->out);
+    {
+        std::lock_guard<std::mutex> l(batch->lock);
+        job->done = 1;
+    }
+    batch->cond.notify_all();
+}
+
+static void PrintProgress( const REXWB_OPTIONS* opt, int bank, int nbanks, uint32_t j, uint32_t count )
+{
+    if(opt->percentage)
+        printf("%d\n", (int)(((uint64_t)bank*100*count + (uint64_t)j*100) / ((uint64_t)nbanks*count)));
+}
+
+// All the banks share one pool. Entries are scheduled across banks, so the next bank
+// is already being converted while the last entries of the current one finish
+static int ConvertBanksParallel( BANKRUN* runs, int nruns, const REXWB_OPTIONS* opt, RUNSTATS* stats )
+{
+    WORKERPOOL* pool = CreateWorkerPool(opt->jobs);
+    // don't let the workers run too far ahead of the writer, converted entries wait in memory
+    uint32_t window = 4 * WorkerPoolSize(pool);
+
+    BATCHJOB batch;
+    batch.opt = *opt;
+    batch.opt.verbose = 0;  // entry details are printed in order by the writer
+    batch.pool = pool;
+    // with a memory cap, each worker (and the writer for streamed entries) gets its share,
+    // and converted entries waiting for the writer must fit in the cap too
+    size_t budget = EntryBudget(opt, WorkerPoolSize(pool));
+    size_t cap = (size_t)opt->memlimit << 20;
+    size_t inflight = 0;
+    REXWB_OPTIONS streamopt = *opt;
+    streamopt.memlimit = (int)(budget >> 20);
+    if(opt->memlimit && !streamopt.memlimit)
+        streamopt.memlimit = 1;
+
+    int ret = 0;
+    int sb = 0;                 // submission cursor: bank and entry
+    uint32_t sj = 0;
+    uint32_t pending = 0;       // submitted and not written yet
+    for( int b=0; b < nruns; ++b)
+    {
+        BANKRUN* run = &runs[b];
+        int shown = 0;
+        for( uint32_t j=0; ; ++j)
+        {
+            while(pending<window && sb<nruns) {
+                BANKRUN* s = &runs[sb];
+                if(!s->opened) {
+                    // opened ahead of the writer: the bank details are printed when the writer gets to it
+                    OpenBankRun(s, opt, 0);
+                    s->jobs.resize(s->count);
+                }
+                if(sj>=s->count) {
+                    ++sb;
+                    sj = 0;
+                    continue;
+                }
+                ENTRYJOB& job = s->jobs[sj];
+                job.batch = &batch;
+                job.wb = &s->wb;
+                job.ret = 0;
+                job.done = 0;
+                GetWaveBankEntry(&s->wb, sj, &job.info, 0);
+                job.workingSet = EntryWorkingSet(&s->wb, &job.info, opt);
+                job.streamed = (budget && job.workingSet > budget);
+                int alias = !s->alias.empty() && s->alias[sj]!=sj;
+                if(job.streamed || alias || s->ret) {
+                    // nothing to convert ahead (or the bank failed, its entries are dropped)
+                    memset(&job.out, 0, sizeof(job.out));
+                    job.workingSet = 0;
+                    job.done = 1;
+                } else {
+                    if(cap && pending && inflight + job.workingSet > cap)
+                        break;  // wait for the writer to catch up
+                    inflight += job.workingSet;
+                    SubmitWork(pool, ConvertEntryJob, &job);
+                }
+                ++sj;
+                ++pending;
+            }
+            if(opt->verbose && !shown) {
+                if(nruns>1)
+                    printf("Bank %s -> %s\n", run->infile, run->outfile);
+                if(run->count) {
+                    PrintWaveBankHeader(&run->wb, run->infile);
+                    PrintDuplicateEntries(run);
+                }
+                shown = 1;
+            }
+            if(j>=run->count)
+                break;
+
+            ENTRYJOB& job = run->jobs[j];
+            {
+                std::unique_lock<std::mutex> l(batch.lock);
+                while(!job.done)
+                    batch.cond.wait(l);
+            }
+            --pending;
+            inflight -= job.workingSet;
+
+            PrintProgress(opt, b, nruns, j, run->count);
+            {
+                WAVEBANKENTRYINFO info;
+                GetWaveBankEntry(&run->wb, j, &info, opt->verbose);
+                PrintWaveBankEntryErrors(&info);
+            }
+
+            // after an error, the remaining entries of the bank are only dropped
+            if(!run->ret)
+                run->ret = job.ret;
+            int alias = !run->alias.empty() && run->alias[j]!=j;
+            STAGETIMES before = run->writer.times;
+            if(run->ret)
+                ;
+            else if(alias)
+                run->ret = WriteBankEntryAlias(&run->writer, &job.info, run->alias[j]);
+            else if(job.streamed)
+                run->ret = ConvertEntryStreamed(&run->wb, &job.info, &streamopt, pool, &run->writer);
+            else
+                run->ret = WriteBankEntry(&run->writer, &job.info, &job.out);
+            AddEntryStats(stats, run, &job.info, &job.out, &before, job.streamed, alias);
+            FreeConvertedEntry(&job.out);
+        }
+        if(CloseBankRun(run))
+            ret = run->ret;
+        AddBankStats(stats, run);
+    }
+
+    DestroyWorkerPool(pool);
+    return ret;
+}
+
+static int ConvertBankSerial( BANKRUN* run, int bank, int nbanks, const REXWB_OPTIONS* opt, RUNSTATS* stats )
+{
+    if(OpenBankRun(run, opt, opt->verbose)) {
+        AddBankStats(stats, run);
+        return run->ret;
+    }
+    for( uint32_t j=0; j < run->count && !run->ret; ++j)
+    {
+        PrintProgress(opt, bank, nbanks, j, run->count);
+
+        WAVEBANKENTRYINFO info;
+        CONVERTEDENTRY e;
+        memset(&e, 0, sizeof(e));
+        GetWaveBankEntry(&run->wb, j, &info, opt->verbose);
+        PrintWaveBankEntryErrors(&info);
+        STAGETIMES before = run->writer.times;
+        int alias = !run->alias.empty() && run->alias[j]!=j;
+        size_t budget = EntryBudget(opt, 1);
+        int streamed = !alias && budget && EntryWorkingSet(&run->wb, &info, opt) > budget;
+        if(alias)
+            run->ret = WriteBankEntryAlias(&run->writer, &info, run->alias[j]);
+        else if(streamed)
+            run->ret = ConvertEntryStreamed(&run->wb, &info, opt, NULL, &run->writer);
+        else {
+            run->ret = ConvertEntry(&run->wb, &info, opt, NULL, &e);
+            if(!run->ret)
+                run->ret = WriteBankEntry(&run->writer, &info, &e);
+        }
+        AddEntryStats(stats, run, &info, &e, &before, streamed, alias);
+        FreeConvertedEntry(&e);
+    }
+    int ret = CloseBankRun(run);
+    AddBankStats(stats, run);
+    return ret;
+}
+
+// Sizes and time of a conversion, for the dry run
+typedef struct {
+    uint32_t    entries;
+    uint64_t    waveIn;
+    uint64_t    waveOut;
+    uint64_t    fileIn;
+    uint64_t    fileOut;
+    double      cost;       // cpu seconds
+} DRYRUNTOTAL;
+
+static void PrintDryRunTotal( const char* what, const DRYRUNTOTAL* total, const REXWB_OPTIONS* opt )
+{
+    int jobs = (opt->jobs>1)? opt->jobs : 1;
+    printf("%s: %u entries, wave data %llu -> %llu bytes, file %llu -> %llu bytes, about %.1fs of conversion",
+        what, total->entries, (unsigned long long)total->waveIn, (unsigned long long)total->waveOut,
+        (unsigned long long)total->fileIn, (unsigned long long)total->fileOut, total->cost);
+    if(jobs>1)
+        printf(" (%.1fs with -j %d)", total->cost / jobs, jobs);
+    printf("\n");
+}
+
+// Same planning as the conversion (duplicates, compact limit, lengths and alignment), but nothing is converted:
+// print the size of each converted entry and of the bank, and the time the conversion should take
+static int DryRunBank( const char* infile, const REXWB_OPTIONS* opt, COSTMODEL* model, DRYRUNTOTAL* all )
+{
+    BANKRUN run;
+    run.infile = infile;
+    int ret = OpenWaveBank(&run.wb, infile, opt->verbose);
+    if(ret)
+        return ret;
+    const WaveBank& wb = run.wb;
+    uint32_t count = wb.bank.dwEntryCount;
+    uint32_t alignment = wb.bank.dwAlignment? wb.bank.dwAlignment : 1;
+    if(opt->dedupe && !( wb.bank.dwFlags & WAVEBANK_FLAGS_COMPACT ))
+        FindDuplicateEntries(&run);
+
+    DRYRUNTOTAL total;
+    memset(&total, 0, sizeof(total));
+    total.entries = count;
+    total.fileIn = wb.file.size;
+    for( uint32_t j=0; j < count && !ret; ++j)
+    {
+        WAVEBANKENTRYINFO info;
+        GetWaveBankEntry(&wb, j, &info, 0);
+        PrintWaveBankEntryErrors(&info);
+        total.waveIn += info.dwLength;
+        if(!run.alias.empty() && run.alias[j]!=j) {
+            printf("  %u: %u bytes, same as entry %u\n", j, info.dwLength, run.alias[j]);
+            continue;
+        }
+        CONVERTEDENTRY out;
+        ENTRYWORK work;
+        ret = PredictEntry(&wb, &info, opt, &out, &work);
+        if(ret)
+            break;
+        double cost = EntryCost(model, &work);
+        total.waveOut += (out.length + alignment - 1) / alignment * alignment;
+        total.cost += cost;
+        printf("  %u:%s%s%s %u -> %u bytes", j, info.name[0]?" \"":"", info.name, info.name[0]?"\"":"", info.dwLength, out.length);
+        if(!out.convert)
+            printf(", copied\n");
+        else if(out.silence)
+            printf(", 1 sec of silence\n");
+        else
+            printf(", %u/%dHz -> %u/%dHz, %.3fs\n", work.frames, work.inrate, work.newframes, work.rate, cost);
+    }
+    if(!ret && ( wb.bank.dwFlags & WAVEBANK_FLAGS_COMPACT )
+      && total.waveOut > (uint64_t)WAVEBANK_MAX_COMPACT_DATA_SEGMENT_SIZE * alignment) {
+        printf("WARNING: converted compact wavebank would need %llu bytes of wave data, it would be copied unchanged\n", (unsigned long long)total.waveOut);
+        total.waveOut = total.waveIn;
+        total.cost = 0;
+    }
+    if(!ret) {
+        // the headers keep their size (the seek tables can only shrink)
+        total.fileOut = count? wb.waveOffset + total.waveOut : total.fileIn;
+        PrintDryRunTotal(infile, &total, opt);
+        all->entries += total.entries;
+        all->waveIn += total.waveIn;
+        all->waveOut += total.waveOut;
+        all->fileIn += total.fileIn;
+        all->fileOut += total.fileOut;
+        all->cost += total.cost;
+    }
+    CloseWaveBank(&run.wb);
+    return ret;
+}
+
+static int DryRunBanks( const char* const* infiles, int count, const REXWB_OPTIONS* opt )
+{
+    COSTMODEL model;
+    InitCostModel(&model, opt);
+    DRYRUNTOTAL all;
+    memset(&all, 0, sizeof(all));
+    int ret = 0;
+    for(int b=0; b<count; ++b)
+        if(DryRunBank(infiles[b], opt, &model, &all)) {
+            printf("ERROR: cannot estimate the conversion of %s\n", infiles[b]);
+            ret = -1;
+        }
+    if(count>1)
+        PrintDryRunTotal("All banks", &all, opt);
+    if(opt->quality == REXWB_QUALITY_SOX)
+        printf("The time is estimated for the built-in resampler, sox is slower\n");
+    return ret;
+}
+
+extern "C" int rexwb_convert_banks( const char* const* infiles, const char* const* outfiles, int count, const REXWB_OPTIONS* bankopt )
+{
+    REXWB_OPTIONS options = *bankopt;
+    const REXWB_OPTIONS* opt = &options;
+    if(opt->dryrun)
+        return DryRunBanks(infiles, count, opt);
+    // each bank is written to a temporary file renamed at the end, the last one would silently win
+    for(int b=1; b<count; ++b)
+        for(int c=0; c<b; ++c)
+            if(SameOutput(outfiles[b], outfiles[c])) {
+                printf("ERROR: %s and %s would both be written to %s\n", infiles[c], infiles[b], outfiles[b]);
+                return -2;
+            }
+    if(options.cachedir && CacheOpen(options.cachedir))
+        options.cachedir = NULL;
+
+    std::vector<BANKRUN> runs(count);
+    for(int b=0; b<count; ++b) {
+        runs[b].infile = infiles[b];
+        runs[b].outfile = outfiles[b];
+        runs[b].count = 0;
+        runs[b].opened = 0;
+        runs[b].ret = 0;
+        runs[b].dups = 0;
+        runs[b].fileIn = 0;
+    }
+
+    RUNSTATS runstats;
+    RUNSTATS* stats = opt->stats? &runstats : NULL;
+    if(stats)
+        StatsBegin(stats, opt);
+
+    int ret = 0;
+    if(opt->jobs>1)
+        ret = ConvertBanksParallel(runs.data(), count, opt, stats);
+    else for(int b=0; b<count; ++b) {
+        if(count>1 && opt->verbose)
+            printf("Bank %s -> %s\n", infiles[b], outfiles[b]);
+        if(ConvertBankSerial(&runs[b], b, count, opt, stats))
+            ret = runs[b].ret;
+    }
+    if(count>1)
+        for(int b=0; b<count; ++b)
+            if(runs[b].ret)
+                printf("ERROR: converting %s failed (%d)\n", infiles[b], runs[b].ret);
+    if(stats && StatsWrite(stats, opt->stats) && !ret)
+        ret = -2;
+
+    return ret;
+}
+
+extern "C" int rexwb_convert_bank( const char* infile, const char* outfile, const REXWB_OPTIONS* opt )
+{
+    return rexwb_convert_banks(&infile, &outfile, 1, opt);
+}
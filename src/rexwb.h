@@ -0,0 +1,244 @@
+#ifndef _REXWB_H_
+#define _REXWB_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Resampler quality (REXWB_OPTIONS.quality)
+enum {
+    REXWB_QUALITY_DEFAULT = 0,      // high
+    REXWB_QUALITY_QUICK,
+    REXWB_QUALITY_MEDIUM,
+    REXWB_QUALITY_HIGH,
+    REXWB_QUALITY_VERYHIGH,
+    REXWB_QUALITY_SOX,              // sox "rate" effect, as older versions did
+};
+
+// Conversion parameters, shared by the C and the C++ API
+typedef struct {
+    int     rate;           // target sample rate
+    int     force;          // force MS ADPCM to PCM 16bits
+    int     mono;           // force mono on multi-channels ADPCM or PCM sounds
+    int     bits8;          // force PCM 8bits (implies force)
+    int     silent;         // replace sounds longer than silent sec with silence (0 to disable)
+    int     verbose;        // print bank and entries details
+    int     percentage;     // print a progression percentage per entry
+    int     jobs;           // worker threads: entries are converted in parallel, and the MS ADPCM blocks of an entry when some are idle (0 or 1: serial)
+    int     quality;        // resampler quality, REXWB_QUALITY_*
+    int     exhaustive;     // MS ADPCM encoder tries every predictor on each block (slower, like sox)
+    int     memlimit;       // working set cap in MB, bigger entries are converted by pieces (0: no cap)
+    const char* cachedir;   // directory of the conversion cache, reused across runs (NULL: no cache)
+    int     dedupe;         // entries with the same data and metadata share one region of the output (not for compact banks)
+    int     inplace;        // when the output is the input file, rewrite it in place when possible (no temporary copy, not crash safe)
+    const char* stats;      // write JSON statistics of the run (stage timings, bytes, peak memory) there at the end ("-": stdout, NULL: none)
+    int     slowest;        // number of slowest entries listed in the statistics (0: 10)
+    int     adaptive;       // choose the rate of each entry from its bandwidth, rate is then the highest one (never upsampled)
+    int     rates[16];      // adaptive rates to choose from, 0 terminated (empty: 8000, 11025, 16000, 22050, 32000, 44100, 48000)
+    int     bandloss;       // adaptive rate: energy that can be lost above the new band, in dB below the total (0: 30)
+    int     trimtail;       // drop the data after the loop end of the entries flagged REMOVELOOPTAIL
+    int     trimsilence;    // drop the leading and trailing silence of converted entries (not when their loop reaches it)
+    int     automono;       // mix to mono the multi-channels entries whose channels are alike (not for compact banks)
+    int     monodiff;       // automono: highest peak difference between the channels, on 16bits (0: identical channels only, -1: 256)
+    int     silencelevel;   // trimsilence: highest absolute 16bits sample value taken as silence (0 or less: digital silence only)
+    int     dryrun;         // only print the size and an estimate of the time of the conversion, nothing is converted or written
+    int     streamsize;     // rexwb_repack_bank: entries of streamsize KB or more go to the streaming bank (0: not by size)
+    int     streamseconds;  // rexwb_repack_bank: entries of streamseconds or more go to the streaming bank (0: not by duration, both 0: 10 sec)
+    const char* report;     // rexwb_repack_bank: write where each entry went there ("-": stdout, NULL: none)
+} REXWB_OPTIONS;
+
+#ifdef __cplusplus
+
+#include "xwb.h"
+#include "mapfile.h"
+#include "pool.h"
+
+// A wavebank opened for reading. All pointers are views inside the mapping.
+struct WaveBank {
+    MAPPEDFILE          file;
+    WAVEBANKHEADER      header;
+    WAVEBANKDATA        bank;
+    const uint8_t*      entries;        // WAVEBANKENTRY or WAVEBANKENTRYCOMPACT, see bank.dwFlags
+    uint32_t            metadataBytes;
+    const char*         entryNames;     // NULL if the bank has no names
+    const uint32_t*     seekTables;     // NULL if the bank has no seek tables
+    uint32_t            seekLen;
+    uint32_t            waveOffset;
+    const uint8_t*      waveData;
+    size_t              waveLen;
+};
+
+// Stages of the conversion timed for the statistics
+enum {
+    STAGE_READ = 0,     // bank parsing, duplicates search, cache lookups
+    STAGE_HEADER,       // RIFF headers built for sox
+    STAGE_DECODE,       // to 16bits PCM (the mapped data is read from disk there), mono downmix
+    STAGE_RESAMPLE,
+    STAGE_ENCODE,       // MS ADPCM encoding or PCM storing
+    STAGE_WRITE,        // wave data, headers and sync
+    STAGE_PAD,          // alignment padding
+    STAGE_COUNT
+};
+
+// Seconds spent in each stage
+typedef struct {
+    double      time[STAGE_COUNT];
+} STAGETIMES;
+
+// Monotonic clock, in seconds
+double StageClock( void );
+
+// Problems found in an entry by GetWaveBankEntry(), printed by PrintWaveBankEntryErrors()
+enum {
+    ENTRYERROR_SEEKOFFSET   = 1<<0,     // invalid seek table offset
+    ENTRYERROR_SEEKSIZE     = 1<<1,     // seek table past the end of its segment
+    ENTRYERROR_NOLENGTH     = 1<<2,
+    ENTRYERROR_REGION       = 1<<3,     // wave data region outside the segment
+    ENTRYERROR_ALIGNMENT    = 1<<4,
+    ENTRYERROR_XMAALIGNMENT = 1<<5,
+    ENTRYERROR_NOSEEKTABLE  = 1<<6,     // xWMA or XMA without its seek table
+};
+
+// One entry of a wavebank, compact or not, with its format and data resolved
+typedef struct {
+    uint32_t                index;
+    uint32_t                dwOffset;       // in wave data segment
+    uint32_t                dwLength;
+    uint32_t                Duration;       // from metadata (0 for compact banks)
+    uint32_t                DurationCompact;// estimated from length
+    float                   seconds;
+    MINIWAVEFORMAT          Format;
+    const WAVEBANKENTRY*    entry;          // NULL for compact banks
+    const uint32_t*         seekTable;      // NULL if none
+    const uint8_t*          data;           // wave data inside the mapping, NULL if the region is invalid
+    uint32_t                errors;         // ENTRYERROR_ flags
+    char                    name[WAVEBANK_ENTRYNAME_LENGTH];
+} WAVEBANKENTRYINFO;
+
+// Result of the conversion of one entry
+typedef struct {
+    int                     convert;        // 0 if the entry is copied as is
+    int                     silence;        // entry replaced by silence
+    const uint8_t*          data;           // data to write (inside buffer, or the input mapping)
+    uint32_t                length;
+    void*                   buffer;         // owned buffer, if any
+    MAPPEDFILE*             cache;          // owned mapping of the cache file holding data, if any
+    MINIWAVEFORMAT          Format;
+    uint32_t                Duration;
+    WAVEBANKSAMPLEREGION    LoopRegion;
+    STAGETIMES              times;          // spent converting it
+} CONVERTEDENTRY;
+
+// Output files are written to a temporary file next to them, and renamed once complete and synced
+int  CreateOutputFile( const char* outfile, char** tmpname );
+int  WriteOutputAt( int fd, const void* data, size_t length, uint64_t offset );
+int  CommitOutputFile( int fd, char* tmpname, const char* outfile );
+void DiscardOutputFile( int fd, char* tmpname );
+// Two output names for the same file (same name, or both existing and linked): the last rename would silently win
+int  SameOutput( const char* a, const char* b );
+
+#define BANKWRITER_BUFFER   (4<<20)
+
+// Output wavebank, entries have to be written in index order.
+// Only the wave data is written while converting, everything before it is written once on close
+typedef struct {
+    int                 fd;             // temporary file (or the input file itself)
+    char*               tmpname;        // NULL when writing in place
+    int                 inplace;
+    char*               outfile;
+    uint8_t*            buffer;         // wave data not written yet
+    uint32_t            buffered;
+    uint64_t            pos;            // file offset of the next wave data byte
+    const WaveBank*     wb;
+    WAVEBANKHEADER      header;
+    WAVEBANKDATA        bank;           // CompactFormat is updated by converted compact entries
+    uint8_t*            entries;
+    const uint32_t**    seekTables;     // seek table kept for each entry, NULL if none or converted (banks with seek tables only)
+    int                 verbose;
+    int                 hasxma;
+    size_t              waveBytes;
+    size_t              newwaveBytes;
+    uint32_t            entryOffset;    // entry being written
+    uint32_t            entryLength;
+    STAGETIMES          times;          // spent writing and padding, and converting the entries written by pieces
+} BANKWRITER;
+
+uint32_t GetDuration( uint32_t length, const MINIWAVEFORMAT* miniFmt, const uint32_t* seekTable );
+
+int  OpenWaveBank( WaveBank* wb, const char* filename, int verbose );
+void CloseWaveBank( WaveBank* wb );
+// What OpenWaveBank() prints when verbose, from an opened bank
+void PrintWaveBankHeader( const WaveBank* wb, const char* infile );
+// Resolve entry j. Problems are only flagged in info->errors, the caller prints them once
+int  GetWaveBankEntry( const WaveBank* wb, uint32_t j, WAVEBANKENTRYINFO* info, int verbose );
+void PrintWaveBankEntryErrors( const WAVEBANKENTRYINFO* info );
+
+// RIFF header (WAVHEADER_SIMPLE or WAVHEADER_ADPCM) for dwLength bytes of miniFmt data. Return the header size
+size_t BuildWavHeader( const MINIWAVEFORMAT* miniFmt, uint32_t dwLength, uint8_t* wavhead );
+// The MS ADPCM blocks of the entry are shared with the idle workers of pool (NULL: all on the calling thread)
+int  ConvertEntry( const WaveBank* wb, const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt, WORKERPOOL* pool, CONVERTEDENTRY* out );
+void FreeConvertedEntry( CONVERTEDENTRY* out );
+// Size of the entry once converted (estimate, up to a block)
+size_t EntryOutputSize( const WaveBank* wb, const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt );
+// Memory ConvertEntry needs for that entry
+size_t EntryWorkingSet( const WaveBank* wb, const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt );
+// Work needed to convert an entry, for the time estimate of a dry run
+typedef struct {
+    int         adpcm_in;
+    int         adpcm_out;
+    uint32_t    frames;         // decoded (0 if the entry is not converted)
+    uint32_t    chans;
+    uint32_t    newframes;      // resampled
+    uint32_t    newchannels;
+    int         inrate;
+    int         rate;
+    int         quality;        // RESAMPLE_* preset, -1 for sox
+} ENTRYWORK;
+// Format, length, duration and loop ConvertEntry would give (out->data stays NULL), without converting anything.
+// Exact with the built-in resampler, close with sox
+int  PredictEntry( const WaveBank* wb, const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt, CONVERTEDENTRY* out, ENTRYWORK* work );
+// Convert and write an entry by pieces, within opt->memlimit. Same output as ConvertEntry + WriteBankEntry
+int  ConvertEntryStreamed( const WaveBank* wb, const WAVEBANKENTRYINFO* info, const REXWB_OPTIONS* opt, WORKERPOOL* pool, BANKWRITER* w );
+
+int  OpenBankWriter( BANKWRITER* w, const WaveBank* wb, const char* outfile, int verbose );
+// Write over the input file itself. The caller makes sure the output never overwrites input data still to be read
+int  OpenBankWriterInPlace( BANKWRITER* w, const WaveBank* wb, const char* outfile, int verbose );
+// Reserve the space of the whole output (size is an estimate, the file is cut to its real size on close)
+void PreallocateBankWriter( BANKWRITER* w, uint64_t size );
+int  WriteBankEntry( BANKWRITER* w, const WAVEBANKENTRYINFO* info, const CONVERTEDENTRY* e );
+// Same, with the data written by pieces: e->data and e->length are not used by EndBankEntry
+int  BeginBankEntry( BANKWRITER* w );
+int  WriteBankEntryData( BANKWRITER* w, const void* data, uint32_t length );
+int  EndBankEntry( BANKWRITER* w, const WAVEBANKENTRYINFO* info, const CONVERTEDENTRY* e );
+// Entry identical to the already written entry first: point it to the same region, nothing is written
+int  WriteBankEntryAlias( BANKWRITER* w, const WAVEBANKENTRYINFO* info, uint32_t first );
+// Write the headers, then sync and rename the output. Return 0 on success
+int  CloseBankWriter( BANKWRITER* w );
+// Drop the output, an existing outfile is left untouched
+void AbortBankWriter( BANKWRITER* w );
+
+extern "C" {
+#endif
+
+// Initialize / shutdown the converter (sox), once per process
+int  rexwb_init( int verbose );
+void rexwb_quit( void );
+// Convert a whole bank. Return 0 on success
+int  rexwb_convert_bank( const char* infile, const char* outfile, const REXWB_OPTIONS* opt );
+// Convert count banks, infiles[i] to outfiles[i], sharing one worker pool: entries of the next banks
+// are converted while the last ones of a bank finish. A failed bank doesn't stop the others. Return 0 if all succeeded
+int  rexwb_convert_banks( const char* const* infiles, const char* const* outfiles, int count, const REXWB_OPTIONS* opt );
+// Split an in-memory bank, without converting anything: the long entries go to streamfile, a streaming bank aligned
+// on DVD sectors (not written if none is), the others to memfile (it can be infile, not streamfile). Entries get new
+// indices, see opt->report. Return 0 on success
+int  rexwb_repack_bank( const char* infile, const char* memfile, const char* streamfile, const REXWB_OPTIONS* opt );
+// Write one PCM or MS ADPCM entry, found by name or else by index, as a .wav file (the data as is). Return 0 on success
+int  rexwb_extract_entry( const char* infile, const char* entry, const char* outfile, const REXWB_OPTIONS* opt );
+// Write all the entries in outdir (created if needed), opt->jobs at a time, named after their index and name.
+// xWMA and XMA entries are skipped. Return 0 if none failed
+int  rexwb_extract_bank( const char* infile, const char* outdir, const REXWB_OPTIONS* opt );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_REXWB_H_
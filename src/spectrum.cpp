@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <complex>
+
+#include "spectrum.h"
+
+typedef std::complex<float> COMPLEX;
+
+#define SPECTRUM_BITS   11      // log2(SPECTRUM_SIZE)
+
+// Hann window, twiddles and bit reversal, built once
+typedef struct {
+    float       window[SPECTRUM_SIZE];
+    COMPLEX     twiddle[SPECTRUM_SIZE/2];
+    uint16_t    reverse[SPECTRUM_SIZE];
+} FFTTABLES;
+
+static const FFTTABLES* GetTables( void )
+{
+    static const FFTTABLES* tables = []() {
+        FFTTABLES* t = new FFTTABLES;
+        for(int i=0; i<SPECTRUM_SIZE; ++i) {
+            t->window[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / SPECTRUM_SIZE);
+            uint32_t r = 0;
+            for(int b=0; b<SPECTRUM_BITS; ++b)
+                r |= ((i >> b) & 1) << (SPECTRUM_BITS - 1 - b);
+            t->reverse[i] = r;
+        }
+        for(int i=0; i<SPECTRUM_SIZE/2; ++i)
+            t->twiddle[i] = std::polar(1.0f, -2.0f * (float)M_PI * i / SPECTRUM_SIZE);
+        return t;
+    }();
+    return tables;
+}
+
+// In place radix-2 FFT of SPECTRUM_SIZE points, input in bit reversed order
+static void FFT( COMPLEX* x, const FFTTABLES* t )
+{
+    for(uint32_t len=2; len<=SPECTRUM_SIZE; len<<=1) {
+        uint32_t half = len/2, step = SPECTRUM_SIZE/len;
+        for(uint32_t i=0; i<SPECTRUM_SIZE; i+=len)
+            for(uint32_t k=0; k<half; ++k) {
+                COMPLEX a = x[i+k];
+                COMPLEX b = x[i+k+half] * t->twiddle[k*step];
+                x[i+k] = a + b;
+                x[i+k+half] = a - b;
+            }
+    }
+}
+
+void SpectrumInit( SPECTRUM* sp )
+{
+    memset(sp, 0, sizeof(*sp));
+}
+
+void SpectrumAdd( SPECTRUM* sp, const int16_t* pcm, uint32_t frames, uint32_t chans )
+{
+    const FFTTABLES* t = GetTables();
+    COMPLEX x[SPECTRUM_SIZE];
+    if(frames > SPECTRUM_SIZE)
+        frames = SPECTRUM_SIZE;
+    for(uint32_t i=0; i<SPECTRUM_SIZE; ++i) {
+        float v = 0.0f;
+        if(i < frames) {
+            for(uint32_t c=0; c<chans; ++c)
+                v += pcm[(size_t)i*chans + c];
+            // a short sound gets a window of its own length, the cut would spread its spectrum
+            float win = (frames == SPECTRUM_SIZE)? t->window[i] : 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / frames);
+            v *= win / chans;
+        }
+        x[t->reverse[i]] = COMPLEX(v, 0.0f);
+    }
+    FFT(x, t);
+    for(uint32_t k=0; k<=SPECTRUM_SIZE/2; ++k)
+        sp->power[k] += std::norm(x[k]);
+    ++sp->windows;
+}
+
+double SpectrumEnergyAbove( const SPECTRUM* sp, int rate, double freq )
+{
+    double total = 0, above = 0;
+    double bin = freq * SPECTRUM_SIZE / rate;
+    for(uint32_t k=1; k<=SPECTRUM_SIZE/2; ++k) {
+        total += sp->power[k];
+        if(k > bin)
+            above += sp->power[k];
+    }
+    return (total > 0)? above / total : 0;
+}
@@ -0,0 +1,21 @@
+#ifndef _SPECTRUM_H_
+#define _SPECTRUM_H_
+
+#include <stdint.h>
+
+// Power spectrum of a sound averaged over windows of SPECTRUM_SIZE frames (Hann window, channels mixed),
+// for the bandwidth analysis of the adaptive rate
+#define SPECTRUM_SIZE   2048
+
+typedef struct {
+    double      power[SPECTRUM_SIZE/2 + 1];     // bin k is at k*rate/SPECTRUM_SIZE Hz
+    uint32_t    windows;
+} SPECTRUM;
+
+void   SpectrumInit( SPECTRUM* sp );
+// Add one window of up to SPECTRUM_SIZE frames of interleaved 16bits PCM (zero padded)
+void   SpectrumAdd( SPECTRUM* sp, const int16_t* pcm, uint32_t frames, uint32_t chans );
+// Share of the energy (DC left out) above freq Hz, for a sound sampled at rate. 0 for silence
+double SpectrumEnergyAbove( const SPECTRUM* sp, int rate, double freq );
+
+#endif //_SPECTRUM_H_
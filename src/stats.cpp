@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+
+#include "stats.h"
+
+static const char* stageNames[STAGE_COUNT] = {
+    "read", "header", "decode", "resample", "encode", "write", "pad"
+};
+
+double StageClock( void )
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void AddStageTimes( STAGETIMES* to, const STAGETIMES* from )
+{
+    for(int i=0; i<STAGE_COUNT; ++i)
+        to->time[i] += from->time[i];
+}
+
+void DiffStageTimes( STAGETIMES* to, const STAGETIMES* a, const STAGETIMES* b )
+{
+    for(int i=0; i<STAGE_COUNT; ++i)
+        to->time[i] = a->time[i] - b->time[i];
+}
+
+static double TotalTime( const STAGETIMES* times )
+{
+    double t = 0;
+    for(int i=0; i<STAGE_COUNT; ++i)
+        t += times->time[i];
+    return t;
+}
+
+static bool SlowerFirst( const ENTRYSTAT& a, const ENTRYSTAT& b )
+{
+    return a.time > b.time;
+}
+
+void StatsBegin( RUNSTATS* stats, const REXWB_OPTIONS* opt )
+{
+    stats->start = StageClock();
+    stats->jobs = (opt->jobs>1)? opt->jobs : 1;
+    stats->slowestCount = (opt->slowest>0)? opt->slowest : 10;
+    memset(&stats->stages, 0, sizeof(stats->stages));
+    stats->entries = 0;
+    stats->converted = 0;
+    stats->cached = 0;
+    stats->duplicates = 0;
+    stats->slowest.clear();
+    stats->banks.clear();
+}
+
+void StatsAddEntry( RUNSTATS* stats, const char* bank, const WAVEBANKENTRYINFO* info, const STAGETIMES* times, uint32_t outBytes, int converted, int cached, int duplicate )
+{
+    AddStageTimes(&stats->stages, times);
+    ++stats->entries;
+    stats->converted += converted;
+    stats->cached += cached;
+    stats->duplicates += duplicate;
+
+    // keep the slowest ones only: the heap top is the fastest of them
+    double t = TotalTime(times);
+    if(stats->slowest.size() >= stats->slowestCount) {
+        if(!stats->slowestCount || t <= stats->slowest.front().time)
+            return;
+        std::pop_heap(stats->slowest.begin(), stats->slowest.end(), SlowerFirst);
+        stats->slowest.pop_back();
+    }
+    ENTRYSTAT e;
+    e.bank = bank;
+    e.index = info->index;
+    e.name = info->name;
+    e.time = t;
+    e.times = *times;
+    e.inBytes = info->dwLength;
+    e.outBytes = outBytes;
+    stats->slowest.push_back(e);
+    std::push_heap(stats->slowest.begin(), stats->slowest.end(), SlowerFirst);
+}
+
+void StatsAddBank( RUNSTATS* stats, const BANKSTAT* bank, const STAGETIMES* times )
+{
+    AddStageTimes(&stats->stages, times);
+    stats->banks.push_back(*bank);
+}
+
+static void WriteString( FILE* f, const char* s )
+{
+    fputc('"', f);
+    for(; *s; ++s) {
+        unsigned char c = *s;
+        if(c=='"' || c=='\\')
+            fprintf(f, "\\%c", c);
+        else if(c<0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static void WriteStages( FILE* f, const STAGETIMES* times )
+{
+    fprintf(f, "{");
+    for(int i=0; i<STAGE_COUNT; ++i)
+        fprintf(f, "%s\"%s\": %.6f", i?", ":"", stageNames[i], times->time[i]);
+    fprintf(f, "}");
+}
+
+int StatsWrite( RUNSTATS* stats, const char* path )
+{
+    int tostdout = !strcmp(path, "-");
+    FILE* f = tostdout? stdout : fopen(path, "w");
+    if(!f) {
+        printf("ERROR: Cannot write statistics to %s\n", path);
+        return -2;
+    }
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    getrusage(RUSAGE_SELF, &usage);
+    uint64_t waveIn = 0, waveOut = 0, fileIn = 0, fileOut = 0;
+    for(auto& b : stats->banks) {
+        waveIn += b.waveIn;
+        waveOut += b.waveOut;
+        fileIn += b.fileIn;
+        fileOut += b.fileOut;
+    }
+    std::sort(stats->slowest.begin(), stats->slowest.end(), SlowerFirst);
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"seconds\": %.6f,\n", StageClock() - stats->start);
+    fprintf(f, "  \"jobs\": %d,\n", stats->jobs);
+    fprintf(f, "  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+    fprintf(f, "  \"entries\": {\"total\": %u, \"converted\": %u, \"from_cache\": %u, \"duplicates\": %u},\n",
+        stats->entries, stats->converted, stats->cached, stats->duplicates);
+    fprintf(f, "  \"bytes\": {\"wave_in\": %llu, \"wave_out\": %llu, \"file_in\": %llu, \"file_out\": %llu},\n",
+        (unsigned long long)waveIn, (unsigned long long)waveOut, (unsigned long long)fileIn, (unsigned long long)fileOut);
+    fprintf(f, "  \"stages\": ");
+    WriteStages(f, &stats->stages);
+    fprintf(f, ",\n  \"banks\": [");
+    for(size_t i=0; i<stats->banks.size(); ++i) {
+        const BANKSTAT& b = stats->banks[i];
+        fprintf(f, "%s\n    {\"input\": ", i?",":"");
+        WriteString(f, b.infile.c_str());
+        fprintf(f, ", \"output\": ");
+        WriteString(f, b.outfile.c_str());
+        fprintf(f, ", \"result\": %d, \"entries\": %u, \"seconds\": %.6f, \"wave_in\": %llu, \"wave_out\": %llu, \"file_in\": %llu, \"file_out\": %llu}",
+            b.ret, b.entries, b.time, (unsigned long long)b.waveIn, (unsigned long long)b.waveOut, (unsigned long long)b.fileIn, (unsigned long long)b.fileOut);
+    }
+    fprintf(f, "%s],\n  \"slowest\": [", stats->banks.empty()?"":"\n  ");
+    for(size_t i=0; i<stats->slowest.size(); ++i) {
+        const ENTRYSTAT& e = stats->slowest[i];
+        fprintf(f, "%s\n    {\"bank\": ", i?",":"");
+        WriteString(f, e.bank.c_str());
+        fprintf(f, ", \"index\": %u, \"name\": ", e.index);
+        WriteString(f, e.name.c_str());
+        fprintf(f, ", \"seconds\": %.6f, \"bytes_in\": %u, \"bytes_out\": %u, \"stages\": ", e.time, e.inBytes, e.outBytes);
+        WriteStages(f, &e.times);
+        fprintf(f, "}");
+    }
+    fprintf(f, "%s]\n}\n", stats->slowest.empty()?"":"\n  ");
+
+    int ret = 0;
+    if(tostdout)
+        fflush(f);
+    else if(fclose(f)) {
+        printf("ERROR: Cannot write statistics to %s\n", path);
+        ret = -2;
+    }
+    return ret;
+}
@@ -0,0 +1,58 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "rexwb.h"
+
+// Statistics of a run (--stats): where the time goes, bytes in and out, and the slowest entries.
+// Stage times are summed over the threads, they can add up to more than the run time with -j
+typedef struct {
+    std::string     bank;
+    uint32_t        index;
+    std::string     name;
+    double          time;
+    STAGETIMES      times;
+    uint32_t        inBytes;
+    uint32_t        outBytes;
+} ENTRYSTAT;
+
+typedef struct {
+    std::string     infile;
+    std::string     outfile;
+    uint32_t        entries;
+    uint64_t        waveIn;
+    uint64_t        waveOut;
+    uint64_t        fileIn;
+    uint64_t        fileOut;
+    double          time;           // from its opening to its output being committed
+    int             ret;
+} BANKSTAT;
+
+typedef struct {
+    double                  start;
+    int                     jobs;
+    size_t                  slowestCount;
+    STAGETIMES              stages;
+    uint32_t                entries;
+    uint32_t                converted;
+    uint32_t                cached;
+    uint32_t                duplicates;
+    std::vector<ENTRYSTAT>  slowest;    // min-heap on time while running, sorted slowest first by StatsWrite
+    std::vector<BANKSTAT>   banks;
+} RUNSTATS;
+
+void AddStageTimes( STAGETIMES* to, const STAGETIMES* from );
+// to = a - b
+void DiffStageTimes( STAGETIMES* to, const STAGETIMES* a, const STAGETIMES* b );
+
+void StatsBegin( RUNSTATS* stats, const REXWB_OPTIONS* opt );
+void StatsAddEntry( RUNSTATS* stats, const char* bank, const WAVEBANKENTRYINFO* info, const STAGETIMES* times, uint32_t outBytes, int converted, int cached, int duplicate );
+void StatsAddBank( RUNSTATS* stats, const BANKSTAT* bank, const STAGETIMES* times );
+// Write the JSON report to path ("-": stdout). Return 0 on success
+int  StatsWrite( RUNSTATS* stats, const char* path );
+
+#endif //_STATS_H_
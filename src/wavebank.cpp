@@ -0,0 +1,522 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "rexwb.h"
+
+uint32_t GetDuration( uint32_t length, const MINIWAVEFORMAT* miniFmt, const uint32_t* seekTable )
+{
+    switch( miniFmt->wFormatTag )
+    {
+    case MINIWAVEFORMAT::TAG_ADPCM:
+        {
+            uint32_t duration = ( length / miniFmt->BlockAlign() ) * miniFmt->AdpcmSamplesPerBlock();
+            uint32_t partial = length % miniFmt->BlockAlign();
+            if ( partial )
+            {
+                if ( partial >= ( 7 * miniFmt->nChannels ) )
+                    duration += ( partial * 2 / miniFmt->nChannels - 12 );
+            }
+            return duration;
+        }
+
+    case MINIWAVEFORMAT::TAG_WMA:
+        if ( seekTable )
+        {
+            uint32_t seekCount = *seekTable;
+            if ( seekCount > 0 )
+            {
+               return seekTable[ seekCount ] / uint32_t( 2 * miniFmt->nChannels );
+            }
+        }
+        return 0;
+
+    case MINIWAVEFORMAT::TAG_XMA:
+        if ( seekTable )
+        {
+            uint32_t seekCount = *seekTable;
+            if ( seekCount > 0 )
+            {
+               return seekTable[ seekCount ];
+            }
+        }
+        return 0;
+
+    default:
+        return ( length * 8 ) / ( miniFmt->BitsPerSample() * miniFmt->nChannels );
+    }
+}
+
+void PrintWaveBankHeader( const WaveBank* wb, const char* infile )
+{
+    const WAVEBANKHEADER& header = wb->header;
+    const WAVEBANKDATA& bank = wb->bank;
+    printf( "WAVEBANK - %s\n%s\nHeader: File version %u, Tool version %u\n\tBankData %u, length %u\n\tEntryMetadata %u, length %u\n\tSeekTables %u, length %u\n\tEntryNames %u, length %u\n\tEntryWaveData %u, length %u\n",
+        infile, "LittleEndian (Windows wave bank)",
+        header.dwHeaderVersion, header.dwVersion,
+        header.Segments[WAVEBANK_SEGIDX_BANKDATA].dwOffset, header.Segments[WAVEBANK_SEGIDX_BANKDATA].dwLength,
+        header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwOffset, header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwLength,
+        header.Segments[WAVEBANK_SEGIDX_SEEKTABLES].dwOffset, header.Segments[WAVEBANK_SEGIDX_SEEKTABLES].dwLength,
+        header.Segments[WAVEBANK_SEGIDX_ENTRYNAMES].dwOffset, header.Segments[WAVEBANK_SEGIDX_ENTRYNAMES].dwLength,
+        header.Segments[WAVEBANK_SEGIDX_ENTRYWAVEDATA].dwOffset, header.Segments[WAVEBANK_SEGIDX_ENTRYWAVEDATA].dwLength );
+
+    printf( "Bank Data:\n\tFlags %08X\n", bank.dwFlags );
+    printf( "\t\t%s\n", ( bank.dwFlags & WAVEBANK_TYPE_STREAMING ) ? "Streaming" : "In-memory" );
+    if ( bank.dwFlags & WAVEBANK_FLAGS_ENTRYNAMES )
+    {
+        printf( "\t\tFLAGS_ENTRYNAMES\n" );
+    }
+    if ( bank.dwFlags & WAVEBANK_FLAGS_COMPACT )
+    {
+        printf( "\t\tFLAGS_COMPACT\n" );
+
+        if ( !( bank.dwFlags & WAVEBANK_TYPE_STREAMING ) )
+        {
+            printf( "WARNING: XACT only supports streaming with compact wavebanks\n");
+        }
+    }
+    if ( bank.dwFlags & WAVEBANK_FLAGS_SYNC_DISABLED )
+    {
+        printf( "\t\tFLAGS_SYNC_DISABLED\n" );
+    }
+    if ( bank.dwFlags & WAVEBANK_FLAGS_SEEKTABLES )
+    {
+        printf( "\t\tFLAGS_SEEKTABLES\n" );
+    }
+    if ( *bank.szBankName )
+        printf( "\tName \"%s\"\n", bank.szBankName );
+
+    printf( "\tEntry metadata size %u\n\tEntry name element size %u\n\tEntry alignment %u\n",
+            bank.dwEntryMetaDataElementSize, bank.dwEntryNameElementSize, bank.dwAlignment );
+
+    if ( ( bank.dwAlignment < WAVEBANK_ALIGNMENT_MIN ) || ( bank.dwAlignment > WAVEBANK_ALIGNMENT_DVD ) )
+    {
+        printf( "WARNING: XACT expects alignment to be in the range %u...%u \n", WAVEBANK_ALIGNMENT_MIN, WAVEBANK_ALIGNMENT_DVD );
+    }
+
+    if ( ( bank.dwFlags & WAVEBANK_TYPE_STREAMING ) && ( bank.dwAlignment < WAVEBANK_DVD_SECTOR_SIZE ) )
+    {
+        printf( "WARNING: XACT expects streaming buffers to be aligned to DVD sector size\n");
+    }
+
+    if ( bank.dwEntryCount )
+        printf( "%u entries in wave bank:\n", bank.dwEntryCount );
+}
+
+int OpenWaveBank( WaveBank* wb, const char* infile, int verbose )
+{
+    memset(wb, 0, sizeof(*wb));
+
+    MAPPEDFILE& fin = wb->file;
+    if(MapFile(&fin, infile)) {
+        printf("Error opening %s for reading\n", infile);
+        return -1;
+    }
+
+    WAVEBANKHEADER& header = wb->header;
+    const void* p_header = MapRange( &fin, 0, sizeof(header) );
+    if ( !p_header )
+    {
+        printf( "ERROR: File too small for valid wavebank\n");
+        CloseWaveBank(wb);
+        return -1;
+    }
+    memcpy( &header, p_header, sizeof(header) );
+
+    if ( *(uint32_t*)header.dwSignature != (uint32_t)WAVEBANK_HEADER_SIGNATURE )
+    {
+        printf( "ERROR: File is not a wavebank - %s\n", infile );
+        CloseWaveBank(wb);
+        return -1;
+    }
+
+    // check that wavedata are at the end of the file!
+    uint32_t waveOffset = header.Segments[WAVEBANK_SEGIDX_ENTRYWAVEDATA].dwOffset;
+    if(    waveOffset<header.Segments[WAVEBANK_SEGIDX_ENTRYNAMES].dwOffset
+        || waveOffset<header.Segments[WAVEBANK_SEGIDX_SEEKTABLES].dwOffset
+        || waveOffset<header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwOffset
+        || waveOffset<header.Segments[WAVEBANK_SEGIDX_BANKDATA].dwOffset
+    ) {
+        printf("ERROR: Only wxb where WaveData are last entry is supported\n");
+        CloseWaveBank(wb);
+        return -3;
+    }
+    wb->waveOffset = waveOffset;
+
+    WAVEBANKDATA& bank = wb->bank;
+
+    const void* p_bank = MapRange( &fin, header.Segments[WAVEBANK_SEGIDX_BANKDATA].dwOffset, sizeof(bank) );
+    if ( !p_bank )
+    {
+        printf( "ERROR: Failed reading bank data\n");
+        CloseWaveBank(wb);
+        return -1;
+    }
+    memcpy( &bank, p_bank, sizeof(bank) );
+
+    if ( bank.dwFlags & WAVEBANK_FLAGS_COMPACT )
+    {
+        if ( bank.dwEntryMetaDataElementSize != sizeof(WAVEBANKENTRYCOMPACT) )
+        {
+            printf( "ERROR: Compact banks expect a metadata element size of %zu\n", sizeof(WAVEBANKENTRYCOMPACT) );
+            CloseWaveBank(wb);
+            return 1;
+        }
+    }
+    else
+    {
+        if ( bank.dwEntryMetaDataElementSize != sizeof(WAVEBANKENTRY) )
+        {
+            printf( "ERROR: Banks expect a metadata element size of %zu\n", sizeof(WAVEBANKENTRY) );
+            CloseWaveBank(wb);
+            return 1;
+        }
+    }
+    if ( !bank.dwAlignment )
+    {
+        printf( "ERROR: Entry alignment is 0\n");
+        CloseWaveBank(wb);
+        return 1;
+    }
+    if(verbose)
+        PrintWaveBankHeader(wb, infile);
+
+    if ( !bank.dwEntryCount )
+    {
+        printf( "NOTE: Empty wave bank\n");
+        return 0;
+    }
+
+    uint32_t metadataBytes = header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwLength;
+    if ( metadataBytes != ( bank.dwEntryMetaDataElementSize * bank.dwEntryCount ) )
+    {
+        printf( "ERROR: Mismatch in entries %u and metadata size %u\n", bank.dwEntryCount, metadataBytes );
+        CloseWaveBank(wb);
+        return 1;
+    }
+    wb->metadataBytes = metadataBytes;
+
+    // Entry Names
+    uint32_t namesBytes = header.Segments[WAVEBANK_SEGIDX_ENTRYNAMES].dwLength;
+
+    if ( namesBytes > 0 )
+    {
+        if ( namesBytes != ( bank.dwEntryNameElementSize * bank.dwEntryCount ) )
+        {
+            printf( "ERROR: Mismatch in entries %u and entry names size %u\n", bank.dwEntryCount, namesBytes );
+        }
+        else
+        {
+            wb->entryNames = (const char*)MapRange( &fin, header.Segments[WAVEBANK_SEGIDX_ENTRYNAMES].dwOffset, namesBytes );
+            if ( !wb->entryNames )
+            {
+                printf( "ERROR: Failed reading entry names\n");
+                CloseWaveBank(wb);
+                return 1;
+            }
+        }
+    }
+
+    // Seek tables
+    uint32_t seekLen = header.Segments[WAVEBANK_SEGIDX_SEEKTABLES].dwLength;
+    if ( seekLen > 0 )
+    {
+        if ( seekLen < ( bank.dwEntryCount * sizeof(uint32_t) ) )
+        {
+            printf( "ERROR: Seek table is too small, needs at least %zu bytes; only %u bytes\n", bank.dwEntryCount * sizeof(uint32_t), seekLen );
+        }
+        else if ( ( seekLen % 4 ) != 0 )
+        {
+            printf( "ERROR: Seek table should be a multiple of 4 in size (%u bytes)\n", seekLen );
+        }
+        else
+        {
+            wb->seekTables = (const uint32_t*)MapRange( &fin, header.Segments[WAVEBANK_SEGIDX_SEEKTABLES].dwOffset, seekLen );
+            if ( !wb->seekTables )
+            {
+                printf( "ERROR: Failed reading seek tables\n");
+                CloseWaveBank(wb);
+                return 1;
+            }
+        }
+    }
+    wb->seekLen = seekLen;
+
+    // Entries (WAVEBANKENTRY or WAVEBANKENTRYCOMPACT views inside the mapping)
+    wb->entries = (const uint8_t*)MapRange( &fin, header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwOffset, metadataBytes );
+    if ( !wb->entries )
+    {
+        printf( "ERROR: Failed reading entry metadata\n");
+        CloseWaveBank(wb);
+        return 1;
+    }
+
+    size_t waveLen = header.Segments[WAVEBANK_SEGIDX_ENTRYWAVEDATA].dwLength;
+
+    if ( ( bank.dwFlags & WAVEBANK_FLAGS_COMPACT ) && ( waveLen > WAVEBANK_MAX_COMPACT_DATA_SEGMENT_SIZE * bank.dwAlignment ) )
+    {
+        printf( "ERROR: data segment too large for a valid compact wavebank" );
+        CloseWaveBank(wb);
+        return 1;
+    }
+
+    // Wave data (view inside the mapping)
+    wb->waveData = (const uint8_t*)MapRange( &fin, waveOffset, waveLen );
+    if ( !wb->waveData )
+    {
+        printf( "ERROR: Failed reading wave data\n");
+        CloseWaveBank(wb);
+        return 1;
+    }
+    wb->waveLen = waveLen;
+
+    return 0;
+}
+
+void CloseWaveBank( WaveBank* wb )
+{
+    UnmapFile(&wb->file);
+    memset(wb, 0, sizeof(*wb));
+    wb->file.fd = -1;
+}
+
+int GetWaveBankEntry( const WaveBank* wb, uint32_t j, WAVEBANKENTRYINFO* info, int verbose )
+{
+    const WAVEBANKDATA& bank = wb->bank;
+    const uint8_t* entries = wb->entries;
+    const uint32_t* seekTables = wb->seekTables;
+    uint32_t seekLen = wb->seekLen;
+    size_t waveLen = wb->waveLen;
+
+    memset(info, 0, sizeof(*info));
+    info->index = j;
+
+    if ( j >= bank.dwEntryCount )
+        return -1;
+
+    uint32_t dwOffset;
+    uint32_t dwLength;
+    uint32_t Duration = 0;
+    uint32_t DurationCompact = 0;
+    const MINIWAVEFORMAT* miniFmt;
+
+    const uint32_t* seekTable = nullptr;
+    if ( seekTables )
+    {
+        uint32_t baseOffset = bank.dwEntryCount * sizeof(uint32_t);
+        uint32_t offset = seekTables[ j ];
+        if ( offset != uint32_t(-1) )
+        {
+            if ( ( baseOffset + offset ) >= seekLen )
+            {
+                info->errors |= ENTRYERROR_SEEKOFFSET;
+            }
+            else
+            {
+                seekTable = reinterpret_cast<const uint32_t*>( reinterpret_cast<const uint8_t*>( seekTables ) + baseOffset + offset );
+
+                if ( ( ( ( *seekTable + 1 ) * sizeof(uint32_t) ) + baseOffset + offset ) > seekLen )
+                {
+                    info->errors |= ENTRYERROR_SEEKSIZE;
+                    seekTable = nullptr;
+                }
+            }
+        }
+    }
+
+    if ( bank.dwFlags & WAVEBANK_FLAGS_COMPACT )
+    {
+        auto& entry = reinterpret_cast<const WAVEBANKENTRYCOMPACT*>( entries )[j];
+
+        if(verbose)
+            printf( "  Entry %u (%d, %d)\n", j, entry.dwOffset, entry.dwLengthDeviation );
+
+        miniFmt = (const MINIWAVEFORMAT*)&bank.CompactFormat;
+        dwOffset = entry.dwOffset * bank.dwAlignment;
+
+        if ( j < ( bank.dwEntryCount - 1 ) )
+        {
+            dwLength = ( reinterpret_cast<const WAVEBANKENTRYCOMPACT*>( entries )[j + 1].dwOffset * bank.dwAlignment ) - dwOffset - entry.dwLengthDeviation;
+        }
+        else
+        {
+            dwLength = static_cast<uint32_t>(waveLen - dwOffset - entry.dwLengthDeviation);
+        }
+
+        DurationCompact = GetDuration( dwLength, miniFmt, seekTable );
+    }
+    else
+    {
+        auto& entry = reinterpret_cast<const WAVEBANKENTRY*>( entries )[j];
+
+        if(verbose) {
+            printf( "  Entry %u\n\tFlags %08X\n", j, entry.dwFlags );
+            if ( entry.dwFlags & WAVEBANKENTRY_FLAGS_READAHEAD )
+            {
+                printf( "\tFLAGS_READAHEAD\n");
+            }
+            if ( entry.dwFlags & WAVEBANKENTRY_FLAGS_LOOPCACHE )
+            {
+                printf( "\tFLAGS_LOOPCACHE\n");
+            }
+            if ( entry.dwFlags & WAVEBANKENTRY_FLAGS_REMOVELOOPTAIL )
+            {
+                printf( "\tFLAGS_REMOVELOOPTAIL\n");
+            }
+            if ( entry.dwFlags & WAVEBANKENTRY_FLAGS_IGNORELOOP )
+            {
+                printf( "\tFLAGS_IGNORELOOP\n");
+            }
+        }
+
+        miniFmt = &entry.Format;
+        dwOffset = entry.PlayRegion.dwOffset;
+        dwLength = entry.PlayRegion.dwLength;
+        Duration = entry.Duration;
+        DurationCompact = GetDuration( entry.PlayRegion.dwLength, miniFmt, seekTable );
+        info->entry = &entry;
+    }
+
+    if ( wb->entryNames )
+    {
+        uint32_t n = bank.dwEntryNameElementSize * j;
+
+        strncpy( info->name, &wb->entryNames[ n ], sizeof(info->name)-1 );
+        if(verbose)
+            printf( "\t\"%s\"\n", info->name );
+    }
+
+    float seconds;
+    if ( bank.dwFlags & WAVEBANK_FLAGS_COMPACT )
+    {
+        seconds = float( DurationCompact ) / float( miniFmt->nSamplesPerSec );
+        if(verbose)
+            printf( "\tEstDuration %u samples (%f seconds)\n", DurationCompact, seconds );
+    }
+    else
+    {
+        seconds = float( Duration ) / float( miniFmt->nSamplesPerSec );
+        if(verbose)
+            printf( "\tDuration %u samples (%f seconds), EstDuration %u\n", Duration, seconds, DurationCompact );
+    }
+
+    if(verbose)
+        printf( "\tPlay Region %u, Length %u\n", dwOffset, dwLength );
+
+    if ( !( bank.dwFlags & WAVEBANK_FLAGS_COMPACT ) )
+    {
+        auto& entry = reinterpret_cast<const WAVEBANKENTRY*>( entries )[j];
+
+        if(verbose)
+            if ( entry.LoopRegion.dwTotalSamples > 0 )
+            {
+                printf( "\tLoop Region %u...%u\n", entry.LoopRegion.dwStartSample, entry.LoopRegion.dwTotalSamples );
+            }
+    }
+
+    const char* fmtstr = nullptr;
+    switch( miniFmt->wFormatTag )
+    {
+    case MINIWAVEFORMAT::TAG_PCM:   fmtstr = "PCM"; break;
+    case MINIWAVEFORMAT::TAG_ADPCM: fmtstr = "MS ADPCM"; break;
+    case MINIWAVEFORMAT::TAG_WMA:   fmtstr = "xWMA"; break;
+    case MINIWAVEFORMAT::TAG_XMA:   fmtstr = "XMA"; break;
+    }
+
+    if(verbose)
+        printf( "\t%s %u channels, %u-bit, %u Hz\n\tblockAlign %u, avgBytesPerSec %u\n",
+            fmtstr,
+            miniFmt->nChannels, miniFmt->BitsPerSample(), miniFmt->nSamplesPerSec,
+            miniFmt->BlockAlign(), miniFmt->AvgBytesPerSec() );
+
+    if ( !dwLength )
+    {
+        info->errors |= ENTRYERROR_NOLENGTH;
+    }
+
+    if ( dwOffset > waveLen
+         || (dwOffset+dwLength) > waveLen )
+    {
+        info->errors |= ENTRYERROR_REGION;
+    }
+    else
+    {
+        info->data = wb->waveData + dwOffset;
+    }
+
+    if ( ( dwOffset % bank.dwAlignment ) != 0 )
+    {
+        info->errors |= ENTRYERROR_ALIGNMENT;
+    }
+
+    if ( seekTable )
+    {
+        if(verbose)
+            printf( "\tSeek table with %u entries", *seekTable );
+
+        for ( uint32_t k = 0; k < *seekTable; ++k )
+        {
+            if ( verbose && ( k % 6 ) == 0 )
+                printf( "\n\t");
+
+            if(verbose)
+                printf( "%u ", seekTable[ k + 1 ] );
+        }
+
+        if(verbose)
+            printf( "\n");
+    }
+
+    switch( miniFmt->wFormatTag  )
+    {
+    case MINIWAVEFORMAT::TAG_XMA:
+        if ( ( dwOffset % 2048 ) != 0 )
+        {
+            info->errors |= ENTRYERROR_XMAALIGNMENT;
+        }
+
+        if ( !seekTable )
+        {
+            info->errors |= ENTRYERROR_NOSEEKTABLE;
+        }
+        break;
+
+    case MINIWAVEFORMAT::TAG_WMA:
+        if ( !seekTable )
+        {
+            info->errors |= ENTRYERROR_NOSEEKTABLE;
+        }
+        break;
+    }
+
+    info->dwOffset = dwOffset;
+    info->dwLength = dwLength;
+    info->Duration = Duration;
+    info->DurationCompact = DurationCompact;
+    info->seconds = seconds;
+    info->Format = *miniFmt;
+    info->seekTable = seekTable;
+
+    return 0;
+}
+
+void PrintWaveBankEntryErrors( const WAVEBANKENTRYINFO* info )
+{
+    uint32_t e = info->errors;
+    if ( e & ENTRYERROR_SEEKOFFSET )
+        printf( "ERROR: Entry %u: Invalid seek table offset entry\n", info->index );
+    if ( e & ENTRYERROR_SEEKSIZE )
+        printf( "ERROR: Entry %u: Too many seek table entries for size of seek tables segment\n", info->index );
+    if ( e & ENTRYERROR_NOLENGTH )
+        printf( "ERROR: Entry %u: length is 0\n", info->index );
+    if ( e & ENTRYERROR_REGION )
+        printf( "ERROR: Entry %u: Invalid wave data region\n", info->index );
+    if ( e & ENTRYERROR_ALIGNMENT )
+        printf( "ERROR: Entry %u: Offset doesn't match alignment\n", info->index );
+    if ( e & ENTRYERROR_XMAALIGNMENT )
+        printf( "ERROR: Entry %u: XMA2 data needs to be aligned to a 2K boundary\n", info->index );
+    if ( e & ENTRYERROR_NOSEEKTABLE )
+        printf( "ERROR: Entry %u: Missing seek table entry for %s wave\n", info->index,
+            ( info->Format.wFormatTag == MINIWAVEFORMAT::TAG_XMA ) ? "XMA2" : "xWMA" );
+}
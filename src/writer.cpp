@@ -0,0 +1,448 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <map>
+
+#include "rexwb.h"
+
+// An existing output reached by a symlink is replaced, not the link
+static char* OutputPath( const char* outfile )
+{
+    char* real = realpath(outfile, NULL);
+    return real? real : strdup(outfile);
+}
+
+// umask() can only be read by setting it, so it's done once, before any thread is started
+static mode_t ReadUmask( void )
+{
+    mode_t mask = umask(0);
+    umask(mask);
+    return mask;
+}
+static const mode_t processUmask = ReadUmask();
+
+int CreateOutputFile( const char* outfile, char** tmpname )
+{
+    // in the same directory, so the final rename is atomic
+    char* path = OutputPath(outfile);
+    size_t l = strlen(path);
+    *tmpname = (char*)malloc(l + 8);
+    memcpy(*tmpname, path, l);
+    memcpy(*tmpname + l, ".XXXXXX", 8);
+    // mkstemp creates the file 0600: a replaced file keeps its mode, a new one gets the usual permissions
+    struct stat st;
+    mode_t mode = (!stat(path, &st) && S_ISREG(st.st_mode))? (st.st_mode & 07777) : (0666 & ~processUmask);
+    free(path);
+    int fd = mkstemp(*tmpname);
+    if(fd<0) {
+        printf("ERROR: Cannot create %s\n", *tmpname);
+        free(*tmpname);
+        *tmpname = NULL;
+        return -1;
+    }
+    if(fchmod(fd, mode)) {
+        printf("ERROR: Cannot set the mode of %s\n", *tmpname);
+        DiscardOutputFile(fd, *tmpname);
+        *tmpname = NULL;
+        return -1;
+    }
+    return fd;
+}
+
+int WriteOutputAt( int fd, const void* data, size_t length, uint64_t offset )
+{
+    const uint8_t* p = (const uint8_t*)data;
+    while(length) {
+        ssize_t n = pwrite(fd, p, length, offset);
+        if(n<0 && errno==EINTR)
+            continue;
+        if(n<=0) {
+            printf("ERROR: Cannot write %zu bytes\n", length);
+            return -2;
+        }
+        p += n;
+        length -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+int CommitOutputFile( int fd, char* tmpname, const char* outfile )
+{
+    int ret = 0;
+    if(fsync(fd)) {
+        printf("ERROR: Cannot sync %s\n", tmpname);
+        ret = -2;
+    }
+    if(close(fd) && !ret)
+        ret = -2;
+    char* path = OutputPath(outfile);
+    if(!ret && rename(tmpname, path)) {
+        printf("ERROR: Cannot rename %s to %s\n", tmpname, path);
+        ret = -2;
+    }
+    if(ret) {
+        unlink(tmpname);
+    } else {
+        // and make the rename itself durable
+        char* dir = strdup(path);
+        char* slash = strrchr(dir, '/');
+        if(slash)
+            slash[slash==dir?1:0] = 0;
+        int dfd = open(slash?dir:".", O_RDONLY|O_DIRECTORY);
+        if(dfd>=0) {
+            fsync(dfd);
+            close(dfd);
+        }
+        free(dir);
+    }
+    free(path);
+    free(tmpname);
+    return ret;
+}
+
+void DiscardOutputFile( int fd, char* tmpname )
+{
+    close(fd);
+    unlink(tmpname);
+    free(tmpname);
+}
+
+int SameOutput( const char* a, const char* b )
+{
+    struct stat sa, sb;
+    return !strcmp(a, b) || (!stat(a, &sa) && !stat(b, &sb) && sa.st_dev==sb.st_dev && sa.st_ino==sb.st_ino);
+}
+
+static void InitBankWriter( BANKWRITER* w, const WaveBank* wb, const char* outfile, int verbose )
+{
+    w->wb = wb;
+    w->verbose = verbose;
+    memcpy(&w->header, &wb->header, sizeof(w->header));
+    memcpy(&w->bank, &wb->bank, sizeof(w->bank));
+    w->outfile = strdup(outfile);
+    w->buffer = new uint8_t[ BANKWRITER_BUFFER ];
+    // the headers are written on close, the wave data starts at the same place as in the input
+    w->pos = wb->waveOffset;
+    // get a copy of entries that will be changed
+    w->entries = new uint8_t[ wb->metadataBytes ];
+    memcpy(w->entries, wb->entries, wb->metadataBytes);
+    if(wb->seekTables) {
+        w->seekTables = new const uint32_t*[ wb->bank.dwEntryCount ];
+        memset(w->seekTables, 0, wb->bank.dwEntryCount * sizeof(*w->seekTables));
+    }
+}
+
+int OpenBankWriter( BANKWRITER* w, const WaveBank* wb, const char* outfile, int verbose )
+{
+    memset(w, 0, sizeof(*w));
+    w->fd = CreateOutputFile(outfile, &w->tmpname);
+    if(w->fd<0)
+        return -2;
+    InitBankWriter(w, wb, outfile, verbose);
+    return 0;
+}
+
+int OpenBankWriterInPlace( BANKWRITER* w, const WaveBank* wb, const char* outfile, int verbose )
+{
+    memset(w, 0, sizeof(*w));
+    w->fd = open(outfile, O_WRONLY);
+    if(w->fd<0) {
+        printf("ERROR: Cannot open %s for writing\n", outfile);
+        return -2;
+    }
+    w->inplace = 1;
+    InitBankWriter(w, wb, outfile, verbose);
+    return 0;
+}
+
+void PreallocateBankWriter( BANKWRITER* w, uint64_t size )
+{
+    // one extent for the whole bank instead of growing by pieces. Not supported everywhere, it's only a hint
+    if(size)
+        fallocate(w->fd, 0, 0, size);
+}
+
+static int FlushBankWriter( BANKWRITER* w )
+{
+    if(!w->buffered)
+        return 0;
+    int ret = WriteOutputAt(w->fd, w->buffer, w->buffered, w->pos - w->buffered);
+    w->buffered = 0;
+    return ret;
+}
+
+// Append wave data, through the buffer for small pieces.
+// In place, data can be a view of the input just after the write position: it always goes through the
+// buffer, so each piece is read before the file under it is overwritten
+static int WriteBankData( BANKWRITER* w, const void* data, uint32_t length )
+{
+    if(w->buffered + length > BANKWRITER_BUFFER) {
+        int ret = FlushBankWriter(w);
+        if(ret)
+            return ret;
+    }
+    if(length >= BANKWRITER_BUFFER/2 && !w->inplace) {
+        w->pos += length;
+        return WriteOutputAt(w->fd, data, length, w->pos - length);
+    }
+    const uint8_t* p = (const uint8_t*)data;
+    while(length) {
+        uint32_t n = BANKWRITER_BUFFER - w->buffered;
+        if(n > length)
+            n = length;
+        memcpy(w->buffer + w->buffered, p, n);
+        w->buffered += n;
+        w->pos += n;
+        p += n;
+        length -= n;
+        if(length) {
+            int ret = FlushBankWriter(w);
+            if(ret)
+                return ret;
+        }
+    }
+    return 0;
+}
+
+// Rebuild the seek tables segment with the tables of the entries copied as is (xWMA / XMA).
+// Their tables only depend on the entry data, converted entries don't have any. The segment can only shrink,
+// it's written over the whole old segment in headers, so no stale table is left behind
+static void BuildSeekTables( BANKWRITER* w, uint8_t* headers )
+{
+    const WaveBank* wb = w->wb;
+    uint32_t count = wb->bank.dwEntryCount;
+    uint32_t* seg = (uint32_t*)(headers + wb->header.Segments[WAVEBANK_SEGIDX_SEEKTABLES].dwOffset);
+    memset(seg, 0, wb->seekLen);
+    uint32_t len = count;   // in uint32_t, after the offsets
+    std::map<const uint32_t*, uint32_t> done;   // tables shared by several entries stay shared
+    for(uint32_t j=0; j<count; ++j) {
+        const uint32_t* table = w->seekTables[j];
+        if(!table) {
+            seg[j] = uint32_t(-1);
+            continue;
+        }
+        auto it = done.find(table);
+        if(it!=done.end()) {
+            seg[j] = it->second;
+            continue;
+        }
+        seg[j] = (len - count) * sizeof(uint32_t);
+        done[table] = seg[j];
+        memcpy(seg + len, table, (*table + 1) * sizeof(uint32_t));
+        len += *table + 1;
+    }
+    if(w->verbose)
+        printf( "  Seek tables %u -> %zu bytes\n", wb->seekLen, len * sizeof(uint32_t) );
+    w->header.Segments[WAVEBANK_SEGIDX_SEEKTABLES].dwLength = len * sizeof(uint32_t);
+}
+
+int BeginBankEntry( BANKWRITER* w )
+{
+    w->entryOffset = w->pos;
+    w->entryLength = 0;
+    return 0;
+}
+
+int WriteBankEntryData( BANKWRITER* w, const void* data, uint32_t length )
+{
+    double t = StageClock();
+    int ret = WriteBankData(w, data, length);
+    w->times.time[STAGE_WRITE] += StageClock() - t;
+    if(ret)
+        return ret;
+    w->entryLength += length;
+    return 0;
+}
+
+int WriteBankEntry( BANKWRITER* w, const WAVEBANKENTRYINFO* info, const CONVERTEDENTRY* e )
+{
+    BeginBankEntry(w);
+    int ret = WriteBankEntryData(w, e->data, e->length);
+    if(!ret)
+        ret = EndBankEntry(w, info, e);
+    return ret;
+}
+
+int EndBankEntry( BANKWRITER* w, const WAVEBANKENTRYINFO* info, const CONVERTEDENTRY* e )
+{
+    const WAVEBANKDATA& bank = w->wb->bank;
+    uint32_t j = info->index;
+    uint32_t newLength = w->entryLength;
+    uint32_t newOffset = w->entryOffset;
+
+    if(info->Format.wFormatTag==MINIWAVEFORMAT::TAG_XMA)
+        w->hasxma = 1;
+    if(w->seekTables)
+        w->seekTables[j] = e->convert?NULL:info->seekTable;
+
+    w->newwaveBytes += newLength;
+    uint32_t pad = (bank.dwAlignment - newLength%bank.dwAlignment) % bank.dwAlignment;
+    if ( bank.dwFlags & WAVEBANK_FLAGS_COMPACT ) {
+        // offset in alignment units, the length comes from the next offset minus the padding
+        auto& newentry = reinterpret_cast<WAVEBANKENTRYCOMPACT*>( w->entries )[j];
+        uint32_t offset = (newOffset - w->wb->waveOffset) / bank.dwAlignment;
+        if ( offset > WAVEBANK_MAX_COMPACT_DATA_SEGMENT_SIZE || pad >= (1u<<11) ) {
+            printf("ERROR: Entry %u doesn't fit in a compact wavebank (offset %u)\n", j, offset);
+            return -2;
+        }
+        if(w->verbose && e->convert)
+            printf("\tnew entry %u->%u -> ", info->dwOffset, info->dwLength);
+        newentry.dwOffset = offset;
+        newentry.dwLengthDeviation = pad;
+        if(e->convert) {
+            // all entries share the same format
+            memcpy(&w->bank.CompactFormat, &e->Format, sizeof(w->bank.CompactFormat));
+            if(w->verbose)
+                printf("%u->%u/%dx%dHz %s\n", newOffset - w->wb->waveOffset, newLength, e->Format.nChannels, e->Format.nSamplesPerSec,
+                    (e->Format.wFormatTag==MINIWAVEFORMAT::TAG_ADPCM)?"MS_ADPCM":"PCM");
+        }
+    } else if(e->convert) {
+        auto& newentry = reinterpret_cast<WAVEBANKENTRY*>( w->entries )[j];
+        MINIWAVEFORMAT* newminiFmt = &newentry.Format;
+        int adpcm_in = newminiFmt->wFormatTag==MINIWAVEFORMAT::TAG_ADPCM;
+        if(w->verbose)
+            printf("\tnew entry %u->%u/%dx%dHz %s -> ", newentry.PlayRegion.dwOffset, newentry.PlayRegion.dwLength, newminiFmt->nChannels, newminiFmt->nSamplesPerSec, adpcm_in?"MS_ADPCM":"PCM");
+        newentry.PlayRegion.dwOffset = newOffset - w->wb->waveOffset;
+        newentry.PlayRegion.dwLength = newLength;
+        newentry.Duration = e->Duration;
+        newentry.Format = e->Format;
+        newentry.LoopRegion = e->LoopRegion;
+        if(w->verbose)
+            printf("%u->%u/%dx%dHz %s%s\n", newentry.PlayRegion.dwOffset, newentry.PlayRegion.dwLength, newminiFmt->nChannels, newminiFmt->nSamplesPerSec,
+                (newminiFmt->wFormatTag==MINIWAVEFORMAT::TAG_ADPCM)?"MS_ADPCM":"PCM",
+                (newminiFmt->wFormatTag==MINIWAVEFORMAT::TAG_PCM && newminiFmt->wBitsPerSample==MINIWAVEFORMAT::BITDEPTH_8)?" 8bits":"");
+    } else {
+        auto& newentry = reinterpret_cast<WAVEBANKENTRY*>( w->entries )[j];
+        newentry.PlayRegion.dwOffset = newOffset - w->wb->waveOffset;
+    }
+    // add some padding if lenght is not aligned
+    if(pad) {
+        double t = StageClock();
+        uint8_t zeros[2048] = {};
+        for(uint32_t l=pad; l; ) {
+            uint32_t n = (l>sizeof(zeros))?sizeof(zeros):l;
+            int ret = WriteBankData(w, zeros, n);
+            if(ret)
+                return ret;
+            l -= n;
+        }
+        w->newwaveBytes += pad;
+        w->times.time[STAGE_PAD] += StageClock() - t;
+    }
+
+    w->waveBytes += info->dwLength;
+
+    return 0;
+}
+
+int WriteBankEntryAlias( BANKWRITER* w, const WAVEBANKENTRYINFO* info, uint32_t first )
+{
+    uint32_t j = info->index;
+    if ( ( w->wb->bank.dwFlags & WAVEBANK_FLAGS_COMPACT ) || first >= j )
+    {
+        printf("ERROR: Entry %u cannot share the region of entry %u\n", j, first);
+        return -2;
+    }
+    auto& newentry = reinterpret_cast<WAVEBANKENTRY*>( w->entries )[j];
+    const auto& source = reinterpret_cast<const WAVEBANKENTRY*>( w->entries )[first];
+    newentry.Duration = source.Duration;
+    newentry.Format = source.Format;
+    newentry.PlayRegion = source.PlayRegion;
+    newentry.LoopRegion = source.LoopRegion;
+    // a copied entry keeps its seek table, a converted one has none
+    if(w->seekTables)
+        w->seekTables[j] = w->seekTables[first]? info->seekTable : NULL;
+    if(w->verbose)
+        printf("\tsame as entry %u, %u->%u\n", first, newentry.PlayRegion.dwOffset, newentry.PlayRegion.dwLength);
+    return 0;
+}
+
+int CloseBankWriter( BANKWRITER* w )
+{
+    const WaveBank* wb = w->wb;
+
+    if ( w->hasxma )
+    {
+        if ( ( wb->header.Segments[WAVEBANK_SEGIDX_ENTRYWAVEDATA].dwOffset % 2048 ) != 0 )
+        {
+            printf( "WARNING: Wave banks containing XMA2 data should have the wave segment offset aligned to a 2K boundary\n" );
+        }
+    }
+
+    if(w->verbose)
+        printf( "  Total wave bytes %zu -> %zu\n", w->waveBytes, w->newwaveBytes );
+
+    if ( w->waveBytes > wb->waveLen )
+    {
+        printf( "ERROR: Invalid wave data region\n");
+    }
+
+    int ret = FlushBankWriter(w);
+    if(!ret) {
+        // everything before the wave data, with the new entries, seek tables, bank data and wave size
+        uint32_t t = wb->waveOffset;
+        uint8_t* headers = new uint8_t[ t ];
+        memcpy(headers, wb->file.data, t);
+        memcpy(headers + wb->header.Segments[WAVEBANK_SEGIDX_ENTRYMETADATA].dwOffset, w->entries, wb->metadataBytes);
+        if(wb->seekTables)
+            BuildSeekTables(w, headers);
+        // the format of compact banks may have changed
+        memcpy(headers + wb->header.Segments[WAVEBANK_SEGIDX_BANKDATA].dwOffset, &w->bank, sizeof(w->bank));
+        w->header.Segments[WAVEBANK_SEGIDX_ENTRYWAVEDATA].dwLength = w->newwaveBytes;
+        memcpy(headers, &w->header, sizeof(w->header));
+        ret = WriteOutputAt(w->fd, headers, t, 0);
+        delete[] headers;
+    }
+    // cut what was preallocated and not used
+    if(!ret && ftruncate(w->fd, w->pos)) {
+        printf("ERROR: Cannot truncate %s\n", w->tmpname?w->tmpname:w->outfile);
+        ret = -2;
+    }
+    if(w->inplace) {
+        if(!ret && fsync(w->fd)) {
+            printf("ERROR: Cannot sync %s\n", w->outfile);
+            ret = -2;
+        }
+        if(close(w->fd) && !ret)
+            ret = -2;
+        if(ret)
+            printf("ERROR: %s was partly rewritten in place and is damaged\n", w->outfile);
+    } else if(!ret)
+        ret = CommitOutputFile(w->fd, w->tmpname, w->outfile);
+    else
+        DiscardOutputFile(w->fd, w->tmpname);
+    w->tmpname = NULL;
+    w->fd = -1;
+
+    AbortBankWriter(w);
+
+    return ret;
+}
+
+void AbortBankWriter( BANKWRITER* w )
+{
+    if(w->tmpname)
+        DiscardOutputFile(w->fd, w->tmpname);
+    else if(w->inplace && w->fd>=0) {
+        close(w->fd);
+        if(w->pos - w->buffered > w->wb->waveOffset)
+            printf("ERROR: %s was partly rewritten in place and is damaged\n", w->outfile);
+    }
+    w->tmpname = NULL;
+    w->fd = -1;
+    free(w->outfile);
+    w->outfile = NULL;
+    delete[] w->buffer;
+    w->buffer = NULL;
+    delete[] w->entries;
+    w->entries = NULL;
+    delete[] w->seekTables;
+    w->seekTables = NULL;
+}
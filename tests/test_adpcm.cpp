@@ -0,0 +1,445 @@
+// MS ADPCM: the decoder against a scalar port of sox's block_expand, the exhaustive encoder against a port of
+// sox's block_mash, and the other encoder output against fixed reference blocks
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "msadpcm.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if(!(cond)) { printf("FAIL: " __VA_ARGS__); printf("\n"); ++failures; } } while(0)
+
+static uint32_t Random( uint32_t* state )
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// Integer only, so the reference blocks don't depend on the libm: two triangles, a square and some noise
+static void GenerateSignal( int16_t* pcm, uint32_t frames, uint32_t chans, uint32_t seed )
+{
+    for(uint32_t i=0; i<frames; ++i)
+        for(uint32_t c=0; c<chans; ++c) {
+            int t1 = (int)((i * (37 + c)) % 512) - 256;
+            int t2 = (int)((i * 5) % 2048) - 1024;
+            int v = (t1 < 0? -t1 : t1) * 60 - 7680 + (t2 < 0? -t2 : t2) * 6 - 3072;
+            v += ((i / 300) % 2)? 2500 : -2500;
+            v += (int)(Random(&seed) & 0x7ff) - 1024;
+            if(i % 3000 > 2800)
+                v *= 4;     // some clipping
+            pcm[(size_t)i*chans + c] = (int16_t)(v > 32767? 32767 : (v < -32768? -32768 : v));
+        }
+}
+
+static uint64_t Hash( const uint8_t* p, size_t n )
+{
+    // FNV-1a
+    uint64_t h = 14695981039346656037ull;
+    for(size_t i=0; i<n; ++i)
+        h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+static MINIWAVEFORMAT AdpcmFormat( uint32_t chans, uint32_t blockAlign )
+{
+    MINIWAVEFORMAT mf;
+    mf.dwValue = 0;
+    mf.wFormatTag = MINIWAVEFORMAT::TAG_ADPCM;
+    mf.nChannels = chans;
+    mf.nSamplesPerSec = 44100;
+    mf.wBitsPerSample = MINIWAVEFORMAT::BITDEPTH_16;
+    mf.wBlockAlign = blockAlign/chans - MINIWAVEFORMAT::ADPCM_BLOCKALIGN_CONVERSION_OFFSET;
+    return mf;
+}
+
+// sox adpcm.c, AdpcmDecode() and lsx_ms_adpcm_block_expand_i(), as they are
+static const int stepAdjustTable[] = {
+    230, 230, 230, 230, 307, 409, 512, 614,
+    768, 614, 512, 409, 307, 230, 230, 230
+};
+static const int iCoef[7][2] = {
+    { 256,   0}, { 512,-256}, {   0,   0}, { 192,  64}, { 240,   0}, { 460,-208}, { 392,-232}
+};
+
+typedef struct { int step; int coef[2]; } MsState_t;
+
+static int SoxDecode( int c, MsState_t* state, int sample1, int sample2 )
+{
+    int vlin, sample, step, nstep;
+    step = state->step;
+    nstep = (stepAdjustTable[c] * step) >> 8;
+    state->step = (nstep < 16)? 16 : nstep;
+    vlin = ((sample1 * state->coef[0]) + (sample2 * state->coef[1])) >> 8;
+    c -= (c & 0x08) << 1;
+    sample = (c * step) + vlin;
+    if (sample > 0x7fff) sample = 0x7fff;
+    else if (sample < -0x8000) sample = -0x8000;
+    return sample;
+}
+
+static void SoxBlockExpand( uint32_t chans, const uint8_t* ibuff, int16_t* obuff, uint32_t n )
+{
+    MsState_t state[8];
+    const uint8_t* ip = ibuff;
+    for(uint32_t ch = 0; ch < chans; ch++) {
+        uint8_t bpred = *ip++;
+        if(bpred >= 7)
+            bpred = 0;
+        state[ch].coef[0] = iCoef[bpred][0];
+        state[ch].coef[1] = iCoef[bpred][1];
+    }
+    for(uint32_t ch = 0; ch < chans; ch++, ip += 2)
+        state[ch].step = (int16_t)(ip[0] | (ip[1] << 8));
+    for(uint32_t ch = 0; ch < chans; ch++, ip += 2)
+        obuff[chans + ch] = (int16_t)(ip[0] | (ip[1] << 8));
+    for(uint32_t ch = 0; ch < chans; ch++, ip += 2)
+        obuff[ch] = (int16_t)(ip[0] | (ip[1] << 8));
+
+    int16_t* op = obuff + 2*chans;
+    int16_t* top = obuff + n*chans;
+    uint32_t ch = 0;
+    while(op < top) {
+        uint8_t b = *ip++;
+        int16_t* tmp = op;
+        *op++ = SoxDecode(b >> 4, state+ch, tmp[-(int)chans], tmp[-2*(int)chans]);
+        if(++ch == chans) ch = 0;
+        if(op >= top)
+            break;
+        tmp = op;
+        *op++ = SoxDecode(b & 0x0f, state+ch, tmp[-(int)chans], tmp[-2*(int)chans]);
+        if(++ch == chans) ch = 0;
+    }
+}
+
+// What sox reads from length bytes: full blocks, then the partial one
+static uint32_t SoxDecodeAll( const uint8_t* data, uint32_t length, uint32_t chans, uint32_t blockAlign, std::vector<int16_t>& pcm )
+{
+    uint32_t spb = AdpcmSamplesIn(0, chans, blockAlign, 0);
+    uint32_t total = AdpcmSamplesIn(length, chans, blockAlign, spb);
+    pcm.assign((size_t)total*chans + 2*chans, 0);
+    std::vector<uint8_t> blk(blockAlign);
+    uint32_t done = 0;
+    for(uint32_t off=0; off<length && done<total; off+=blockAlign) {
+        uint32_t bytes = (length - off < blockAlign)? length - off : blockAlign;
+        uint32_t n = AdpcmSamplesIn(bytes, chans, blockAlign, spb);
+        if(n < 2)
+            break;
+        memset(blk.data(), 0, blockAlign);
+        memcpy(blk.data(), data + off, bytes);
+        SoxBlockExpand(chans, blk.data(), pcm.data() + (size_t)done*chans, n);
+        done += n;
+    }
+    return done;
+}
+
+static void CheckDecode( const char* what, const uint8_t* data, uint32_t length, uint32_t chans, uint32_t blockAlign )
+{
+    MINIWAVEFORMAT mf = AdpcmFormat(chans, blockAlign);
+    std::vector<int16_t> ref;
+    uint32_t nref = SoxDecodeAll(data, length, chans, blockAlign, ref);
+    std::vector<int16_t> pcm((size_t)AdpcmSamplesIn(length, chans, blockAlign, mf.AdpcmSamplesPerBlock())*chans + 2*chans);
+    uint32_t n = AdpcmDecode(data, length, &mf, pcm.data());
+    CHECK(n == nref, "%s: %u channels, blockAlign %u: %u samples decoded, sox gives %u", what, chans, blockAlign, n, nref);
+    if(n != nref)
+        return;
+    for(size_t i=0; i<(size_t)n*chans; ++i)
+        if(pcm[i] != ref[i]) {
+            CHECK(0, "%s: %u channels, blockAlign %u: sample %zu is %d, sox gives %d", what, chans, blockAlign, i, pcm[i], ref[i]);
+            return;
+        }
+}
+
+// Blocks of random headers and nibbles, mostly small ones so the step doesn't overflow (in sox too)
+static void TestDecodeRandom( void )
+{
+    uint32_t seed = 1234;
+    // per channel, the MINIWAVEFORMAT holds up to 255+ADPCM_BLOCKALIGN_CONVERSION_OFFSET
+    const uint32_t aligns[] = { 36, 70, 140, 256, 277 };
+    for(uint32_t chans=1; chans<=6; ++chans)
+        for(uint32_t a : aligns) {
+            uint32_t blockAlign = a * chans;
+            uint32_t nblocks = 37;
+            std::vector<uint8_t> data((size_t)nblocks * blockAlign);
+            for(uint32_t b=0; b<nblocks; ++b) {
+                uint8_t* p = &data[(size_t)b * blockAlign];
+                for(uint32_t ch=0; ch<chans; ++ch)
+                    *p++ = (Random(&seed) % 9 == 0)? 7 + Random(&seed) % 249 : Random(&seed) % 7;
+                for(uint32_t ch=0; ch<chans; ++ch, p+=2) {
+                    int step = (Random(&seed) % 4 == 0)? (int)(Random(&seed) % 65536) - 32768 : 16 + Random(&seed) % 2000;
+                    p[0] = step & 0xff;
+                    p[1] = (step >> 8) & 0xff;
+                }
+                for(uint32_t k=0; k<4*chans; ++k)
+                    *p++ = Random(&seed) & 0xff;
+                static const uint8_t small[] = { 0, 1, 2, 3, 13, 14, 15 };
+                for(; p<&data[(size_t)(b+1) * blockAlign]; ++p) {
+                    uint8_t hi = (Random(&seed) % 12)? small[Random(&seed) % 7] : Random(&seed) % 16;
+                    uint8_t lo = (Random(&seed) % 12)? small[Random(&seed) % 7] : Random(&seed) % 16;
+                    *p = (hi << 4) | lo;
+                }
+            }
+            CheckDecode("random blocks", data.data(), data.size(), chans, blockAlign);
+            // and cut in the last block
+            CheckDecode("random blocks, partial", data.data(), data.size() - blockAlign/3, chans, blockAlign);
+        }
+}
+
+// sox adpcm.c, AdpcmMashS(), AdpcmMashChannel() and lsx_ms_adpcm_block_mash_i(), as they are
+static int SoxMashS( uint32_t ch, uint32_t chans, const int v[2], const int coef[2], const int16_t* ibuff, int n, int* iostep, uint8_t* obuff )
+{
+    const int16_t* ip = ibuff + ch;
+    const int16_t* itop = ibuff + n*chans;
+    int v0 = v[0], v1 = v[1];
+    int d = *ip - v1; ip += chans;
+    double d2 = d*d;
+    d = *ip - v0; ip += chans;
+    d2 += d*d;
+    int step = *iostep;
+    uint8_t* op = obuff;
+    int ox = 0;
+    if(op) {
+        op += chans;
+        op += 2*ch;
+        op[0] = step; op[1] = step>>8;
+        op += 2*chans;
+        op[0] = v0; op[1] = v0>>8;
+        op += 2*chans;
+        op[0] = v1; op[1] = v1>>8;
+        op = obuff + 7*chans;
+        ox = 4*ch;
+    }
+    for(; ip < itop; ip += chans) {
+        int vlin = (v0 * coef[0] + v1 * coef[1]) >> 8;
+        int d3 = *ip - vlin;
+        int dp = d3 + (step<<3) + (step>>1);
+        int c = 0;
+        if(dp > 0) {
+            c = dp/step;
+            if(c > 15) c = 15;
+        }
+        c -= 8;
+        dp = c * step;
+        c &= 0x0f;
+        v1 = v0;
+        v0 = vlin + dp;
+        if(v0 < -0x8000) v0 = -0x8000;
+        else if(v0 > 0x7fff) v0 = 0x7fff;
+        d3 = *ip - v0;
+        d2 += d3*d3;
+        if(op) {
+            op[ox>>3] |= (ox&4)? c : (c<<4);
+            ox += 4*chans;
+        }
+        step = (stepAdjustTable[c] * step) >> 8;
+        if(step < 16) step = 16;
+    }
+    d2 /= n;
+    *iostep = step;
+    return (int)sqrt(d2);
+}
+
+static void SoxMashChannel( uint32_t ch, uint32_t chans, const int16_t* ip, int n, int* st, uint8_t* obuff )
+{
+    int v[2];
+    int n0 = n/2; if(n0 > 32) n0 = 32;
+    if(*st < 16) *st = 16;
+    v[1] = ip[ch];
+    v[0] = ip[ch+chans];
+    int dmin = 0, kmin = 0, smin = 0;
+    for(int k=0; k<7; k++) {
+        int ss, s0, s1, d0, d1;
+        ss = s0 = *st;
+        d0 = SoxMashS(ch, chans, v, iCoef[k], ip, n, &ss, NULL);
+        s1 = s0;
+        SoxMashS(ch, chans, v, iCoef[k], ip, n0, &s1, NULL);
+        ss = s1 = (3*s0+s1)/4;
+        d1 = SoxMashS(ch, chans, v, iCoef[k], ip, n, &ss, NULL);
+        if(!k || d0<dmin || d1<dmin) {
+            kmin = k;
+            if(d0 <= d1) {
+                dmin = d0;
+                smin = s0;
+            } else {
+                dmin = d1;
+                smin = s1;
+            }
+        }
+    }
+    *st = smin;
+    SoxMashS(ch, chans, v, iCoef[kmin], ip, n, st, obuff);
+    obuff[ch] = kmin;
+}
+
+static void SoxBlockMash( uint32_t chans, const int16_t* ip, int n, int* st, uint8_t* obuff, uint32_t blockAlign )
+{
+    for(uint8_t* p=obuff+7*chans; p<obuff+blockAlign; p++) *p = 0;
+    for(uint32_t ch=0; ch<chans; ch++)
+        SoxMashChannel(ch, chans, ip, n, st+ch, obuff);
+}
+
+// What sox's wav writer gives: the steps start at 0 and go on from block to block, the last block is zero-filled
+static void SoxEncodeAll( const int16_t* pcm, uint32_t frames, uint32_t chans, uint32_t blockAlign, std::vector<uint8_t>& out )
+{
+    uint32_t spb = AdpcmSamplesIn(0, chans, blockAlign, 0);
+    uint32_t nblocks = (frames + spb - 1) / spb;
+    std::vector<int16_t> samples((size_t)spb*chans);
+    int st[8] = {0};
+    out.assign((size_t)nblocks*blockAlign, 0);
+    for(uint32_t b=0; b<nblocks; ++b) {
+        uint32_t n = (frames - b*spb < spb)? frames - b*spb : spb;
+        std::fill(samples.begin(), samples.end(), 0);
+        memcpy(samples.data(), pcm + (size_t)b*spb*chans, (size_t)n*chans*2);
+        SoxBlockMash(chans, samples.data(), spb, st, &out[(size_t)b*blockAlign], blockAlign);
+    }
+}
+
+// With -e, the blocks of the first ADPCM_CHUNK_BLOCKS chunk are the ones sox writes (the next chunks start
+// with their own step, so only the first one can match)
+static void TestEncodeSox( void )
+{
+    static const uint32_t cases[][3] = {
+        // chans, blockAlign, frames
+        { 1,   36,   1000 }, { 1,   64,  10000 }, { 1,  256,  20000 }, { 1,  277,   9999 }, { 2,  140,   4000 },
+        { 2,  512,  30001 }, { 4,  720,  14000 }, { 6, 1536,  12345 },
+    };
+    for(auto& c : cases) {
+        uint32_t chans = c[0], blockAlign = c[1], frames = c[2];
+        std::vector<int16_t> pcm((size_t)frames * chans);
+        GenerateSignal(pcm.data(), frames, chans, 77);
+        std::vector<uint8_t> ref, out(AdpcmEncodedSize(frames, chans, blockAlign));
+        SoxEncodeAll(pcm.data(), frames, chans, blockAlign, ref);
+        uint32_t l = AdpcmEncode(pcm.data(), frames, chans, blockAlign, 1, NULL, out.data());
+        CHECK(l == ref.size(), "sox encode %u channels, blockAlign %u: %u bytes, sox gives %zu", chans, blockAlign, l, ref.size());
+        size_t n = std::min((size_t)l, std::min(ref.size(), (size_t)ADPCM_CHUNK_BLOCKS*blockAlign));
+        for(size_t i=0; i<n; ++i)
+            if(out[i] != ref[i]) {
+                CHECK(0, "sox encode %u channels, blockAlign %u: byte %zu of block %zu is 0x%02x, sox gives 0x%02x",
+                    chans, blockAlign, i % blockAlign, i / blockAlign, out[i], ref[i]);
+                break;
+            }
+    }
+}
+
+// Reference blocks: the first block and a hash of the whole output of AdpcmEncode, for a fixed signal
+typedef struct {
+    uint32_t    chans;
+    uint32_t    blockAlign;
+    uint32_t    frames;
+    int         exhaustive;
+    uint64_t    hash;
+    uint8_t     first[32];  // first bytes of the first block
+} ENCODEREF;
+
+static const ENCODEREF encodeRefs[] = {
+#include "test_adpcm_refs.h"
+};
+
+// Several entries encoded at once on a pool, each sharing its chunks with the pool
+typedef struct {
+    const int16_t*          pcm;
+    const ENCODEREF*        ref;
+    WORKERPOOL*             pool;
+    std::vector<uint8_t>    out;
+    uint32_t                length;
+} ENCODEJOB;
+
+static void EncodeJob( void* arg )
+{
+    ENCODEJOB* job = (ENCODEJOB*)arg;
+    const ENCODEREF* r = job->ref;
+    job->length = AdpcmEncode(job->pcm, r->frames, r->chans, r->blockAlign, r->exhaustive, job->pool, job->out.data());
+}
+
+static void TestEncode( int print )
+{
+    for(const ENCODEREF& r : encodeRefs) {
+        std::vector<int16_t> pcm((size_t)r.frames * r.chans);
+        GenerateSignal(pcm.data(), r.frames, r.chans, 42);
+        uint32_t size = AdpcmEncodedSize(r.frames, r.chans, r.blockAlign);
+        std::vector<uint8_t> out(size), out4(size);
+        uint32_t l = AdpcmEncode(pcm.data(), r.frames, r.chans, r.blockAlign, r.exhaustive, NULL, out.data());
+        uint64_t h = Hash(out.data(), l);
+        if(print) {
+            printf("    { %u, %4u, %6u, %d, 0x%016llxull, {", r.chans, r.blockAlign, r.frames, r.exhaustive, (unsigned long long)h);
+            for(int k=0; k<32; ++k)
+                printf("%s0x%02x", k?",":"", out[k]);
+            printf("} },\n");
+            continue;
+        }
+        CHECK(l == size, "encode %u channels, blockAlign %u: %u bytes, expected %u", r.chans, r.blockAlign, l, size);
+        CHECK(h == r.hash && !memcmp(out.data(), r.first, sizeof(r.first)), "encode %u channels, blockAlign %u, exhaustive %d: output differs from the reference blocks",
+            r.chans, r.blockAlign, r.exhaustive);
+
+        // the workers don't change the output, whether the encoding starts from one of them or not
+        WORKERPOOL* pool = CreateWorkerPool(4);
+        uint32_t l4 = AdpcmEncode(pcm.data(), r.frames, r.chans, r.blockAlign, r.exhaustive, pool, out4.data());
+        CHECK(l4 == l && !memcmp(out.data(), out4.data(), l), "encode %u channels, blockAlign %u: 4 workers differ from 1 thread", r.chans, r.blockAlign);
+        std::vector<ENCODEJOB> jobs(6);
+        for(ENCODEJOB& job : jobs) {
+            job.pcm = pcm.data();
+            job.ref = &r;
+            job.pool = pool;
+            job.out.resize(size);
+            SubmitWork(pool, EncodeJob, &job);
+        }
+        DestroyWorkerPool(pool);
+        for(ENCODEJOB& job : jobs)
+            CHECK(job.length == l && !memcmp(out.data(), job.out.data(), l), "encode %u channels, blockAlign %u: encoded from a worker, the output differs",
+                r.chans, r.blockAlign);
+
+        // nor encoding by pieces of chunks, like the streamed conversion does
+        uint32_t spb = AdpcmSamplesIn(0, r.chans, r.blockAlign, 0);
+        uint32_t nfull = r.frames / spb;
+        const uint32_t pieces[] = { ADPCM_CHUNK_BLOCKS, 3*ADPCM_CHUNK_BLOCKS };
+        for(uint32_t piece : pieces) {
+            std::vector<uint8_t> byp((size_t)nfull * r.blockAlign);
+            for(uint32_t b=0; b<nfull; b+=piece) {
+                uint32_t n = (nfull - b < piece)? nfull - b : piece;
+                AdpcmEncodeBlocks(b? pcm.data() + (size_t)(b-1)*spb*r.chans : NULL, pcm.data() + (size_t)b*spb*r.chans,
+                    n, r.chans, r.blockAlign, r.exhaustive, NULL, byp.data() + (size_t)b*r.blockAlign);
+            }
+            CHECK(!memcmp(byp.data(), out.data(), byp.size()), "encode %u channels, blockAlign %u: pieces of %u blocks differ", r.chans, r.blockAlign, piece);
+        }
+
+        // what is encoded decodes like sox does, and close to the input
+        CheckDecode("encoded", out.data(), l, r.chans, r.blockAlign);
+        MINIWAVEFORMAT mf = AdpcmFormat(r.chans, r.blockAlign);
+        std::vector<int16_t> dec((size_t)AdpcmSamplesIn(l, r.chans, r.blockAlign, spb) * r.chans);
+        uint32_t n = AdpcmDecode(out.data(), l, &mf, dec.data());
+        CHECK(n >= r.frames, "encode %u channels, blockAlign %u: %u samples decoded for %u", r.chans, r.blockAlign, n, r.frames);
+        double err = 0, sig = 0;
+        for(size_t i=0; i<(size_t)r.frames*r.chans; ++i) {
+            double d = (double)dec[i] - pcm[i];
+            err += d*d;
+            sig += (double)pcm[i]*pcm[i];
+        }
+        CHECK(err * 100 < sig, "encode %u channels, blockAlign %u: signal to noise ratio under 20dB", r.chans, r.blockAlign);
+    }
+}
+
+int main( int argc, char** argv )
+{
+    // --print-refs writes test_adpcm_refs.h, after a deliberate change of the encoder output
+    int print = (argc > 1 && !strcmp(argv[1], "--print-refs"));
+    if(!print) {
+        TestDecodeRandom();
+        TestEncodeSox();
+    }
+    TestEncode(print);
+    if(print)
+        return 0;
+    if(failures)
+        printf("%d failures\n", failures);
+    else
+        printf("MS ADPCM: ok\n");
+    return failures? 1 : 0;
+}
@@ -0,0 +1,7 @@
+// Generated by test_adpcm --print-refs: { chans, blockAlign, frames, exhaustive, hash, first bytes }
+    { 1,   64,  10000, 0, 0xb2dc26f777fbe689ull, {0x06,0xd3,0x00,0x1e,0x18,0x64,0x21,0x74,0x0e,0xeb,0x2e,0xc2,0x05,0x02,0x12,0xe2,0xcc,0x2b,0x2c,0x4f,0x21,0xf3,0xef,0xec,0xfe,0xe1,0xf7,0x0e,0x50,0xe0,0xdf,0x0b} },
+    { 1,  256,  20000, 0, 0xef67aebf45046ea0ull, {0x05,0x10,0x00,0x1e,0x18,0x64,0x21,0x78,0x8c,0x11,0x73,0xe3,0xe4,0xcf,0xef,0xd3,0xfe,0x72,0x3b,0x4e,0x0e,0xd3,0xee,0x21,0x32,0x23,0xe4,0xb9,0x10,0xe1,0xf2,0x5e} },
+    { 1,  256,  20000, 1, 0x692c82112e6f1b52ull, {0x00,0x15,0x01,0x1e,0x18,0x64,0x21,0xaa,0xed,0xee,0x35,0x13,0x24,0x0f,0xdc,0xce,0xee,0x41,0x60,0x31,0x1e,0xcf,0xdd,0xef,0x24,0x44,0x23,0x0b,0xfd,0xde,0xd0,0x52} },
+    { 2,  512,  30001, 0, 0x2095712919c63ff1ull, {0x05,0x05,0xea,0x00,0x98,0x00,0x75,0x1a,0xf6,0x16,0x64,0x21,0xe8,0x20,0x9c,0x01,0x12,0xd8,0x0f,0xe1,0x77,0x42,0x1f,0xe1,0x21,0x11,0xde,0xaa,0x1e,0xf2,0xfd,0x02} },
+    { 2,  512,  30001, 1, 0xd817f4e3579a1cbdull, {0x04,0x04,0x56,0x01,0x22,0x01,0x75,0x1a,0xf6,0x16,0x64,0x21,0xe8,0x20,0x88,0xee,0xee,0xcd,0xec,0xde,0x42,0x03,0x43,0x24,0x34,0x34,0x11,0xde,0xeb,0xdf,0x9c,0xef} },
+    { 6, 1536,  12345, 0, 0xb1deaf68eb6835d9ull, {0x05,0x05,0x05,0x05,0x05,0x05,0x69,0x01,0xf6,0x00,0x10,0x00,0x95,0x00,0xf4,0x00,0x14,0x01,0x4a,0x15,0xe4,0x15,0x8d,0x16,0xf5,0x18,0x5c,0x14,0x79,0x18,0x64,0x21} },
@@ -0,0 +1,143 @@
+// Resampler: streamed by pieces against Resample(), and the response of every kernel (decimation ones included)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <vector>
+
+#include "resample.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if(!(cond)) { printf("FAIL: " __VA_ARGS__); printf("\n"); ++failures; } } while(0)
+
+static const char* qualities[] = { "quick", "medium", "high", "veryhigh" };
+
+// 44100->22050 and 44100->11025 use the decimation kernels, 44100->44099 interpolates the phases
+static const int ratios[][2] = {
+    { 44100, 22050 }, { 44100, 11025 }, { 48000, 24000 }, { 44100, 32000 }, { 48000, 44100 },
+    { 22050, 44100 }, { 8000, 22050 }, { 44100, 44099 },
+};
+
+static uint32_t Random( uint32_t* state )
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// Tones and noise, loud enough to clip here and there after the filter
+static void GenerateSignal( int16_t* pcm, uint32_t frames, uint32_t chans, int rate )
+{
+    uint32_t seed = 7;
+    for(uint32_t i=0; i<frames; ++i)
+        for(uint32_t c=0; c<chans; ++c) {
+            double v = 12000.0 * sin(2*M_PI*440.0*(c+1)*i/rate) + 9000.0 * sin(2*M_PI*5000.0*i/rate)
+                + (double)((int)(Random(&seed) & 0x1fff) - 4096);
+            if(i % 5000 < 100)
+                v *= 3;
+            pcm[(size_t)i*chans + c] = (int16_t)(v > 32767? 32767 : (v < -32768? -32768 : v));
+        }
+}
+
+// Push in pieces of piece frames (cycling through a few sizes when piece is 0) and compare with Resample()
+static void TestStream( const RESAMPLER* rs, const char* what, const int16_t* in, uint32_t frames, uint32_t chans,
+    const std::vector<int16_t>& ref, uint32_t piece )
+{
+    static const uint32_t cycle[] = { 1, 5, 64, 333, 4096 };
+    RESAMPLESTREAM* st = CreateResampleStream(rs, chans, frames);
+    std::vector<int16_t> got;
+    uint32_t done = 0, k = 0;
+    while(done < frames) {
+        uint32_t n = piece? piece : cycle[k++ % 5];
+        if(n > frames - done)
+            n = frames - done;
+        const int16_t* out;
+        uint32_t nout = ResampleStreamPush(st, in + (size_t)done*chans, n, &out);
+        got.insert(got.end(), out, out + (size_t)nout*chans);
+        done += n;
+    }
+    FreeResampleStream(st);
+    CHECK(got.size() == ref.size(), "%s, pieces of %u: %zu output frames, Resample gives %zu", what, piece, got.size()/chans, ref.size()/chans);
+    if(got.size() == ref.size())
+        for(size_t i=0; i<got.size(); ++i)
+            if(got[i] != ref[i]) {
+                CHECK(0, "%s, pieces of %u: sample %zu is %d, Resample gives %d", what, piece, i, got[i], ref[i]);
+                break;
+            }
+}
+
+static void TestStreams( void )
+{
+    const uint32_t pieces[] = { 0, 1, 7, 1000, 4096, 65536 };
+    for(auto& r : ratios)
+        for(int q=RESAMPLE_QUICK; q<=RESAMPLE_VERYHIGH; ++q)
+            for(uint32_t chans=1; chans<=2; ++chans) {
+                uint32_t frames = 12011;
+                std::vector<int16_t> in((size_t)frames*chans);
+                GenerateSignal(in.data(), frames, chans, r[0]);
+                RESAMPLER* rs = CreateResampler(r[0], r[1], q);
+                std::vector<int16_t> ref((size_t)ResampledLength(rs, frames)*chans);
+                uint32_t n = Resample(rs, in.data(), frames, chans, ref.data());
+                CHECK(n*chans == ref.size(), "Resample %d->%d: %u frames for %zu", r[0], r[1], n, ref.size()/chans);
+                char what[64];
+                snprintf(what, sizeof(what), "%d->%d %s, %u channels", r[0], r[1], qualities[q], chans);
+                for(uint32_t piece : pieces)
+                    TestStream(rs, what, in.data(), frames, chans, ref, piece);
+                FreeResampler(rs);
+            }
+}
+
+// Peak error against the ideal output for a tone of the pass band, and peak level of a tone above the new Nyquist
+// frequency (it must be filtered out, not aliased), away from the ends
+static void ToneResponse( const RESAMPLER* rs, int inrate, int outrate, double freq, double* peakerr, double* peak )
+{
+    const double amp = 16000.0;
+    uint32_t frames = inrate / 2;
+    std::vector<int16_t> in(frames);
+    for(uint32_t i=0; i<frames; ++i)
+        in[i] = (int16_t)lrint(amp * sin(2*M_PI*freq*i/inrate));
+    std::vector<int16_t> out(ResampledLength(rs, frames));
+    uint32_t n = Resample(rs, in.data(), frames, 1, out.data());
+    *peakerr = *peak = 0;
+    for(uint32_t k=n/8; k<n-n/8; ++k) {
+        double ideal = amp * sin(2*M_PI*freq*k/outrate);
+        *peakerr = fmax(*peakerr, fabs(out[k] - ideal) / amp);
+        *peak = fmax(*peak, fabs((double)out[k]) / amp);
+    }
+}
+
+static void TestResponse( void )
+{
+    // pass band error and stop band level for each preset, in dB
+    static const double maxerr[] = { -45, -55, -70, -75 };
+    static const double maxstop[] = { -45, -65, -75, -75 };
+    for(auto& r : ratios)
+        for(int q=RESAMPLE_QUICK; q<=RESAMPLE_VERYHIGH; ++q) {
+            RESAMPLER* rs = CreateResampler(r[0], r[1], q);
+            int low = (r[0] < r[1])? r[0] : r[1];
+            double err, peak, stoperr, stop;
+            ToneResponse(rs, r[0], r[1], 0.25 * low / 2, &err, &peak);
+            CHECK(20*log10(err + 1e-9) < maxerr[q], "%d->%d %s: pass band error %.1fdB", r[0], r[1], qualities[q], 20*log10(err + 1e-9));
+            if(r[1] < r[0] * 0.9) {
+                ToneResponse(rs, r[0], r[1], 0.5 * (r[1] / 2 + r[0] / 2), &stoperr, &stop);
+                CHECK(20*log10(stop + 1e-9) < maxstop[q], "%d->%d %s: stop band level %.1fdB", r[0], r[1], qualities[q], 20*log10(stop + 1e-9));
+            }
+            FreeResampler(rs);
+        }
+}
+
+int main( void )
+{
+    TestStreams();
+    TestResponse();
+    if(failures)
+        printf("%d failures\n", failures);
+    else
+        printf("Resampler: ok\n");
+    return failures? 1 : 0;
+}
@@ -0,0 +1,154 @@
+// Streamed conversion: ConvertEntryStreamed() must write the same bank as ConvertEntry() + WriteBankEntry()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "rexwb.h"
+#include "resample.h"
+#include "genbank.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if(!(cond)) { printf("FAIL: " __VA_ARGS__); printf("\n"); ++failures; } } while(0)
+
+static int ReadFile( const char* name, std::vector<uint8_t>& data )
+{
+    FILE* f = fopen(name, "rb");
+    if(!f)
+        return -1;
+    fseek(f, 0, SEEK_END);
+    data.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    int ok = fread(data.data(), 1, data.size(), f) == data.size();
+    fclose(f);
+    return ok? 0 : -1;
+}
+
+// Every entry of the bank, whole or by pieces of opt->memlimit. Return how many were bigger than the limit
+static int ConvertBank( const WaveBank* wb, const char* outfile, const REXWB_OPTIONS* opt, int streamed )
+{
+    BANKWRITER w;
+    if(OpenBankWriter(&w, wb, outfile, 0))
+        return -1;
+    int ret = 0, big = 0;
+    for(uint32_t j=0; j<wb->bank.dwEntryCount && !ret; ++j) {
+        WAVEBANKENTRYINFO info;
+        GetWaveBankEntry(wb, j, &info, 0);
+        if(streamed) {
+            big += EntryWorkingSet(wb, &info, opt) > ((size_t)opt->memlimit << 20);
+            ret = ConvertEntryStreamed(wb, &info, opt, NULL, &w);
+        } else {
+            CONVERTEDENTRY e;
+            memset(&e, 0, sizeof(e));
+            ret = ConvertEntry(wb, &info, opt, NULL, &e);
+            if(!ret)
+                ret = WriteBankEntry(&w, &info, &e);
+            FreeConvertedEntry(&e);
+        }
+    }
+    if(ret) {
+        AbortBankWriter(&w);
+        return -1;
+    }
+    return CloseBankWriter(&w)? -1 : big;
+}
+
+typedef struct {
+    const char* name;
+    int         rate;
+    int         force, mono, bits8, quality, exhaustive, adaptive, trimtail, trimsilence, automono;
+} CONVERTCASE;
+
+static const CONVERTCASE cases[] = {
+    { "22050",                  22050, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+    { "11025 -f -q quick",      11025, 1, 0, 0, REXWB_QUALITY_QUICK, 0, 0, 0, 0, 0 },
+    { "32000 -m -e",            32000, 0, 1, 0, 0, 1, 0, 0, 0, 0 },
+    { "16000 -8",               16000, 1, 0, 1, REXWB_QUALITY_MEDIUM, 0, 0, 0, 0, 0 },
+    { "44100 -a -q veryhigh",   44100, 0, 0, 0, REXWB_QUALITY_VERYHIGH, 0, 1, 0, 0, 0 },
+    { "22050 -z --auto-mono -t",22050, 0, 0, 0, 0, 0, 0, 1, 1, 1 },
+    { "24000 -f -z -a",         24000, 1, 0, 0, 0, 0, 1, 0, 1, 0 },
+};
+
+static void TestBank( const char* dir, const char* what, const GENBANKOPTIONS* gen )
+{
+    std::string in = std::string(dir) + "/streamed_in.xwb";
+    std::string whole = std::string(dir) + "/streamed_whole.xwb";
+    std::string pieces = std::string(dir) + "/streamed_pieces.xwb";
+    if(GenerateWaveBank(in.c_str(), gen)) {
+        CHECK(0, "%s: cannot write %s", what, in.c_str());
+        return;
+    }
+    WaveBank wb;
+    if(OpenWaveBank(&wb, in.c_str(), 0)) {
+        CHECK(0, "%s: cannot open %s", what, in.c_str());
+        return;
+    }
+    for(const CONVERTCASE& c : cases) {
+        if((c.automono || c.mono) && (wb.bank.dwFlags & WAVEBANK_FLAGS_COMPACT))
+            continue;
+        REXWB_OPTIONS opt = {};
+        opt.rate = c.rate;
+        opt.force = c.force;
+        opt.mono = c.mono;
+        opt.bits8 = c.bits8;
+        opt.quality = c.quality;
+        opt.exhaustive = c.exhaustive;
+        opt.adaptive = c.adaptive;
+        opt.trimtail = c.trimtail;
+        opt.trimsilence = c.trimsilence;
+        opt.automono = c.automono;
+        opt.monodiff = -1;
+        opt.jobs = 1;
+        int r1 = ConvertBank(&wb, whole.c_str(), &opt, 0);
+        opt.memlimit = 1;
+        int big = ConvertBank(&wb, pieces.c_str(), &opt, 1);
+        CHECK(r1 >= 0 && big >= 0, "%s, %s: conversion failed", what, c.name);
+        if(r1 < 0 || big < 0)
+            continue;
+        CHECK(big > 0, "%s, %s: no entry was converted by pieces", what, c.name);
+        std::vector<uint8_t> a, b;
+        CHECK(!ReadFile(whole.c_str(), a) && !ReadFile(pieces.c_str(), b), "%s, %s: cannot read the outputs", what, c.name);
+        size_t k = 0;
+        while(k < a.size() && k < b.size() && a[k] == b[k])
+            ++k;
+        CHECK(a.size() == b.size() && k == a.size(), "%s, %s: streamed output differs at byte %zu (%zu and %zu bytes)",
+            what, c.name, k, a.size(), b.size());
+    }
+    CloseWaveBank(&wb);
+    remove(in.c_str());
+    remove(whole.c_str());
+    remove(pieces.c_str());
+}
+
+int main( int argc, char** argv )
+{
+    const char* dir = (argc > 1)? argv[1] : ".";
+    GENBANKOPTIONS gen;
+    GenBankDefaults(&gen);
+    gen.entries = 6;
+    gen.seconds = 3.0f;
+    TestBank(dir, "mixed bank", &gen);
+
+    // silence to trim and pseudo stereo
+    gen.silence = 0.3f;
+    gen.alike = 1;
+    gen.seed = 5;
+    TestBank(dir, "padded bank", &gen);
+
+    GenBankDefaults(&gen);
+    gen.entries = 3;
+    gen.seconds = 3.0f;
+    gen.compact = 1;
+    TestBank(dir, "compact bank", &gen);
+
+    FreeResamplers();
+    if(failures)
+        printf("%d failures\n", failures);
+    else
+        printf("Streamed conversion: ok\n");
+    return failures? 1 : 0;
+}